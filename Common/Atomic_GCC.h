@@ -59,15 +59,24 @@ inline void AtomicIncrement(volatile u32& target) {
 	__sync_add_and_fetch(&target, 1);
 }
 
+// Returns the value before the add.
+inline u32 AtomicFetchAdd(volatile u32& target, u32 value) {
+	return __sync_fetch_and_add(&target, value);
+}
+
 inline u32 AtomicLoad(volatile u32& src) {
 	return src; // 32-bit reads are always atomic.
 }
 inline u32 AtomicLoadAcquire(volatile u32& src) {
 	//keep the compiler from caching any memory references
 	u32 result = src; // 32-bit reads are always atomic.
-	//__sync_synchronize(); // TODO: May not be necessary.
+#if defined(ARM) || defined(MIPS)
+	// Weakly ordered, later loads could otherwise see older data.
+	__sync_synchronize();
+#else
 	// Compiler instruction only. x86 loads always have acquire semantics.
 	__asm__ __volatile__ ( "":::"memory" );
+#endif
 	return result;
 }
 
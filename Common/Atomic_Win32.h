@@ -55,6 +55,11 @@ inline void AtomicIncrement(volatile u32& target) {
 	InterlockedIncrement((volatile LONG*)&target);
 }
 
+// Returns the value before the add.
+inline u32 AtomicFetchAdd(volatile u32& target, u32 value) {
+	return (u32)InterlockedExchangeAdd((volatile LONG*)&target, (LONG)value);
+}
+
 inline void AtomicDecrement(volatile u32& target) {
 	InterlockedDecrement((volatile LONG*)&target);
 }
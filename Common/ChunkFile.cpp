@@ -0,0 +1,295 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <functional>
+
+#include "Common.h"
+#include "ChunkFile.h"
+#include "FileUtil.h"
+#include "Hash.h"
+#include "ThreadPools.h"
+
+namespace {
+	struct ChunkJob
+	{
+		const u8 *src;
+		size_t srcSize;
+		u8 *dest;
+		size_t destSize;
+		u32 checksum;
+		bool ok;
+	};
+
+	// Parallelizable over jobs.
+	void CompressChunkJobs(ChunkJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			ChunkJob &job = jobs[i];
+			snappy_compress((const char *)job.src, job.srcSize, (char *)job.dest, &job.destSize);
+			job.checksum = HashAdler32(job.dest, job.destSize);
+			job.ok = true;
+		}
+	}
+
+	// Parallelizable over jobs.  Here src is compressed.
+	void DecompressChunkJobs(ChunkJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			ChunkJob &job = jobs[i];
+			size_t size = job.destSize;
+			job.ok = HashAdler32(job.src, job.srcSize) == job.checksum;
+			job.ok = job.ok && snappy_uncompress((const char *)job.src, job.srcSize, (char *)job.dest, &size) == SNAPPY_OK;
+			job.ok = job.ok && size == job.destSize;
+		}
+	}
+}
+
+bool CChunkFileReader::CompressChunks(const std::vector<u8> &buffer, std::vector<u8> &out)
+{
+	if (buffer.empty())
+		return false;
+
+	const size_t count = (buffer.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	const size_t tableSize = sizeof(u32) + count * sizeof(SChunkEntry);
+
+	// Compress each chunk straight into its worst case slot, then pack them afterward.
+	const size_t maxChunkSize = snappy_max_compressed_length(CHUNK_SIZE);
+	std::vector<u8> scratch(count * maxChunkSize);
+	std::vector<ChunkJob> jobs(count);
+	for (size_t i = 0; i < count; ++i) {
+		ChunkJob &job = jobs[i];
+		job.src = &buffer[i * CHUNK_SIZE];
+		job.srcSize = std::min((size_t)CHUNK_SIZE, buffer.size() - i * CHUNK_SIZE);
+		job.dest = &scratch[i * maxChunkSize];
+		job.destSize = maxChunkSize;
+		job.ok = false;
+	}
+	GlobalThreadPool::Loop(std::bind(&CompressChunkJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)count);
+
+	size_t total = tableSize;
+	for (size_t i = 0; i < count; ++i)
+		total += jobs[i].destSize;
+	out.resize(total);
+
+	*(u32 *)&out[0] = (u32)count;
+	SChunkEntry *entries = (SChunkEntry *)&out[sizeof(u32)];
+	u8 *dest = &out[tableSize];
+	for (size_t i = 0; i < count; ++i) {
+		entries[i].CompressedSize = (u32)jobs[i].destSize;
+		entries[i].UncompressedSize = (u32)jobs[i].srcSize;
+		entries[i].Checksum = jobs[i].checksum;
+		memcpy(dest, jobs[i].dest, jobs[i].destSize);
+		dest += jobs[i].destSize;
+	}
+	return true;
+}
+
+bool CChunkFileReader::DecompressChunks(const u8 *data, size_t size, std::vector<u8> &buffer, size_t uncompressedSize)
+{
+	if (size < sizeof(u32)) {
+		ERROR_LOG(COMMON, "ChunkReader: Missing chunk table");
+		return false;
+	}
+	const u32 count = *(const u32 *)data;
+	const size_t tableSize = sizeof(u32) + (size_t)count * sizeof(SChunkEntry);
+	if (tableSize > size) {
+		ERROR_LOG(COMMON, "ChunkReader: Bad chunk count %d", count);
+		return false;
+	}
+
+	const SChunkEntry *entries = (const SChunkEntry *)(data + sizeof(u32));
+	std::vector<ChunkJob> jobs(count);
+	size_t srcPos = tableSize;
+	size_t destPos = 0;
+	for (u32 i = 0; i < count; ++i) {
+		srcPos += entries[i].CompressedSize;
+		destPos += entries[i].UncompressedSize;
+	}
+	if (srcPos != size || destPos != uncompressedSize || count == 0) {
+		ERROR_LOG(COMMON, "ChunkReader: Chunk table doesn't match file size");
+		return false;
+	}
+
+	buffer.resize(uncompressedSize);
+	srcPos = tableSize;
+	destPos = 0;
+	for (u32 i = 0; i < count; ++i) {
+		ChunkJob &job = jobs[i];
+		job.src = data + srcPos;
+		job.srcSize = entries[i].CompressedSize;
+		job.dest = &buffer[destPos];
+		job.destSize = entries[i].UncompressedSize;
+		job.checksum = entries[i].Checksum;
+		job.ok = false;
+		srcPos += job.srcSize;
+		destPos += job.destSize;
+	}
+	GlobalThreadPool::Loop(std::bind(&DecompressChunkJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)count);
+
+	for (u32 i = 0; i < count; ++i) {
+		if (!jobs[i].ok) {
+			ERROR_LOG(COMMON, "ChunkReader: Chunk %d is corrupt", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CChunkFileReader::LoadFile(const std::string& _rFilename, int _Revision, std::vector<u8> &buffer, std::string* _failureReason)
+{
+	INFO_LOG(COMMON, "ChunkReader: Loading %s" , _rFilename.c_str());
+	_failureReason->clear();
+	_failureReason->append("LoadStateWrongVersion");
+
+	if (!File::Exists(_rFilename)) {
+		_failureReason->clear();
+		_failureReason->append("LoadStateDoesntExist");
+		ERROR_LOG(COMMON, "ChunkReader: File doesn't exist");
+		return false;
+	}
+
+	// Check file size
+	const u64 fileSize = File::GetSize(_rFilename);
+	static const u64 headerSize = sizeof(SChunkHeader);
+	if (fileSize < headerSize)
+	{
+		ERROR_LOG(COMMON,"ChunkReader: File too small");
+		return false;
+	}
+
+	File::IOFile pFile(_rFilename, "rb");
+	if (!pFile)
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Can't open file for reading");
+		return false;
+	}
+
+	// read the header
+	SChunkHeader header;
+	if (!pFile.ReadArray(&header, 1))
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Bad header size");
+		return false;
+	}
+
+	// Check revision
+	if (header.Revision != _Revision)
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Wrong file revision, got %d expected %d",
+			header.Revision, _Revision);
+		return false;
+	}
+
+	if (strcmp(header.GitVersion, PPSSPP_GIT_VERSION) != 0)
+	{
+		WARN_LOG(COMMON, "This savestate was generated by a different version of PPSSPP, %s. It may not load properly.",
+			header.GitVersion);
+	}
+
+	// get size
+	const int sz = (int)(fileSize - headerSize);
+	if (header.ExpectedSize != sz || sz <= 0)
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Bad file size, got %d expected %d",
+			sz, header.ExpectedSize);
+		return false;
+	}
+
+	// read the state
+	std::vector<u8> fileData(sz);
+	if (!pFile.ReadBytes(&fileData[0], sz))
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Error reading file");
+		return false;
+	}
+
+	if (header.Compress == COMPRESS_SNAPPY_CHUNKED) {
+		if (!DecompressChunks(&fileData[0], sz, buffer, header.UncompressedSize)) {
+			buffer.clear();
+			return false;
+		}
+	} else if (header.Compress) {
+		size_t uncomp_size = header.UncompressedSize;
+		buffer.resize(uncomp_size);
+		snappy_uncompress((const char *)&fileData[0], sz, (char *)&buffer[0], &uncomp_size);
+		if ((int)uncomp_size != header.UncompressedSize) {
+			ERROR_LOG(COMMON,"Size mismatch: file: %i  calc: %i", (int)header.UncompressedSize, (int)uncomp_size);
+		}
+	} else {
+		buffer.swap(fileData);
+	}
+
+	return !buffer.empty();
+}
+
+bool CChunkFileReader::SaveFile(const std::string& _rFilename, int _Revision, const std::vector<u8> &buffer)
+{
+	INFO_LOG(COMMON, "ChunkReader: Writing %s" , _rFilename.c_str());
+
+	File::IOFile pFile(_rFilename, "wb");
+	if (!pFile)
+	{
+		ERROR_LOG(COMMON,"ChunkReader: Error opening file for write");
+		return false;
+	}
+
+	bool compress = true;
+	const size_t sz = buffer.size();
+
+	// Create header
+	SChunkHeader header;
+	header.Compress = compress ? COMPRESS_SNAPPY_CHUNKED : COMPRESS_NONE;
+	header.Revision = _Revision;
+	header.ExpectedSize = (int)sz;
+	header.UncompressedSize = (int)sz;
+	strncpy(header.GitVersion, PPSSPP_GIT_VERSION, 32);
+
+	// Write to file
+	if (compress) {
+		std::vector<u8> compressed_buffer;
+		if (!CompressChunks(buffer, compressed_buffer)) {
+			ERROR_LOG(COMMON,"ChunkReader: Nothing to compress");
+			return false;
+		}
+		size_t comp_len = compressed_buffer.size();
+		header.ExpectedSize = (int)comp_len;
+		if (!pFile.WriteArray(&header, 1))
+		{
+			ERROR_LOG(COMMON,"ChunkReader: Failed writing header");
+			return false;
+		}
+		if (!pFile.WriteBytes(&compressed_buffer[0], comp_len)) {
+			ERROR_LOG(COMMON,"ChunkReader: Failed writing compressed data");
+			return false;
+		}	else {
+			INFO_LOG(COMMON, "Savestate: Compressed %i bytes into %i", (int)sz, (int)comp_len);
+		}
+	} else {
+		if (!pFile.WriteArray(&header, 1))
+		{
+			ERROR_LOG(COMMON,"ChunkReader: Failed writing header");
+			return false;
+		}
+		if (!pFile.WriteBytes(&buffer[0], sz))
+		{
+			ERROR_LOG(COMMON,"ChunkReader: Failed writing data");
+			return false;
+		}
+	}
+
+	INFO_LOG(COMMON,"ChunkReader: Done writing %s",
+			 _rFilename.c_str());
+	return true;
+}
@@ -27,6 +27,7 @@
 // - Zero backwards/forwards compatibility
 // - Serialization code for anything complex has to be manually written.
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <deque>
@@ -125,10 +126,14 @@ public:
 	u8 **ptr;
 	Mode mode;
 	Error error;
+	// If set, MODE_WRITE grows this buffer as it goes, so no MODE_MEASURE pass is needed.
+	std::vector<u8> *growBuffer;
 
 public:
-	PointerWrap(u8 **ptr_, Mode mode_) : ptr(ptr_), mode(mode_), error(ERROR_NONE) {}
-	PointerWrap(unsigned char **ptr_, int mode_) : ptr((u8**)ptr_), mode((Mode)mode_), error(ERROR_NONE) {}
+	PointerWrap(u8 **ptr_, Mode mode_) : ptr(ptr_), mode(mode_), error(ERROR_NONE), growBuffer(NULL) {}
+	PointerWrap(unsigned char **ptr_, int mode_) : ptr((u8**)ptr_), mode((Mode)mode_), error(ERROR_NONE), growBuffer(NULL) {}
+	// *ptr_ must point at the start of buffer (or be NULL if it's empty.)
+	PointerWrap(u8 **ptr_, std::vector<u8> *buffer) : ptr(ptr_), mode(MODE_WRITE), error(ERROR_NONE), growBuffer(buffer) {}
 
 	void SetMode(Mode mode_) {mode = mode_;}
 	Mode GetMode() const {return mode;}
@@ -141,11 +146,29 @@ public:
 			mode = PointerWrap::MODE_MEASURE;
 	}
 
+	// Bytes written or read so far, only valid with a grow buffer.
+	size_t GrowOffset() const
+	{
+		return growBuffer->empty() ? 0 : *ptr - &(*growBuffer)[0];
+	}
+
+	void EnsureSpace(size_t size)
+	{
+		if (growBuffer == NULL)
+			return;
+		const size_t offset = GrowOffset();
+		if (offset + size > growBuffer->size())
+		{
+			growBuffer->resize(std::max(offset + size, growBuffer->size() * 2));
+			*ptr = &(*growBuffer)[0] + offset;
+		}
+	}
+
 	void DoVoid(void *data, int size)
 	{
 		switch (mode) {
 		case MODE_READ:	memcpy(data, *ptr, size); break;
-		case MODE_WRITE: memcpy(*ptr, data, size); break;
+		case MODE_WRITE: EnsureSpace(size); memcpy(*ptr, data, size); break;
 		case MODE_MEASURE: break;  // MODE_MEASURE - don't need to do anything
 		case MODE_VERIFY: for(int i = 0; i < size; i++) _dbg_assert_msg_(COMMON, ((u8*)data)[i] == (*ptr)[i], "Savestate verification failure: %d (0x%X) (at %p) != %d (0x%X) (at %p).\n", ((u8*)data)[i], ((u8*)data)[i], &((u8*)data)[i], (*ptr)[i], (*ptr)[i], &(*ptr)[i]); break;
 		default: break;  // throw an error?
@@ -444,7 +467,7 @@ public:
 		
 		switch (mode) {
 		case MODE_READ:		x = (char*)*ptr; break;
-		case MODE_WRITE:	memcpy(*ptr, x.c_str(), stringLen); break;
+		case MODE_WRITE:	EnsureSpace(stringLen); memcpy(*ptr, x.c_str(), stringLen); break;
 		case MODE_MEASURE: break;
 		case MODE_VERIFY: _dbg_assert_msg_(COMMON, !strcmp(x.c_str(), (char*)*ptr), "Savestate verification failure: \"%s\" != \"%s\" (at %p).\n", x.c_str(), (char*)*ptr, ptr); break;
 		}
@@ -458,7 +481,7 @@ public:
 
 		switch (mode) {
 		case MODE_READ:		x = (wchar_t*)*ptr; break;
-		case MODE_WRITE:	memcpy(*ptr, x.c_str(), stringLen); break;
+		case MODE_WRITE:	EnsureSpace(stringLen); memcpy(*ptr, x.c_str(), stringLen); break;
 		case MODE_MEASURE: break;
 		case MODE_VERIFY: _dbg_assert_msg_(COMMON, x == (wchar_t*)*ptr, "Savestate verification failure: \"%ls\" != \"%ls\" (at %p).\n", x.c_str(), (wchar_t*)*ptr, ptr); break;
 		}
@@ -585,165 +608,55 @@ public:
 	template<class T>
 	static bool Load(const std::string& _rFilename, int _Revision, T& _class, std::string* _failureReason) 
 	{
-		INFO_LOG(COMMON, "ChunkReader: Loading %s" , _rFilename.c_str());
-		_failureReason->clear();
-		_failureReason->append("LoadStateWrongVersion");
-
-		if (!File::Exists(_rFilename)) {
-			_failureReason->clear();
-			_failureReason->append("LoadStateDoesntExist");
-			ERROR_LOG(COMMON, "ChunkReader: File doesn't exist");
-			return false;
-		}
-				
-		// Check file size
-		const u64 fileSize = File::GetSize(_rFilename);
-		static const u64 headerSize = sizeof(SChunkHeader);
-		if (fileSize < headerSize)
-		{
-			ERROR_LOG(COMMON,"ChunkReader: File too small");
-			return false;
-		}
-
-		File::IOFile pFile(_rFilename, "rb");
-		if (!pFile)
-		{
-			ERROR_LOG(COMMON,"ChunkReader: Can't open file for reading");
-			return false;
-		}
-
-		// read the header
-		SChunkHeader header;
-		if (!pFile.ReadArray(&header, 1))
-		{
-			ERROR_LOG(COMMON,"ChunkReader: Bad header size");
+		std::vector<u8> buffer;
+		if (!LoadFile(_rFilename, _Revision, buffer, _failureReason))
 			return false;
-		}
-		
-		// Check revision
-		if (header.Revision != _Revision)
-		{
-			ERROR_LOG(COMMON,"ChunkReader: Wrong file revision, got %d expected %d",
-				header.Revision, _Revision);
-			return false;
-		}
-		
-		if (strcmp(header.GitVersion, PPSSPP_GIT_VERSION) != 0)
-		{
-			WARN_LOG(COMMON, "This savestate was generated by a different version of PPSSPP, %s. It may not load properly.",
-				header.GitVersion);
-		}
-
-		// get size
-		const int sz = (int)(fileSize - headerSize);
-		if (header.ExpectedSize != sz)
-		{
-			ERROR_LOG(COMMON,"ChunkReader: Bad file size, got %d expected %d",
-				sz, header.ExpectedSize);
-			return false;
-		}
-		
-		// read the state
-		u8* buffer = new u8[sz];
-		if (!pFile.ReadBytes(buffer, sz))
-		{
-			ERROR_LOG(COMMON,"ChunkReader: Error reading file");
-			return false;
-		}
 
-		u8 *ptr = buffer;
-		u8 *buf = buffer;
-		if (header.Compress) {
-			u8 *uncomp_buffer = new u8[header.UncompressedSize];
-			size_t uncomp_size = header.UncompressedSize;
-			snappy_uncompress((const char *)buffer, sz, (char *)uncomp_buffer, &uncomp_size);
-			if ((int)uncomp_size != header.UncompressedSize) {
-				ERROR_LOG(COMMON,"Size mismatch: file: %i  calc: %i", (int)header.UncompressedSize, (int)uncomp_size);
-			}
-			ptr = uncomp_buffer;
-			buf = uncomp_buffer;
-			delete [] buffer;
-		}
-
-		PointerWrap p(&ptr, PointerWrap::MODE_READ);
-		_class.DoState(p);
-		delete[] buf;
-		
+		bool result = LoadPtr(&buffer[0], _class);
 		INFO_LOG(COMMON, "ChunkReader: Done loading %s" , _rFilename.c_str());
-		return p.error != p.ERROR_FAILURE;
+		return result;
 	}
 	
 	// Save file template
 	template<class T>
 	static bool Save(const std::string& _rFilename, int _Revision, T& _class)
 	{
-		INFO_LOG(COMMON, "ChunkReader: Writing %s" , _rFilename.c_str());
+		std::vector<u8> buffer;
+		if (!SaveToBuffer(buffer, _class))
+			return false;
+		return SaveFile(_rFilename, _Revision, buffer);
+	}
 
-		File::IOFile pFile(_rFilename, "wb");
-		if (!pFile)
+	// Serializes in a single pass, growing the buffer as needed.  Any existing
+	// contents of buffer are overwritten, but its allocation is reused.
+	template<class T>
+	static bool SaveToBuffer(std::vector<u8> &buffer, T& _class)
+	{
+		u8 *ptr = buffer.empty() ? NULL : &buffer[0];
+		PointerWrap p(&ptr, &buffer);
+		_class.DoState(p);
+		if (p.error == p.ERROR_FAILURE)
 		{
-			ERROR_LOG(COMMON,"ChunkReader: Error opening file for write");
+			buffer.clear();
 			return false;
 		}
+		buffer.resize(p.GrowOffset());
+		return true;
+	}
 
-		bool compress = true;
-
-		// Get data
-		u8 *ptr = 0;
-		PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
-		_class.DoState(p);
-		size_t const sz = (size_t)ptr;
-		
-		u8 * buffer = new u8[sz];
-		ptr = &buffer[0];
-		p.SetMode(PointerWrap::MODE_WRITE);
+	// In-memory variant, used for states that never touch the disk (like rewind.)
+	template<class T>
+	static bool LoadPtr(u8 *ptr, T& _class)
+	{
+		PointerWrap p(&ptr, PointerWrap::MODE_READ);
 		_class.DoState(p);
-
-		// Create header
-		SChunkHeader header;
-		header.Compress = compress ? 1 : 0;
-		header.Revision = _Revision;
-		header.ExpectedSize = (int)sz;
-		header.UncompressedSize = (int)sz;
-		strncpy(header.GitVersion, PPSSPP_GIT_VERSION, 32);
-
-		// Write to file
-		if (compress) {
-			size_t comp_len = snappy_max_compressed_length(sz);
-			u8 *compressed_buffer = new u8[comp_len];
-			snappy_compress((const char *)buffer, sz, (char *)compressed_buffer, &comp_len);
-			delete [] buffer;
-			header.ExpectedSize = (int)comp_len;
-			if (!pFile.WriteArray(&header, 1))
-			{
-				ERROR_LOG(COMMON,"ChunkReader: Failed writing header");
-				return false;
-			}
-			if (!pFile.WriteBytes(&compressed_buffer[0], comp_len)) {
-				ERROR_LOG(COMMON,"ChunkReader: Failed writing compressed data");
-				return false;
-			}	else {
-				INFO_LOG(COMMON, "Savestate: Compressed %i bytes into %i", (int)sz, (int)comp_len);
-			}
-			delete [] compressed_buffer;
-		} else {
-			if (!pFile.WriteArray(&header, 1))
-			{
-				ERROR_LOG(COMMON,"ChunkReader: Failed writing header");
-				return false;
-			}
-			if (!pFile.WriteBytes(&buffer[0], sz))
-			{
-				ERROR_LOG(COMMON,"ChunkReader: Failed writing data");
-				return false;
-			}
-			delete [] buffer;
-		}
-		
-		INFO_LOG(COMMON,"ChunkReader: Done writing %s", 
-				 _rFilename.c_str());
 		return p.error != p.ERROR_FAILURE;
 	}
+
+	// These only do the file I/O and (de)compression, and don't touch any state.
+	// That means they're safe to call from another thread.
+	static bool LoadFile(const std::string& _rFilename, int _Revision, std::vector<u8> &buffer, std::string* _failureReason);
+	static bool SaveFile(const std::string& _rFilename, int _Revision, const std::vector<u8> &buffer);
 	
 	template <class T>
 	static bool Verify(T& _class)
@@ -770,6 +683,19 @@ public:
 	}
 
 private:
+	// Values for SChunkHeader::Compress.
+	enum
+	{
+		COMPRESS_NONE = 0,
+		// A single snappy stream.  Only loaded, for older states.
+		COMPRESS_SNAPPY = 1,
+		// A u32 count, that many SChunkEntry, and then each chunk compressed separately.
+		COMPRESS_SNAPPY_CHUNKED = 2,
+	};
+
+	// Uncompressed size of each chunk except the last.
+	static const u32 CHUNK_SIZE = 1024 * 1024;
+
 	struct SChunkHeader
 	{
 		int Revision;
@@ -778,6 +704,17 @@ private:
 		int UncompressedSize;
 		char GitVersion[32];
 	};
+
+	struct SChunkEntry
+	{
+		u32 CompressedSize;
+		u32 UncompressedSize;
+		// Adler32 of the compressed data.
+		u32 Checksum;
+	};
+
+	static bool CompressChunks(const std::vector<u8> &buffer, std::vector<u8> &out);
+	static bool DecompressChunks(const u8 *data, size_t size, std::vector<u8> &buffer, size_t uncompressedSize);
 };
 
 #endif  // _POINTERWRAP_H_
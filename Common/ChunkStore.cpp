@@ -0,0 +1,336 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <functional>
+
+#include "ChunkStore.h"
+#include "FileUtil.h"
+#include "Hash.h"
+#include "ThreadPools.h"
+#include "../ext/snappy/snappy-c.h"
+
+extern const char *PPSSPP_GIT_VERSION;
+
+static const u32 MANIFEST_MAGIC = 0x4D535050;  // PPSM
+static const u32 INDEX_MAGIC = 0x58445050;  // PPDX
+// Bump when page keys change, older stores are then thrown away.  1 hashed pages with Murmur3, 2 with XXH64.
+static const u32 STORE_VERSION = 2;
+
+namespace {
+	struct PageJob
+	{
+		const u8 *src;
+		size_t srcSize;
+		u64 hash;
+		u32 check;
+		bool isNew;
+		std::vector<u8> compressed;
+		u8 *dest;
+		size_t destSize;
+		bool ok;
+	};
+
+	// Parallelizable over jobs.
+	void HashPageJobs(PageJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			PageJob &job = jobs[i];
+			job.hash = HashXXH64(job.src, job.srcSize);
+			job.check = HashAdler32(job.src, job.srcSize);
+		}
+	}
+
+	// Parallelizable over jobs, only compresses the new ones.
+	void CompressPageJobs(PageJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			PageJob &job = jobs[i];
+			if (!job.isNew)
+				continue;
+			size_t size = snappy_max_compressed_length(job.srcSize);
+			job.compressed.resize(size);
+			snappy_compress((const char *)job.src, job.srcSize, (char *)&job.compressed[0], &size);
+			job.compressed.resize(size);
+		}
+	}
+
+	// Parallelizable over jobs.  Here src is compressed.
+	void DecompressPageJobs(PageJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			PageJob &job = jobs[i];
+			size_t size = job.destSize;
+			job.ok = snappy_uncompress((const char *)job.src, job.srcSize, (char *)job.dest, &size) == SNAPPY_OK;
+			job.ok = job.ok && size == job.destSize;
+			job.ok = job.ok && HashAdler32(job.dest, job.destSize) == job.check;
+		}
+	}
+}
+
+ChunkStore::ChunkStore(const std::string &basePath)
+	: basePath_(basePath), packFilename_(basePath + ".ppdb"), indexFilename_(basePath + ".ppdx"), indexLoaded_(false)
+{
+}
+
+void ChunkStore::LoadIndex()
+{
+	if (indexLoaded_)
+		return;
+	indexLoaded_ = true;
+	index_.clear();
+
+	if (!File::Exists(indexFilename_))
+		return;
+
+	File::IOFile indexFile(indexFilename_, "rb");
+	IndexHeader header;
+	if (!indexFile.ReadArray(&header, 1) || header.magic != INDEX_MAGIC || header.version != STORE_VERSION)
+	{
+		// No manifest of this version can use its pages, so start over.
+		WARN_LOG(COMMON, "ChunkStore: %s is from an older version, starting a new store", indexFilename_.c_str());
+		indexFile.Close();
+		File::Delete(indexFilename_);
+		if (File::Exists(packFilename_))
+			File::Delete(packFilename_);
+		return;
+	}
+	if (!File::Exists(packFilename_))
+		return;
+
+	const u64 packSize = File::GetSize(packFilename_);
+	const u64 count = (File::GetSize(indexFilename_) - sizeof(IndexHeader)) / sizeof(IndexEntry);
+	std::vector<IndexEntry> entries((size_t)count);
+	if (count == 0 || !indexFile.ReadArray(&entries[0], entries.size()))
+		return;
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		// Might have crashed while appending to the pack, ignore pages that didn't make it.
+		if (entries[i].offset + entries[i].compressedSize > packSize)
+			continue;
+		index_[entries[i].key] = entries[i];
+	}
+	INFO_LOG(COMMON, "ChunkStore: %d pages in %s", (int)index_.size(), packFilename_.c_str());
+}
+
+bool ChunkStore::SaveFile(const std::string &manifestFilename, int revision, const std::vector<u8> &buffer)
+{
+	INFO_LOG(COMMON, "ChunkStore: Writing %s", manifestFilename.c_str());
+	LoadIndex();
+	if (buffer.empty())
+		return false;
+
+	const size_t count = (buffer.size() + PAGE_SIZE - 1) / PAGE_SIZE;
+	std::vector<PageJob> jobs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		jobs[i].src = &buffer[i * PAGE_SIZE];
+		jobs[i].srcSize = std::min((size_t)PAGE_SIZE, buffer.size() - i * PAGE_SIZE);
+		jobs[i].isNew = false;
+	}
+	GlobalThreadPool::Loop(std::bind(&HashPageJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)count);
+
+	std::vector<PageKey> keys(count);
+	std::map<PageKey, bool> pendingKeys;
+	for (size_t i = 0; i < count; ++i)
+	{
+		PageKey &key = keys[i];
+		key.hash = jobs[i].hash;
+		key.check = jobs[i].check;
+		key.size = (u32)jobs[i].srcSize;
+		// Pages repeat within a state too (zeroed memory, mostly), only store them once.
+		if (index_.find(key) == index_.end() && pendingKeys.find(key) == pendingKeys.end())
+		{
+			jobs[i].isNew = true;
+			pendingKeys[key] = true;
+		}
+	}
+	GlobalThreadPool::Loop(std::bind(&CompressPageJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)count);
+
+	// Pages first, then their index entries, so a crash never leaves the index pointing at junk.
+	if (!pendingKeys.empty())
+	{
+		u64 offset = File::Exists(packFilename_) ? File::GetSize(packFilename_) : 0;
+		File::IOFile packFile(packFilename_, "ab");
+		if (!packFile)
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Can't open %s for writing", packFilename_.c_str());
+			return false;
+		}
+
+		std::vector<IndexEntry> newEntries;
+		newEntries.reserve(pendingKeys.size());
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!jobs[i].isNew)
+				continue;
+			IndexEntry entry;
+			entry.key = keys[i];
+			entry.offset = offset;
+			entry.compressedSize = (u32)jobs[i].compressed.size();
+			entry.reserved = 0;
+			if (!packFile.WriteBytes(&jobs[i].compressed[0], entry.compressedSize))
+			{
+				ERROR_LOG(COMMON, "ChunkStore: Failed writing pages");
+				return false;
+			}
+			offset += entry.compressedSize;
+			newEntries.push_back(entry);
+		}
+		packFile.Close();
+
+		IndexHeader indexHeader;
+		indexHeader.magic = INDEX_MAGIC;
+		indexHeader.version = STORE_VERSION;
+		const bool newIndex = !File::Exists(indexFilename_);
+		File::IOFile indexFile(indexFilename_, "ab");
+		if (!indexFile || (newIndex && !indexFile.WriteArray(&indexHeader, 1)) || !indexFile.WriteArray(&newEntries[0], newEntries.size()))
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Failed writing index");
+			return false;
+		}
+		for (size_t i = 0; i < newEntries.size(); ++i)
+			index_[newEntries[i].key] = newEntries[i];
+	}
+
+	ManifestHeader header;
+	header.magic = MANIFEST_MAGIC;
+	header.version = STORE_VERSION;
+	header.revision = revision;
+	header.pageSize = PAGE_SIZE;
+	header.pageCount = (u32)count;
+	header.totalSize = (u32)buffer.size();
+	strncpy(header.gitVersion, PPSSPP_GIT_VERSION, 32);
+
+	File::IOFile manifest(manifestFilename, "wb");
+	if (!manifest || !manifest.WriteArray(&header, 1) || !manifest.WriteArray(&keys[0], keys.size()))
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Failed writing manifest %s", manifestFilename.c_str());
+		return false;
+	}
+
+	INFO_LOG(COMMON, "ChunkStore: Stored %d of %d pages", (int)pendingKeys.size(), (int)count);
+	return true;
+}
+
+bool ChunkStore::LoadFile(const std::string &manifestFilename, int revision, std::vector<u8> &buffer, std::string *failureReason)
+{
+	INFO_LOG(COMMON, "ChunkStore: Loading %s", manifestFilename.c_str());
+	failureReason->clear();
+	failureReason->append("LoadStateWrongVersion");
+
+	File::IOFile manifest(manifestFilename, "rb");
+	if (!manifest)
+	{
+		failureReason->clear();
+		failureReason->append("LoadStateDoesntExist");
+		ERROR_LOG(COMMON, "ChunkStore: Manifest doesn't exist");
+		return false;
+	}
+
+	ManifestHeader header;
+	if (!manifest.ReadArray(&header, 1) || header.magic != MANIFEST_MAGIC)
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Bad manifest header");
+		return false;
+	}
+	// Before version 2 there was no version, so check it before anything else in the header.
+	if (header.version != STORE_VERSION)
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Manifest is from store version %d, expected %d", header.version, STORE_VERSION);
+		return false;
+	}
+	if (header.pageSize != PAGE_SIZE)
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Bad manifest page size %d", header.pageSize);
+		return false;
+	}
+	if (header.revision != revision)
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Wrong revision, got %d expected %d", header.revision, revision);
+		return false;
+	}
+	if (strncmp(header.gitVersion, PPSSPP_GIT_VERSION, 32) != 0)
+	{
+		WARN_LOG(COMMON, "This savestate was generated by a different version of PPSSPP, %.32s. It may not load properly.", header.gitVersion);
+	}
+
+	std::vector<PageKey> keys(header.pageCount);
+	if (header.pageCount == 0 || (u64)header.pageCount * PAGE_SIZE < header.totalSize || !manifest.ReadArray(&keys[0], keys.size()))
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Bad manifest page list");
+		return false;
+	}
+
+	LoadIndex();
+	File::IOFile packFile(packFilename_, "rb");
+	if (!packFile)
+	{
+		ERROR_LOG(COMMON, "ChunkStore: Can't open %s", packFilename_.c_str());
+		return false;
+	}
+
+	// Read all the compressed pages first, then decompress them in parallel.
+	std::vector<u32> srcOffsets(keys.size());
+	std::vector<u8> compressed;
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		std::map<PageKey, IndexEntry>::iterator it = index_.find(keys[i]);
+		if (it == index_.end())
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Missing page %d", (int)i);
+			return false;
+		}
+		const IndexEntry &entry = it->second;
+		srcOffsets[i] = (u32)compressed.size();
+		compressed.resize(compressed.size() + entry.compressedSize);
+		if (!packFile.Seek(entry.offset, SEEK_SET) || !packFile.ReadBytes(&compressed[srcOffsets[i]], entry.compressedSize))
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Failed reading page %d", (int)i);
+			return false;
+		}
+	}
+
+	buffer.resize(header.totalSize);
+	std::vector<PageJob> jobs(keys.size());
+	size_t destPos = 0;
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		PageJob &job = jobs[i];
+		job.src = &compressed[srcOffsets[i]];
+		job.srcSize = index_[keys[i]].compressedSize;
+		job.dest = &buffer[destPos];
+		job.destSize = keys[i].size;
+		job.check = keys[i].check;
+		job.ok = destPos + job.destSize <= buffer.size();
+		if (!job.ok)
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Page sizes don't match state size");
+			return false;
+		}
+		destPos += job.destSize;
+	}
+	GlobalThreadPool::Loop(std::bind(&DecompressPageJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)jobs.size());
+
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (!jobs[i].ok)
+		{
+			ERROR_LOG(COMMON, "ChunkStore: Page %d is corrupt", (int)i);
+			return false;
+		}
+	}
+	return destPos == buffer.size();
+}
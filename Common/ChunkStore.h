@@ -0,0 +1,99 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+
+// Content addressed storage for save states.
+//
+// A state is split into fixed size pages, and each page is stored only once per store
+// (snappy compressed, keyed by its hash), in an append-only pack file.  Each saved state
+// is just a small manifest listing its pages.  Slots of the same game have mostly the
+// same RAM, so saving a slot usually only appends a few new pages.
+//
+// Not thread safe, use from one thread at a time.
+class ChunkStore
+{
+public:
+	// Uses basePath + ".ppdb" for page data and basePath + ".ppdx" for its index.
+	ChunkStore(const std::string &basePath);
+
+	const std::string &BasePath() const { return basePath_; }
+
+	bool SaveFile(const std::string &manifestFilename, int revision, const std::vector<u8> &buffer);
+	bool LoadFile(const std::string &manifestFilename, int revision, std::vector<u8> &buffer, std::string *failureReason);
+
+	enum {
+		PAGE_SIZE = 64 * 1024,
+	};
+
+private:
+	struct PageKey
+	{
+		u64 hash;
+		u32 check;
+		u32 size;
+
+		bool operator < (const PageKey &other) const
+		{
+			if (hash != other.hash)
+				return hash < other.hash;
+			if (check != other.check)
+				return check < other.check;
+			return size < other.size;
+		}
+	};
+
+	struct IndexEntry
+	{
+		PageKey key;
+		u64 offset;
+		u32 compressedSize;
+		u32 reserved;
+	};
+
+	// At the start of the index, the rest is IndexEntrys.
+	struct IndexHeader
+	{
+		u32 magic;
+		u32 version;
+	};
+
+	struct ManifestHeader
+	{
+		u32 magic;
+		u32 version;
+		int revision;
+		u32 pageSize;
+		u32 pageCount;
+		u32 totalSize;
+		char gitVersion[32];
+	};
+
+	void LoadIndex();
+
+	std::string basePath_;
+	std::string packFilename_;
+	std::string indexFilename_;
+	bool indexLoaded_;
+	std::map<PageKey, IndexEntry> index_;
+};
@@ -16,13 +16,29 @@
 // http://code.google.com/p/dolphin-emu/
 
 #include <algorithm>
+#include <cstring>
 #include "Hash.h"
-#if _M_SSE >= 0x402
-#include "CPUDetect.h"
+#include "../ext/xxhash.h"
+
+#if defined(__x86_64__) || (defined(_MSC_VER) && defined(_M_X64))
+#define HASH_CRC32C_X64
+#endif
+#if defined(HASH_CRC32C_X64) || defined(__i386__) || (defined(_MSC_VER) && defined(_M_IX86))
+#define HASH_CRC32C_AVAILABLE
 #include <nmmintrin.h>
+#ifdef _MSC_VER
+#define HASH_SSE42_TARGET
+#else
+// Lets these functions use the instruction without building everything with -msse4.2.
+#define HASH_SSE42_TARGET __attribute__((target("sse4.2")))
+#endif
+#endif
+// 32-bit CPUs (like most ARM ones) have no fast 64-bit multiply, which XXH64 is built on.
+#if !defined(HASH_CRC32C_X64) && !defined(_M_X64) && !defined(__aarch64__) && !defined(_M_ARM64)
+#define HASH_FAST64_LANES32
 #endif
 
-static u64 (*ptrHashFunction)(const u8 *src, int len, u32 samples) = &GetMurmurHash3;
+static bool hashUseHardware = false;
 
 // uint32_t
 // WARNING - may read one more byte!
@@ -112,6 +128,20 @@ u32 HashEctor(const u8* ptr, int length)
 }
 
 
+//----------
+// Finalization mix - avalanches all bits to within 0.05% bias
+
+inline u64 fmix64(u64 k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
 #ifdef _M_X64
 
 //-----------------------------------------------------------------------------
@@ -149,20 +179,6 @@ inline void bmix64(u64 & h1, u64 & h2, u64 & k1, u64 & k2, u64 & c1, u64 & c2)
     c2 = c2*5+0x6bce6396;
 }
 
-//----------
-// Finalization mix - avalanches all bits to within 0.05% bias
-
-inline u64 fmix64(u64 k)
-{
-    k ^= k >> 33;
-    k *= 0xff51afd7ed558ccd;
-    k ^= k >> 33;
-    k *= 0xc4ceb9fe1a85ec53;
-    k ^= k >> 33;
-
-    return k;
-}
-
 u64 GetMurmurHash3(const u8 *src, int len, u32 samples)
 {
     const u8 * data = (const u8*)src;
@@ -237,104 +253,7 @@ u64 GetMurmurHash3(const u8 *src, int len, u32 samples)
     return h1;
 }
 
-
-// CRC32 hash using the SSE4.2 instruction
-u64 GetCRC32(const u8 *src, int len, u32 samples)
-{
-#if _M_SSE >= 0x402
-	u64 h = len;
-	u32 Step = (len / 8);
-	const u64 *data = (const u64 *)src;
-	const u64 *end = data + Step;
-	if(samples == 0) samples = std::max(Step, 1u);
-	Step = Step / samples;
-	if(Step < 1) Step = 1;
-	while(data < end)
-	{
-		h = _mm_crc32_u64(h, data[0]);
-		data += Step;
-	}
-
-	const u8 *data2 = (const u8*)end;
-	return _mm_crc32_u64(h, u64(data2[0]));
 #else
-	return 0;
-#endif
-}
-
-
-/* NOTE: This hash function is used for custom texture loading/dumping, so
-   it should not be changed, which would require all custom textures to be
-   recalculated for their new hash values. If the hashing function is
-   changed, make sure this one is still used when the legacy parameter is
-   true. */
-u64 GetHashHiresTexture(const u8 *src, int len, u32 samples)
-{
-	const u64 m = 0xc6a4a7935bd1e995;
-	u64 h = len * m;
-	const int r = 47;
-	u32 Step = (len / 8);
-	const u64 *data = (const u64 *)src;
-	const u64 *end = data + Step;
-	if(samples == 0) samples = std::max(Step, 1u);
-	Step = Step / samples;
-	if(Step < 1) Step = 1;
-	while(data < end)
-	{
-		u64 k = data[0];
-		data+=Step;
-		k *= m; 
-		k ^= k >> r; 
-		k *= m; 		
-		h ^= k;
-		h *= m; 
-	}
-
-	const u8 * data2 = (const u8*)end;
-
-	switch(len & 7)
-	{
-	case 7: h ^= u64(data2[6]) << 48;
-	case 6: h ^= u64(data2[5]) << 40;
-	case 5: h ^= u64(data2[4]) << 32;
-	case 4: h ^= u64(data2[3]) << 24;
-	case 3: h ^= u64(data2[2]) << 16;
-	case 2: h ^= u64(data2[1]) << 8;
-	case 1: h ^= u64(data2[0]);
-			h *= m;
-	};
- 
-	h ^= h >> r;
-	h *= m;
-	h ^= h >> r;
-
-	return h;
-} 
-#else
-// CRC32 hash using the SSE4.2 instruction
-u64 GetCRC32(const u8 *src, int len, u32 samples)
-{
-#if _M_SSE >= 0x402
-	u32 h = len;
-	u32 Step = (len/4);
-	const u32 *data = (const u32 *)src;
-	const u32 *end = data + Step;
-	if(samples == 0) samples = std::max(Step, 1u);
-	Step  = Step / samples;
-	if(Step < 1) Step = 1;
-	while(data < end)
-	{
-		h = _mm_crc32_u32(h, data[0]);
-		data += Step;
-	}
-
-	const u8 *data2 = (const u8*)end;
-	return (u64)_mm_crc32_u32(h, u32(data2[0]));
-#else
-	return 0;
-#endif
-}
-
 //-----------------------------------------------------------------------------
 // Block read - if your platform needs to do endian-swapping or can only
 // handle aligned reads, do the conversion here
@@ -453,77 +372,224 @@ u64 GetMurmurHash3(const u8* src, int len, u32 samples)
 	
 	return *((u64 *)&out);
 }
+#endif
 
-/* FIXME: The old 32-bit version of this hash made different hashes than the
-   64-bit version. Until someone can make a new version of the 32-bit one that
-   makes identical hashes, this is just a c/p of the 64-bit one. */
-u64 GetHashHiresTexture(const u8 *src, int len, u32 samples)
+static inline u64 Read64(const u8 *p)
 {
-	const u64 m = 0xc6a4a7935bd1e995ULL;
-	u64 h = len * m;
-	const int r = 47;
-	u32 Step = (len / 8);
-	const u64 *data = (const u64 *)src;
-	const u64 *end = data + Step;
-	if(samples == 0) samples = std::max(Step, 1u);
-	Step = Step / samples;
-	if(Step < 1) Step = 1;
-	while(data < end)
+	u64 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline u32 Read32(const u8 *p)
+{
+	u32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+u64 HashXXH64(const u8 *data, size_t len, u64 seed)
+{
+	return XXH64(data, len, seed);
+}
+
+//----------
+// CRC32C (Castagnoli), the polynomial SSE4.2's crc32 instruction uses.  These take and return
+// the running value without the inversions, HashCRC32C does those.
+
+struct CRC32CTable
+{
+	CRC32CTable()
 	{
-		u64 k = data[0];
-		data+=Step;
-		k *= m; 
-		k ^= k >> r; 
-		k *= m; 		
-		h ^= k;
-		h *= m; 
+		for (u32 i = 0; i < 256; ++i)
+		{
+			u32 crc = i;
+			for (int j = 0; j < 8; ++j)
+				crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+			table[i] = crc;
+		}
 	}
 
-	const u8 * data2 = (const u8*)end;
+	u32 table[256];
+};
 
-	switch(len & 7)
-	{
-	case 7: h ^= u64(data2[6]) << 48;
-	case 6: h ^= u64(data2[5]) << 40;
-	case 5: h ^= u64(data2[4]) << 32;
-	case 4: h ^= u64(data2[3]) << 24;
-	case 3: h ^= u64(data2[2]) << 16;
-	case 2: h ^= u64(data2[1]) << 8;
-	case 1: h ^= u64(data2[0]);
-			h *= m;
-	};
- 
-	h ^= h >> r;
-	h *= m;
-	h ^= h >> r;
+static const CRC32CTable crc32cTable;
 
-	return h;
+static u32 CRC32CGeneric(u32 crc, const u8 *data, size_t len)
+{
+	while (len-- > 0)
+		crc = (crc >> 8) ^ crc32cTable.table[(crc ^ *data++) & 0xFF];
+	return crc;
 }
-#endif
 
-u64 GetHash64(const u8 *src, int len, u32 samples)
+// Picks samples blocks out of blocks, or all of them for 0.
+static size_t SampleStride(size_t blocks, u32 samples)
 {
-    return ptrHashFunction(src, len, samples);
+	if (samples == 0 || blocks <= samples)
+		return 1;
+	return blocks / samples;
 }
 
-// sets the hash function used for the texture cache
-void SetHash64Function(bool useHiresTextures)
+#ifdef HASH_FAST64_LANES32
+
+static const u32 LANES32_PRIME1 = 2654435761U;
+static const u32 LANES32_PRIME2 = 2246822519U;
+static const u32 LANES32_PRIME3 = 3266489917U;
+
+static inline u32 Rotl32(u32 x, int r)
 {
-	if (useHiresTextures)
-	{
-		ptrHashFunction = &GetHashHiresTexture;
-	}
-#if _M_SSE >= 0x402
-	else if (cpu_info.bSSE4_2 && !useHiresTextures) // sse crc32 version
+	return (x << r) | (x >> (32 - r));
+}
+
+static inline u32 Lanes32Round(u32 lane, u32 input)
+{
+	return Rotl32(lane + input * LANES32_PRIME2, 13) * LANES32_PRIME1;
+}
+
+static inline u32 Lanes32Avalanche(u32 h)
+{
+	h ^= h >> 15;
+	h *= LANES32_PRIME2;
+	h ^= h >> 13;
+	h *= LANES32_PRIME3;
+	h ^= h >> 16;
+	return h;
+}
+
+// XXH32's rounds on four 32-bit lanes, so only 32-bit multiplies.  The lanes get folded into
+// two halves instead of one, to keep a 64-bit result for the caches.
+static u64 Fast64Generic(const u8 *data, size_t len, u64 seed, size_t stride)
+{
+	u32 a = (u32)seed + LANES32_PRIME1 + LANES32_PRIME2;
+	u32 b = (u32)(seed >> 32) + LANES32_PRIME2;
+	u32 c = (u32)seed;
+	u32 d = (u32)(seed >> 32) - LANES32_PRIME1;
+
+	const size_t blocks = len / 32;
+	for (size_t i = 0; i < blocks; i += stride)
 	{
-		ptrHashFunction = &GetCRC32;
+		const u8 *p = data + i * 32;
+		a = Lanes32Round(a, Read32(p + 0));
+		b = Lanes32Round(b, Read32(p + 4));
+		c = Lanes32Round(c, Read32(p + 8));
+		d = Lanes32Round(d, Read32(p + 12));
+		a = Lanes32Round(a, Read32(p + 16));
+		b = Lanes32Round(b, Read32(p + 20));
+		c = Lanes32Round(c, Read32(p + 24));
+		d = Lanes32Round(d, Read32(p + 28));
 	}
+	const u32 tail = XXH32(data + blocks * 32, (int)(len & 31), a ^ d);
+
+	const u32 lo = Lanes32Avalanche(Rotl32(a, 1) + Rotl32(b, 7) + Rotl32(c, 12) + Rotl32(d, 18) + tail);
+	const u32 hi = Lanes32Avalanche((a ^ Rotl32(c, 16)) * LANES32_PRIME3 + (b ^ Rotl32(d, 16)) * LANES32_PRIME1 + tail + (u32)len);
+	return ((u64)hi << 32) | lo;
+}
+
+#else
+
+static u64 Fast64Generic(const u8 *data, size_t len, u64 seed, size_t stride)
+{
+	if (stride == 1)
+		return XXH64(data, len, seed);
+
+	const size_t blocks = len / 32;
+	u64 h = seed;
+	for (size_t i = 0; i < blocks; i += stride)
+		h = XXH64(data + i * 32, 32, h);
+	return XXH64(data + blocks * 32, len & 31, h ^ len);
+}
+
+#endif
+
+#ifdef HASH_CRC32C_AVAILABLE
+
+HASH_SSE42_TARGET
+static u32 CRC32CSSE42(u32 crc, const u8 *data, size_t len)
+{
+#ifdef HASH_CRC32C_X64
+	u64 crc64 = crc;
+	for (; len >= 8; len -= 8, data += 8)
+		crc64 = _mm_crc32_u64(crc64, Read64(data));
+	crc = (u32)crc64;
 #endif
-	else
+	for (; len >= 4; len -= 4, data += 4)
+		crc = _mm_crc32_u32(crc, Read32(data));
+	for (; len > 0; --len)
+		crc = _mm_crc32_u8(crc, *data++);
+	return crc;
+}
+
+// Four CRC32C lanes over each 32 byte block, so the instruction's latency overlaps.  CRC is
+// linear, the lanes only get mixed nonlinearly at the end, which is fine for cache keys.
+HASH_SSE42_TARGET
+static u64 Fast64SSE42(const u8 *data, size_t len, u64 seed, size_t stride)
+{
+	u32 a = (u32)seed;
+	u32 b = (u32)(seed >> 32);
+	u32 c = ~a;
+	u32 d = ~b;
+
+	const size_t blocks = len / 32;
+	for (size_t i = 0; i < blocks; i += stride)
 	{
-		ptrHashFunction = &GetMurmurHash3;
+		const u8 *p = data + i * 32;
+#ifdef HASH_CRC32C_X64
+		a = (u32)_mm_crc32_u64(a, Read64(p + 0));
+		b = (u32)_mm_crc32_u64(b, Read64(p + 8));
+		c = (u32)_mm_crc32_u64(c, Read64(p + 16));
+		d = (u32)_mm_crc32_u64(d, Read64(p + 24));
+#else
+		a = _mm_crc32_u32(_mm_crc32_u32(a, Read32(p + 0)), Read32(p + 4));
+		b = _mm_crc32_u32(_mm_crc32_u32(b, Read32(p + 8)), Read32(p + 12));
+		c = _mm_crc32_u32(_mm_crc32_u32(c, Read32(p + 16)), Read32(p + 20));
+		d = _mm_crc32_u32(_mm_crc32_u32(d, Read32(p + 24)), Read32(p + 28));
+#endif
 	}
+	a = CRC32CSSE42(a, data + blocks * 32, len & 31);
+
+	const u64 lo = ((u64)a << 32) | b;
+	const u64 hi = ((u64)c << 32) | d;
+	return fmix64(lo ^ fmix64(hi + (u64)len));
+}
+
+#endif
+
+u32 HashCRC32C(const u8 *data, size_t len, u32 crc)
+{
+#ifdef HASH_CRC32C_AVAILABLE
+	if (hashUseHardware)
+		return ~CRC32CSSE42(~crc, data, len);
+#endif
+	return ~CRC32CGeneric(~crc, data, len);
 }
 
+u64 HashFast64(const u8 *data, size_t len, u64 seed)
+{
+#ifdef HASH_CRC32C_AVAILABLE
+	if (hashUseHardware)
+		return Fast64SSE42(data, len, seed, 1);
+#endif
+	return Fast64Generic(data, len, seed, 1);
+}
 
+u64 HashFast64Sampled(const u8 *data, size_t len, u32 samples, u64 seed)
+{
+	const size_t stride = SampleStride(len / 32, samples);
+#ifdef HASH_CRC32C_AVAILABLE
+	if (hashUseHardware)
+		return Fast64SSE42(data, len, seed, stride);
+#endif
+	return Fast64Generic(data, len, seed, stride);
+}
+
+void SetHashHardwareEnabled(bool enabled)
+{
+#ifdef HASH_CRC32C_AVAILABLE
+	hashUseHardware = enabled;
+#endif
+}
 
+bool GetHashHardwareEnabled()
+{
+	return hashUseHardware;
+}
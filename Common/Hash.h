@@ -24,9 +24,21 @@ u32 HashFletcher(const u8* data_u8, size_t length);  // FAST. Length & 1 == 0.
 u32 HashAdler32(const u8* data, size_t len);         // Fairly accurate, slightly slower
 u32 HashFNV(const u8* ptr, int length);              // Another fast and decent hash
 u32 HashEctor(const u8* ptr, int length);            // JUNK. DO NOT USE FOR NEW THINGS
-u64 GetCRC32(const u8 *src, int len, u32 samples); // SSE4.2 version of CRC32
-u64 GetHashHiresTexture(const u8 *src, int len, u32 samples);
-u64 GetMurmurHash3(const u8 *src, int len, u32 samples);
-u64 GetHash64(const u8 *src, int len, u32 samples);
-void SetHash64Function(bool useHiresTextures);
+u64 GetMurmurHash3(const u8 *src, int len, u32 samples); // Differs between 32 and 64-bit builds
+
+// Use these for new things.
+//
+// HashXXH64 gives the same value everywhere, so it's the one for anything kept on disk.
+// The Fast64 ones use CRC32C when SSE4.2 is enabled, xxHash64 on other 64-bit CPUs and XXH32's
+// rounds on 32-bit ones, so their values only mean something within one run - texture, CLUT
+// and vertex caches and the like.
+u64 HashXXH64(const u8 *data, size_t len, u64 seed = 0);
+u32 HashCRC32C(const u8 *data, size_t len, u32 crc = 0);  // Pass the last result to continue
+u64 HashFast64(const u8 *data, size_t len, u64 seed = 0);
+// Only about samples 32 byte blocks spread over the data, plus the tail.  0 hashes everything.
+u64 HashFast64Sampled(const u8 *data, size_t len, u32 samples, u64 seed = 0);
+
+// Off until System sets it from cpu_info.bSSE4_2.  Has no effect on other CPUs.
+void SetHashHardwareEnabled(bool enabled);
+bool GetHashHardwareEnabled();
 #endif // _HASH_H_
@@ -19,6 +19,7 @@
 #include "base/logging.h"
 #include "LogManager.h"
 #include "ConsoleListener.h"
+#include "Atomics.h"
 #include "Timer.h"
 #include "Thread.h"
 #include "FileUtil.h"
@@ -50,6 +51,7 @@ void GenericLog(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type,
 LogManager *LogManager::m_logManager = NULL;
 
 LogManager::LogManager()
+	: m_queueHead(0), m_queueTail(0), m_writerSleeping(0), m_writerExit(0)
 {
 	// create log files
 	m_Log[LogTypes::MASTER_LOG] = new LogContainer("*",	      "Master Log");
@@ -97,10 +99,20 @@ LogManager::LogManager()
 #endif
 #endif
 	}
+
+	m_queue = new QueuedMessage[LOG_QUEUE_SIZE];
+	for (u32 i = 0; i < LOG_QUEUE_SIZE; ++i)
+		m_queue[i].sequence = i;
+	// Started by Init(), once the thread can log through us.
+	m_writerThread = NULL;
 }
 
 LogManager::~LogManager()
 {
+	// Write out everything that's left first.
+	StopWriter();
+	delete [] m_queue;
+
 	for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
 	{
 #if !defined(USING_GLES2) || defined(_DEBUG)
@@ -125,11 +137,13 @@ LogManager::~LogManager()
 
 void LogManager::ChangeFileLog(const char *filename)
 {
+	std::lock_guard<std::mutex> lk(m_writer_lock);
 	if (m_fileLog != NULL)
 	{
 		for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
 			m_logManager->RemoveListener((LogTypes::LOG_TYPE)i, m_fileLog);
 		delete m_fileLog;
+		m_fileLog = NULL;
 	}
 
 	if (filename != NULL)
@@ -164,13 +178,24 @@ void LogManager::LoadConfig(IniFile::Section *section)
 
 void LogManager::Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const char *file, int line, const char *format, va_list args)
 {
-	std::lock_guard<std::mutex> lk(m_log_lock);
-
-	char msg[MAX_MSGLEN * 2];
+	// Most messages stop here, so this must stay cheap: no locks.
 	LogContainer *log = m_Log[type];
 	if (!log || !log->IsEnabled() || level > log->GetLevel() || ! log->HasListeners())
 		return;
 
+	// Take the next slot in the queue.  If the writer is behind by a whole queue, wait for it.
+	const u32 ticket = Common::AtomicFetchAdd(m_queueHead, 1);
+	QueuedMessage &queued = m_queue[ticket & (LOG_QUEUE_SIZE - 1)];
+	if (Common::AtomicLoadAcquire(queued.sequence) != ticket)
+	{
+		m_writerEvent.Set();
+		while (Common::AtomicLoadAcquire(queued.sequence) != ticket)
+			Common::YieldCPU();
+	}
+	queued.level = level;
+	queued.type = type;
+	char *msg = queued.msg;
+
 	static const char level_to_char[8] = "-NEWIDV";
 	char formattedTime[13];
 	Common::Timer::GetTimeFormatted(formattedTime);
@@ -212,12 +237,103 @@ void LogManager::Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const
 	// This will include the null terminator.
 	memcpy(msgPos, "\n", sizeof("\n"));
 
-	log->Trigger(level, msg);
+	// Now it's ready.  This is a full barrier, so the check below can't miss the writer going to sleep.
+	Common::AtomicIncrement(queued.sequence);
+	if (level <= LogTypes::LERROR)
+		WriteThrough(ticket);
+	else if (Common::AtomicLoad(m_writerSleeping))
+		m_writerEvent.Set();
+}
+
+bool LogManager::IsQueueEmpty()
+{
+	QueuedMessage &queued = m_queue[m_queueTail & (LOG_QUEUE_SIZE - 1)];
+	return Common::AtomicLoadAcquire(queued.sequence) != m_queueTail + 1;
+}
+
+void LogManager::WriteNext()
+{
+	QueuedMessage &queued = m_queue[m_queueTail & (LOG_QUEUE_SIZE - 1)];
+	m_Log[queued.type]->Trigger(queued.level, queued.msg);
+	// Free for the logging thread that gets the ticket a whole queue later.
+	Common::AtomicStoreRelease(queued.sequence, m_queueTail + LOG_QUEUE_SIZE);
+	++m_queueTail;
+}
+
+bool LogManager::WriteQueued()
+{
+	std::lock_guard<std::mutex> lk(m_writer_lock);
+	u32 count = 0;
+	// Limited, so we flush every so often even when it never runs dry.
+	while (count < LOG_QUEUE_SIZE && !IsQueueEmpty())
+	{
+		WriteNext();
+		++count;
+	}
+
+	if (count != 0 && m_fileLog != NULL)
+		m_fileLog->Flush();
+	return count != 0;
+}
+
+void LogManager::WriteThrough(u32 ticket)
+{
+	std::lock_guard<std::mutex> lk(m_writer_lock);
+	// The writer thread may have gotten to it already.
+	if ((s32)(m_queueTail - ticket) > 0)
+		return;
+
+	while ((s32)(m_queueTail - ticket) <= 0)
+	{
+		if (IsQueueEmpty())
+			Common::YieldCPU();
+		else
+			WriteNext();
+	}
+	if (m_fileLog != NULL)
+		m_fileLog->Flush();
+}
+
+void LogManager::WriterThread()
+{
+	Common::SetCurrentThreadName("LogWriter");
+
+	while (true)
+	{
+		if (WriteQueued())
+			continue;
+		if (Common::AtomicLoad(m_writerExit))
+			break;
+
+		// Announce we're going to sleep before the last check, so Log() either sees it or we see its message.
+		Common::AtomicIncrement(m_writerSleeping);
+		bool empty;
+		{
+			std::lock_guard<std::mutex> lk(m_writer_lock);
+			empty = IsQueueEmpty();
+		}
+		if (empty && !Common::AtomicLoad(m_writerExit))
+			m_writerEvent.Wait();
+		Common::AtomicDecrement(m_writerSleeping);
+	}
+}
+
+void LogManager::StopWriter()
+{
+	if (!m_writerThread)
+		return;
+
+	Common::AtomicStore(m_writerExit, 1);
+	m_writerEvent.Set();
+	m_writerThread->join();
+	delete m_writerThread;
+	m_writerThread = NULL;
 }
 
 void LogManager::Init()
 {
 	m_logManager = new LogManager();
+	m_logManager->m_writerThread = new std::thread(&LogManager::WriterThread, m_logManager);
 }
 
 void LogManager::Shutdown()
@@ -227,7 +343,7 @@ void LogManager::Shutdown()
 }
 
 LogContainer::LogContainer(const char* shortName, const char* fullName, bool enable)
-	: m_enable(enable)
+	: m_enable(enable), m_listenerCount(0)
 {
 	strncpy(m_fullName, fullName, 128);
 	strncpy(m_shortName, shortName, 32);
@@ -239,12 +355,14 @@ void LogContainer::AddListener(LogListener *listener)
 {
 	std::lock_guard<std::mutex> lk(m_listeners_lock);
 	m_listeners.insert(listener);
+	m_listenerCount = (u32)m_listeners.size();
 }
 
 void LogContainer::RemoveListener(LogListener *listener)
 {
 	std::lock_guard<std::mutex> lk(m_listeners_lock);
 	m_listeners.erase(listener);
+	m_listenerCount = (u32)m_listeners.size();
 }
 
 void LogContainer::Trigger(LogTypes::LOG_LEVELS level, const char *msg)
@@ -274,7 +392,16 @@ void FileLogListener::Log(LogTypes::LOG_LEVELS, const char *msg)
 		return;
 
 	std::lock_guard<std::mutex> lk(m_log_lock);
-	m_logfile << msg << std::flush;
+	m_logfile << msg;
+}
+
+void FileLogListener::Flush()
+{
+	if (!IsValid())
+		return;
+
+	std::lock_guard<std::mutex> lk(m_log_lock);
+	m_logfile.flush();
 }
 
 void DebuggerLogListener::Log(LogTypes::LOG_LEVELS, const char *msg)
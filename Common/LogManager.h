@@ -28,6 +28,8 @@
 
 #define	MAX_MESSAGES 8000   
 #define MAX_MSGLEN  1024
+// Formatted messages waiting for the writer thread, must be a power of 2.
+#define LOG_QUEUE_SIZE 256
 
 extern const char *hleCurrentThreadName;
 
@@ -46,6 +48,8 @@ public:
 	FileLogListener(const char *filename);
 
 	void Log(LogTypes::LOG_LEVELS, const char *msg);
+	// Log() only buffers, the log writer calls this after each batch.
+	void Flush();
 
 	bool IsValid() { if (!m_logfile) return false; else return true; }
 	bool IsEnabled() const { return m_enable; }
@@ -85,7 +89,8 @@ public:
 
 	void SetLevel(LogTypes::LOG_LEVELS level) {	m_level = level; }
 
-	bool HasListeners() const { return !m_listeners.empty(); }
+	// Doesn't lock, so it's cheap enough to check on every message.
+	bool HasListeners() const { return m_listenerCount != 0; }
 
 private:
 	char m_fullName[128];
@@ -94,19 +99,52 @@ private:
 	LogTypes::LOG_LEVELS m_level;
 	std::mutex m_listeners_lock;
 	std::set<LogListener*> m_listeners;
+	volatile u32 m_listenerCount;
 };
 
 class ConsoleListener;
 
+// Messages are formatted on the thread that logs them and put in a lock-free queue.
+// A writer thread passes them on to the listeners, and the file log is flushed once per
+// batch.  Errors are written out before Log() returns, since a crash often follows them.
 class LogManager : NonCopyable
 {
 private:
+	struct QueuedMessage
+	{
+		// The ticket of the message that may be written here next, plus 1 once it's ready to read.
+		volatile u32 sequence;
+		LogTypes::LOG_LEVELS level;
+		LogTypes::LOG_TYPE type;
+		char msg[MAX_MSGLEN * 2];
+	};
+
 	LogContainer* m_Log[LogTypes::NUMBER_OF_LOGS];
 	FileLogListener *m_fileLog;
 	ConsoleListener *m_consoleLog;
 	DebuggerLogListener *m_debuggerLog;
 	static LogManager *m_logManager;  // Singleton. Ugh.
-	std::mutex m_log_lock;
+
+	QueuedMessage *m_queue;
+	// Next ticket to hand out to a logging thread.
+	volatile u32 m_queueHead;
+	// Next ticket to write out, only touched under m_writer_lock.
+	u32 m_queueTail;
+	std::thread *m_writerThread;
+	// Held while passing messages to listeners, so they can be swapped safely.
+	std::mutex m_writer_lock;
+	Common::Event m_writerEvent;
+	volatile u32 m_writerSleeping;
+	volatile u32 m_writerExit;
+
+	bool IsQueueEmpty();
+	void WriteNext();
+	// Returns false if there was nothing to write.
+	bool WriteQueued();
+	// Waits for the messages before it, if other threads are still formatting them.
+	void WriteThrough(u32 ticket);
+	void WriterThread();
+	void StopWriter();
 
 	LogManager();
 	~LogManager();
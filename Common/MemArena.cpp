@@ -29,6 +29,8 @@
 #ifdef ANDROID
 #include <sys/ioctl.h>
 #include <linux/ashmem.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
 #endif
 #endif
 
@@ -115,6 +117,11 @@ size_t roundup(size_t x) {
 }
 #else
 size_t roundup(size_t x) {
+	// With huge pages, file offsets have to line up with the huge pages of the views.
+	if (GetHugePageMode() != HUGEPAGES_OFF) {
+		const size_t gran = GetHugePageSize();
+		return (x + gran - 1) & ~(gran - 1);
+	}
 	return x;
 }
 #endif
@@ -135,15 +142,28 @@ void MemArena::GrabLowMemSpace(size_t size)
 		return;
 	}
 #else
-	mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-	fd = open(ram_temp_file.c_str(), O_RDWR | O_CREAT, mode);
+	fd = -1;
+#if defined(__linux__) && defined(__NR_memfd_create)
+	// No file on disk, and unlike /tmp files, memfd's shmem can be backed by huge pages.
+	if (GetHugePageMode() != HUGEPAGES_OFF)
+	{
+		fd = (int)syscall(__NR_memfd_create, "PPSSPP_RAM", 0);
+		if (fd < 0)
+			WARN_LOG(MEMMAP, "memfd_create failed, errno: %d, no huge pages for the arena", (int)(errno));
+	}
+#endif
 	if (fd < 0)
 	{
-		ERROR_LOG(MEMMAP, "Failed to grab memory space as a file: %s of size: %08x  errno: %d", ram_temp_file.c_str(), (int)size, (int)(errno));
-		return;
+		mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+		fd = open(ram_temp_file.c_str(), O_RDWR | O_CREAT, mode);
+		if (fd < 0)
+		{
+			ERROR_LOG(MEMMAP, "Failed to grab memory space as a file: %s of size: %08x  errno: %d", ram_temp_file.c_str(), (int)size, (int)(errno));
+			return;
+		}
+		// delete immediately, we keep the fd so it still lives
+		unlink(ram_temp_file.c_str());
 	}
-	// delete immediately, we keep the fd so it still lives
-	unlink(ram_temp_file.c_str());
 	if (ftruncate(fd, size) != 0)
 	{
 		ERROR_LOG(MEMMAP, "Failed to ftruncate %d to size %08x", (int)fd, (int)size);
@@ -174,14 +194,44 @@ void *MemArena::CreateView(s64 offset, size_t size, void *base)
 	void *ptr = MapViewOfFileEx(hMemoryMapping, FILE_MAP_ALL_ACCESS, 0, (DWORD)((u64)offset), size, base);
 	return ptr;
 #else
+	// Huge pages need the address aligned like the file offset, so find a spot for views
+	// that can go anywhere.  The reservation is mapped over, then the rest given back.
+	u8 *reserved = 0;
+	size_t reservedSize = 0;
+	if (base == 0 && GetHugePageMode() != HUGEPAGES_OFF && size >= GetHugePageSize())
+	{
+		reservedSize = size + GetHugePageSize();
+		void *space = mmap(0, reservedSize, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+		if (space != MAP_FAILED)
+		{
+			reserved = (u8 *)space;
+			base = (void *)(((uintptr_t)reserved + GetHugePageSize() - 1) & ~(uintptr_t)(GetHugePageSize() - 1));
+		}
+	}
+
 	void *retval = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED |
 		((base == 0) ? 0 : MAP_FIXED), fd, offset);
 
+	if (reserved)
+	{
+		const size_t head = (u8 *)base - reserved;
+		if (retval == MAP_FAILED)
+			munmap(reserved, reservedSize);
+		else
+		{
+			if (head != 0)
+				munmap(reserved, head);
+			if (reservedSize - head - size != 0)
+				munmap((u8 *)base + size, reservedSize - head - size);
+		}
+	}
+
 	if (retval == MAP_FAILED)
 	{
 		NOTICE_LOG(MEMMAP, "mmap on %s (fd: %d) failed", ram_temp_file.c_str(), (int)fd);
 		return 0;
 	}
+	AdviseHugePages(retval, size);
 	return retval;
 #endif
 }
@@ -34,6 +34,12 @@
 
 #include <stdlib.h>
 
+#if defined(__linux__) && !defined(ANDROID)
+#define HUGEPAGES_AVAILABLE
+#include <cstring>
+#endif
+
+static int hugePageMode = HUGEPAGES_OFF;
 
 #if !defined(_WIN32) && defined(__x86_64__) && !defined(MAP_32BIT)
 #include <unistd.h>
@@ -52,6 +58,119 @@ static RChunk* g_code_chunk = NULL;
 static RHeap* g_code_heap = NULL;
 #endif
 
+#ifdef HUGEPAGES_AVAILABLE
+// The word in brackets in a transparent_hugepage setting, like "advise" in "always [advise] never".
+static std::string GetTransparentHugePageSetting(const char *name)
+{
+	std::string filename = std::string("/sys/kernel/mm/transparent_hugepage/") + name;
+	FILE *f = fopen(filename.c_str(), "r");
+	if (!f)
+		return "";
+	char line[256] = {0};
+	if (!fgets(line, sizeof(line), f))
+		line[0] = 0;
+	fclose(f);
+
+	const char *start = strchr(line, '[');
+	const char *end = start ? strchr(start, ']') : NULL;
+	return end ? std::string(start + 1, end) : "";
+}
+
+// Reserved huge pages for the code space in explicit mode, or MAP_FAILED for regular ones.
+static void *MapHugeExecutableMemory(size_t size, bool low)
+{
+	if (hugePageMode != HUGEPAGES_EXPLICIT || size == 0 || (size % GetHugePageSize()) != 0)
+		return MAP_FAILED;
+
+	int flags = MAP_ANON | MAP_PRIVATE | MAP_HUGETLB;
+	void *hint = NULL;
+#if defined(__x86_64__)
+	// Not every kernel applies MAP_32BIT to hugetlbfs, but they all take a free hint.
+	if (low)
+		hint = (void *)0x40000000;
+#endif
+	void *ptr = mmap(hint, size, PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0);
+	if (ptr == MAP_FAILED)
+	{
+		WARN_LOG(COMMON, "No reserved huge pages for %d MB of code space (errno %d), check vm.nr_hugepages", (int)(size >> 20), errno);
+		return MAP_FAILED;
+	}
+#if defined(__x86_64__)
+	if (low && (uintptr_t)ptr + size > 0x80000000ULL)
+	{
+		WARN_LOG(COMMON, "Huge pages for the code space landed above 2 GB, using regular pages");
+		munmap(ptr, size);
+		return MAP_FAILED;
+	}
+#endif
+	return ptr;
+}
+#endif
+
+void SetHugePageMode(int mode)
+{
+#ifdef HUGEPAGES_AVAILABLE
+	hugePageMode = mode;
+	if (mode == HUGEPAGES_OFF)
+		return;
+
+	const std::string anon = GetTransparentHugePageSetting("enabled");
+	const std::string shmem = GetTransparentHugePageSetting("shmem_enabled");
+	INFO_LOG(COMMON, "Huge pages: mode %d, transparent_hugepage enabled=%s shmem_enabled=%s", mode, anon.c_str(), shmem.c_str());
+	if (anon == "never")
+		WARN_LOG(COMMON, "Transparent huge pages are disabled, the code space only gets them in explicit mode");
+	if (shmem != "advise" && shmem != "always" && shmem != "force")
+		WARN_LOG(COMMON, "The memory arena needs transparent_hugepage/shmem_enabled set to advise for huge pages");
+#endif
+}
+
+int GetHugePageMode()
+{
+	return hugePageMode;
+}
+
+void AdviseHugePages(void *ptr, size_t size)
+{
+#if defined(HUGEPAGES_AVAILABLE) && defined(MADV_HUGEPAGE)
+	if (hugePageMode == HUGEPAGES_OFF || ptr == NULL || size < GetHugePageSize())
+		return;
+	if (madvise(ptr, size, MADV_HUGEPAGE) != 0)
+		WARN_LOG(COMMON, "madvise(MADV_HUGEPAGE) failed for %p, errno %d", ptr, errno);
+#endif
+}
+
+size_t GetHugePageBytes(const void *ptr, size_t size)
+{
+	size_t bytes = 0;
+#ifdef HUGEPAGES_AVAILABLE
+	FILE *f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return 0;
+
+	const uintptr_t start = (uintptr_t)ptr;
+	const uintptr_t end = start + size;
+	bool inside = false;
+	char line[512];
+	while (fgets(line, sizeof(line), f))
+	{
+		unsigned long mapStart, mapEnd;
+		char field[64];
+		unsigned long kb;
+		// Each mapping starts with its range, the fields after are in kB.
+		if (sscanf(line, "%lx-%lx ", &mapStart, &mapEnd) == 2)
+			inside = mapStart < end && mapEnd > start;
+		else if (inside && sscanf(line, "%63[^:]: %lu kB", field, &kb) == 2)
+		{
+			if (!strcmp(field, "AnonHugePages") || !strcmp(field, "ShmemPmdMapped") || !strcmp(field, "FilePmdMapped")
+				|| !strcmp(field, "Shared_Hugetlb") || !strcmp(field, "Private_Hugetlb"))
+				bytes += (size_t)kb * 1024;
+		}
+	}
+	fclose(f);
+#endif
+	return bytes;
+}
+
 // This is purposely not a full wrapper for virtualalloc/mmap, but it
 // provides exactly the primitive operations that Dolphin needs.
 
@@ -86,12 +205,21 @@ void* AllocateExecutableMemory(size_t size, bool low)
 	if (low && (!map_hint))
 		map_hint = (char*)round_page(512*1024*1024); /* 0.5 GB rounded up to the next page */
 #endif
-	void* ptr = mmap(map_hint, size, PROT_READ | PROT_WRITE	| PROT_EXEC,
-		MAP_ANON | MAP_PRIVATE
+	void* ptr = MAP_FAILED;
+#ifdef HUGEPAGES_AVAILABLE
+	ptr = MapHugeExecutableMemory(size, low);
+#endif
+	if (ptr == MAP_FAILED)
+	{
+		ptr = mmap(map_hint, size, PROT_READ | PROT_WRITE	| PROT_EXEC,
+			MAP_ANON | MAP_PRIVATE
 #if defined(__x86_64__) && defined(MAP_32BIT)
-		| (low ? MAP_32BIT : 0)
+			| (low ? MAP_32BIT : 0)
 #endif
-		, -1, 0);
+			, -1, 0);
+		if (ptr != MAP_FAILED)
+			AdviseHugePages(ptr, size);
+	}
 #endif /* defined(_WIN32) */
 
 	// printf("Mapped executable memory at %p (size %ld)\n", ptr,
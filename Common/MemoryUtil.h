@@ -34,6 +34,28 @@ std::string MemUsage();
 
 inline int GetPageSize() { return 4096; }
 
+// Huge pages for the emulated memory arena and the JIT code space, to cut down on TLB misses
+// from random guest memory access and large amounts of generated code.  Linux only, the
+// other platforms always use regular pages.
+enum HugePageMode
+{
+	HUGEPAGES_OFF = 0,
+	// madvise(MADV_HUGEPAGE), the kernel uses huge pages where it can.  The arena needs
+	// /sys/kernel/mm/transparent_hugepage/shmem_enabled set to advise for this.
+	HUGEPAGES_TRANSPARENT = 1,
+	// Reserved hugetlbfs pages (vm.nr_hugepages) for the code space, transparent otherwise.
+	HUGEPAGES_EXPLICIT = 2,
+};
+
+// Only affects memory allocated afterwards.
+void SetHugePageMode(int mode);
+int GetHugePageMode();
+inline size_t GetHugePageSize() { return 2 * 1024 * 1024; }
+// Asks for transparent huge pages on a mapping, if the mode allows.
+void AdviseHugePages(void *ptr, size_t size);
+// How much of [ptr, ptr + size) the kernel currently has on huge pages, from /proc/self/smaps.
+size_t GetHugePageBytes(const void *ptr, size_t size);
+
 template <typename T>
 class SimpleBuf {
 public:
@@ -0,0 +1,384 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "Atomics.h"
+#include "StdConditionVariable.h"
+#include "StdMutex.h"
+#include "StdThread.h"
+#include "TaskScheduler.h"
+#include "Thread.h"
+#include "../Core/Config.h"
+
+// Tasks not yet finished, for a handle or group.
+struct TaskCounter
+{
+	TaskCounter() : count(0) {}
+	volatile u32 count;
+};
+
+namespace {
+	// ParallelFor slices per worker with the default grain, so uneven slices still balance.
+	const int SLICES_PER_WORKER = 4;
+
+	struct Task
+	{
+		Task() : loop(0), lower(0), upper(0) {}
+
+		std::function<void()> func;
+		// ParallelFor slices use these instead, to skip copying the function for each.
+		const std::function<void(int,int)> *loop;
+		int lower;
+		int upper;
+		std::shared_ptr<TaskCounter> counter;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	class Scheduler
+	{
+	public:
+		Scheduler(int numWorkers);
+		~Scheduler();
+
+		int NumWorkers() const { return (int)threads_.size(); }
+
+		void Push(Task *tasks, int count);
+		void Wait(TaskCounter *counter);
+
+	private:
+		void WorkerThread(int index);
+		// -1 if not called from a worker.
+		int CurrentWorker() const;
+		bool PopTask(int self, Task &task);
+		bool RunOne(int self);
+		void Finish(TaskCounter *counter);
+
+		std::vector<std::thread *> threads_;
+		std::vector<std::thread::id> threadIds_;
+		// One per worker, and the shared one for other threads last.
+		std::vector<WorkQueue *> queues_;
+		volatile u32 queued_;
+		volatile u32 exit_;
+
+		// Idle workers sleep on wake_, and waiting threads with nothing to run on done_.
+		std::mutex sleepLock_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		volatile u32 sleepingWorkers_;
+		volatile u32 sleepingWaiters_;
+	};
+
+	Scheduler::Scheduler(int numWorkers)
+		: queued_(0), exit_(0), sleepingWorkers_(0), sleepingWaiters_(0)
+	{
+		for (int i = 0; i <= numWorkers; ++i)
+			queues_.push_back(new WorkQueue());
+		// Nothing can be queued yet, so the workers won't look at threadIds_ before it's filled.
+		for (int i = 0; i < numWorkers; ++i)
+			threads_.push_back(new std::thread(&Scheduler::WorkerThread, this, i));
+		for (int i = 0; i < numWorkers; ++i)
+			threadIds_.push_back(threads_[i]->get_id());
+	}
+
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleepLock_);
+			Common::AtomicStore(exit_, 1);
+			wake_.notify_all();
+		}
+		for (size_t i = 0; i < threads_.size(); ++i)
+		{
+			threads_[i]->join();
+			delete threads_[i];
+		}
+		for (size_t i = 0; i < queues_.size(); ++i)
+			delete queues_[i];
+	}
+
+	int Scheduler::CurrentWorker() const
+	{
+		const std::thread::id id = std::this_thread::get_id();
+		for (size_t i = 0; i < threadIds_.size(); ++i)
+		{
+			if (threadIds_[i] == id)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	void Scheduler::Push(Task *tasks, int count)
+	{
+		const int self = CurrentWorker();
+		WorkQueue *queue = queues_[self < 0 ? queues_.size() - 1 : self];
+		{
+			std::lock_guard<std::mutex> guard(queue->lock);
+			for (int i = 0; i < count; ++i)
+				queue->tasks.push_back(tasks[i]);
+		}
+		Common::AtomicAdd(queued_, count);
+
+		// The sleepers check queued_ after counting themselves, under sleepLock_, so one of us sees the other.
+		if (Common::AtomicLoad(sleepingWorkers_) != 0 || Common::AtomicLoad(sleepingWaiters_) != 0)
+		{
+			std::lock_guard<std::mutex> guard(sleepLock_);
+			if (count == 1)
+				wake_.notify_one();
+			else
+				wake_.notify_all();
+			done_.notify_all();
+		}
+	}
+
+	bool Scheduler::PopTask(int self, Task &task)
+	{
+		if (Common::AtomicLoad(queued_) == 0)
+			return false;
+
+		// Our own newest task first, it's likely still in cache.
+		if (self >= 0)
+		{
+			WorkQueue *queue = queues_[self];
+			std::lock_guard<std::mutex> guard(queue->lock);
+			if (!queue->tasks.empty())
+			{
+				task = queue->tasks.back();
+				queue->tasks.pop_back();
+				Common::AtomicDecrement(queued_);
+				return true;
+			}
+		}
+
+		// Otherwise the oldest from the shared queue or another worker, starting after ours.
+		const int numQueues = (int)queues_.size();
+		const int start = self < 0 ? numQueues - 1 : self + 1;
+		for (int i = 0; i < numQueues; ++i)
+		{
+			const int victim = (start + i) % numQueues;
+			if (victim == self)
+				continue;
+			WorkQueue *queue = queues_[victim];
+			std::lock_guard<std::mutex> guard(queue->lock);
+			if (!queue->tasks.empty())
+			{
+				task = queue->tasks.front();
+				queue->tasks.pop_front();
+				Common::AtomicDecrement(queued_);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Scheduler::RunOne(int self)
+	{
+		Task task;
+		if (!PopTask(self, task))
+			return false;
+
+		if (task.loop)
+			(*task.loop)(task.lower, task.upper);
+		else
+			task.func();
+		Finish(task.counter.get());
+		return true;
+	}
+
+	void Scheduler::Finish(TaskCounter *counter)
+	{
+		if (Common::AtomicFetchAdd(counter->count, (u32)-1) != 1)
+			return;
+		if (Common::AtomicLoad(sleepingWaiters_) != 0)
+		{
+			std::lock_guard<std::mutex> guard(sleepLock_);
+			done_.notify_all();
+		}
+	}
+
+	void Scheduler::WorkerThread(int index)
+	{
+		Common::SetCurrentThreadName("TaskWorker");
+
+		while (true)
+		{
+			if (RunOne(index))
+				continue;
+
+			std::unique_lock<std::mutex> guard(sleepLock_);
+			Common::AtomicIncrement(sleepingWorkers_);
+			while (Common::AtomicLoad(queued_) == 0 && !Common::AtomicLoad(exit_))
+				wake_.wait(guard);
+			Common::AtomicDecrement(sleepingWorkers_);
+			// Only exit once everything queued has run.
+			if (Common::AtomicLoad(exit_) && Common::AtomicLoad(queued_) == 0)
+				break;
+		}
+	}
+
+	void Scheduler::Wait(TaskCounter *counter)
+	{
+		const int self = CurrentWorker();
+		while (Common::AtomicLoadAcquire(counter->count) != 0)
+		{
+			if (RunOne(self))
+				continue;
+
+			// The rest are running elsewhere, sleep until they're done or there's more to help with.
+			std::unique_lock<std::mutex> guard(sleepLock_);
+			Common::AtomicIncrement(sleepingWaiters_);
+			while (Common::AtomicLoad(counter->count) != 0 && Common::AtomicLoad(queued_) == 0)
+				done_.wait(guard);
+			Common::AtomicDecrement(sleepingWaiters_);
+		}
+	}
+
+	Scheduler *scheduler = 0;
+	volatile u32 schedulerStarted = 0;
+	std::mutex schedulerLock;
+
+	Scheduler *GetScheduler()
+	{
+		if (Common::AtomicLoadAcquire(schedulerStarted))
+			return scheduler;
+
+		std::lock_guard<std::mutex> guard(schedulerLock);
+		if (!scheduler)
+		{
+			scheduler = new Scheduler(std::max(1, g_Config.iNumWorkerThreads));
+			Common::AtomicStoreRelease(schedulerStarted, 1);
+		}
+		return scheduler;
+	}
+}
+
+TaskHandle::TaskHandle()
+{
+}
+
+bool TaskHandle::IsDone() const
+{
+	return !counter_ || Common::AtomicLoadAcquire(counter_->count) == 0;
+}
+
+void TaskHandle::Wait()
+{
+	if (counter_)
+		TaskScheduler::Wait(counter_.get());
+}
+
+TaskGroup::TaskGroup()
+	: counter_(new TaskCounter())
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+void TaskGroup::Run(const std::function<void()> &task)
+{
+	TaskScheduler::Push(task, counter_);
+}
+
+bool TaskGroup::IsDone() const
+{
+	return Common::AtomicLoadAcquire(counter_->count) == 0;
+}
+
+void TaskGroup::Wait()
+{
+	TaskScheduler::Wait(counter_.get());
+}
+
+TaskHandle TaskScheduler::Submit(const std::function<void()> &task)
+{
+	TaskHandle handle;
+	handle.counter_.reset(new TaskCounter());
+	Push(task, handle.counter_);
+	return handle;
+}
+
+void TaskScheduler::Push(const std::function<void()> &func, const std::shared_ptr<TaskCounter> &counter)
+{
+	Task task;
+	task.func = func;
+	task.counter = counter;
+	Common::AtomicIncrement(counter->count);
+	GetScheduler()->Push(&task, 1);
+}
+
+void TaskScheduler::Wait(TaskCounter *counter)
+{
+	if (Common::AtomicLoadAcquire(counter->count) != 0)
+		GetScheduler()->Wait(counter);
+}
+
+void TaskScheduler::ParallelFor(const std::function<void(int,int)> &loop, int lower, int upper, int grain)
+{
+	const int range = upper - lower;
+	if (range <= 0)
+		return;
+
+	Scheduler *sched = GetScheduler();
+	if (grain <= 0)
+		grain = std::max(1, range / ((sched->NumWorkers() + 1) * SLICES_PER_WORKER));
+	const int slices = (range + grain - 1) / grain;
+	if (slices <= 1)
+	{
+		loop(lower, upper);
+		return;
+	}
+
+	// The first slice runs right here, the waiting below helps with the rest.
+	std::shared_ptr<TaskCounter> counter(new TaskCounter());
+	std::vector<Task> tasks(slices - 1);
+	for (int i = 1; i < slices; ++i)
+	{
+		Task &task = tasks[i - 1];
+		task.loop = &loop;
+		task.lower = lower + i * grain;
+		task.upper = std::min(upper, task.lower + grain);
+		task.counter = counter;
+	}
+	Common::AtomicAdd(counter->count, (u32)tasks.size());
+	sched->Push(&tasks[0], (int)tasks.size());
+
+	loop(lower, std::min(upper, lower + grain));
+	sched->Wait(counter.get());
+}
+
+int TaskScheduler::NumWorkers()
+{
+	return GetScheduler()->NumWorkers();
+}
+
+void TaskScheduler::Shutdown()
+{
+	std::lock_guard<std::mutex> guard(schedulerLock);
+	Common::AtomicStoreRelease(schedulerStarted, 0);
+	delete scheduler;
+	scheduler = 0;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "CommonTypes.h"
+
+// Work stealing task scheduler.
+//
+// There are g_Config.iNumWorkerThreads workers, started on first use.  Each has its own
+// queue: tasks submitted from a worker go on its queue and it takes the newest first,
+// while idle workers steal the oldest from the others.  Tasks from other threads go on
+// a shared queue.
+//
+// Waiting (TaskHandle::Wait, TaskGroup::Wait, ParallelFor) runs queued tasks on the
+// waiting thread until the awaited ones are done, so it's fine to wait inside a task.
+// It also means a waiting thread may run tasks from someone else.
+//
+// There are no return values, bind a pointer to a job struct for results, like the
+// GlobalThreadPool::Loop users do.
+
+struct TaskCounter;
+
+class TaskHandle
+{
+public:
+	TaskHandle();
+
+	// An empty handle is always done.
+	bool IsDone() const;
+	void Wait();
+
+private:
+	friend class TaskScheduler;
+	std::shared_ptr<TaskCounter> counter_;
+};
+
+class TaskGroup
+{
+public:
+	TaskGroup();
+	// Waits for anything still running.
+	~TaskGroup();
+
+	void Run(const std::function<void()> &task);
+	bool IsDone() const;
+	void Wait();
+
+private:
+	TaskGroup(const TaskGroup &);
+	void operator =(const TaskGroup &);
+
+	std::shared_ptr<TaskCounter> counter_;
+};
+
+class TaskScheduler
+{
+public:
+	static TaskHandle Submit(const std::function<void()> &task);
+
+	// Runs loop(l, u) over [lower, upper) in slices of about grain, and waits for them.
+	// With grain 0, it picks enough slices to balance the load over the workers.
+	static void ParallelFor(const std::function<void(int,int)> &loop, int lower, int upper, int grain = 0);
+
+	static int NumWorkers();
+
+	// Finishes the queued tasks and stops the workers.  The next use starts them again.
+	static void Shutdown();
+
+private:
+	friend class TaskHandle;
+	friend class TaskGroup;
+	static void Push(const std::function<void()> &task, const std::shared_ptr<TaskCounter> &counter);
+	static void Wait(TaskCounter *counter);
+};
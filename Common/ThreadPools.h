@@ -1,15 +1,11 @@
 #pragma once
 
-#include "thread/threadpool.h"
+#include <functional>
 
+// Kept for the existing users, new code should use TaskScheduler directly.
 class GlobalThreadPool {
 public:
 	// will execute slices of "loop" from "lower" to "upper"
-	// in parallel on the global thread pool
+	// in parallel on the global task scheduler
 	static void Loop(const std::function<void(int,int)>& loop, int lower, int upper);
-
-private:
-	static std::shared_ptr<ThreadPool> pool;
-	static bool initialized;
-	static void Inititialize();
 };
@@ -195,7 +195,13 @@ void Timer::GetTimeFormatted(char formattedTime[13])
 	char tmp[13];
 
 	time(&sysTime);
+#ifdef _WIN32
 	gmTime = localtime(&sysTime);
+#else
+	// Messages are formatted on several threads at once.
+	struct tm localTime;
+	gmTime = localtime_r(&sysTime, &localTime);
+#endif
 
 	strftime(tmp, 6, "%M:%S", gmTime);
 
@@ -0,0 +1,121 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "base/timeutil.h"
+#include "Common/Log.h"
+#include "Common/StdMutex.h"
+#include "Common/StringUtils.h"
+#include "Core/BootProfiler.h"
+
+namespace BootProfiler {
+
+struct PhaseInfo {
+	const char *name;
+	int depth;
+};
+
+// In BootPhase order.
+static const PhaseInfo phaseInfo[BOOT_PHASE_COUNT] = {
+	{ "PSP_Init", 0 },
+	{ "Core and HLE init", 1 },
+	{ "Mount disc", 1 },
+	{ "__KernelLoadExec", 1 },
+	{ "Decrypt PRX", 2 },
+	{ "Load and relocate", 2 },
+	{ "Scan for functions", 2 },
+	{ "Hash functions", 3 },
+	{ "Resolve imports", 2 },
+	{ "GPU init", 1 },
+	{ "JIT compile", 0 },
+};
+
+static std::recursive_mutex profileLock;
+static volatile bool active = false;
+static double startTime;
+static double totals[BOOT_PHASE_COUNT];
+static int counts[BOOT_PHASE_COUNT];
+static std::string report;
+
+void Start() {
+	std::lock_guard<std::recursive_mutex> guard(profileLock);
+	memset(totals, 0, sizeof(totals));
+	memset(counts, 0, sizeof(counts));
+	report.clear();
+	startTime = real_time_now();
+	active = true;
+}
+
+void Finish(bool reachedFirstFrame) {
+	std::lock_guard<std::recursive_mutex> guard(profileLock);
+	if (!active)
+		return;
+	active = false;
+
+	const double elapsed = real_time_now() - startTime;
+	if (reachedFirstFrame)
+		report = StringFromFormat("Boot profile: first frame after %0.1f ms\n", elapsed * 1000.0);
+	else
+		report = StringFromFormat("Boot profile: shut down after %0.1f ms without a frame\n", elapsed * 1000.0);
+	report += StringFromFormat("  %-24s %12s %6s\n", "Phase", "Time", "Count");
+
+	for (int i = 0; i < BOOT_PHASE_COUNT; ++i) {
+		const PhaseInfo &info = phaseInfo[i];
+		const int indent = 2 + info.depth * 2;
+		report += StringFromFormat("%*s%-*s %9.1f ms %6d\n", indent, "", 24 - indent + 2, info.name, totals[i] * 1000.0, counts[i]);
+	}
+
+	// One log line per phase, so it greps well.
+	size_t pos = 0;
+	while (pos < report.size()) {
+		size_t end = report.find('\n', pos);
+		INFO_LOG(LOADER, "%s", report.substr(pos, end - pos).c_str());
+		pos = end + 1;
+	}
+}
+
+bool IsActive() {
+	return active;
+}
+
+void Add(BootPhase phase, double seconds) {
+	std::lock_guard<std::recursive_mutex> guard(profileLock);
+	if (!active)
+		return;
+	totals[phase] += seconds;
+	counts[phase]++;
+}
+
+std::string GetReport() {
+	std::lock_guard<std::recursive_mutex> guard(profileLock);
+	return report;
+}
+
+}  // namespace BootProfiler
+
+BootPhaseTimer::BootPhaseTimer(BootPhase phase) : phase_(phase), start_(0.0) {
+	if (BootProfiler::IsActive())
+		start_ = real_time_now();
+}
+
+void BootPhaseTimer::Stop() {
+	if (start_ != 0.0) {
+		BootProfiler::Add(phase_, real_time_now() - start_);
+		start_ = 0.0;
+	}
+}
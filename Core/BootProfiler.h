@@ -0,0 +1,72 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+
+#include "Common/CommonTypes.h"
+
+// Times the phases of booting a game, from PSP_Init until the first flip.
+//
+// Phases nest as listed, a phase's time includes the ones under it.  Modules the game
+// loads itself before its first frame are counted too, so the load phases can add up to
+// more than __KernelLoadExec.  The report is logged when the boot finishes, and kept for
+// GetReport (headless --boot-profile.)  Outside of a boot the timers do nothing.
+
+enum BootPhase {
+	BOOT_PHASE_INIT,
+	BOOT_PHASE_CORE_INIT,
+	BOOT_PHASE_MOUNT,
+	BOOT_PHASE_LOAD_EXEC,
+	BOOT_PHASE_DECRYPT,
+	BOOT_PHASE_RELOCATE,
+	BOOT_PHASE_SCAN_FUNCTIONS,
+	BOOT_PHASE_HASH_FUNCTIONS,
+	BOOT_PHASE_IMPORTS,
+	BOOT_PHASE_GPU_INIT,
+	BOOT_PHASE_JIT_COMPILE,
+
+	BOOT_PHASE_COUNT,
+};
+
+namespace BootProfiler {
+	// Clears the previous numbers and starts timing.
+	void Start();
+	// Stops timing and logs the report.  Does nothing if not started.
+	void Finish(bool reachedFirstFrame);
+	bool IsActive();
+
+	void Add(BootPhase phase, double seconds);
+	// The report from the last Finish, empty if none.
+	std::string GetReport();
+}
+
+class BootPhaseTimer {
+public:
+	BootPhaseTimer(BootPhase phase);
+	~BootPhaseTimer() {
+		Stop();
+	}
+
+	// To end the phase before the scope does.
+	void Stop();
+
+private:
+	BootPhase phase_;
+	double start_;
+};
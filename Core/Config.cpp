@@ -70,6 +70,14 @@ void Config::Load(const char *iniFileName, const char *controllerIniFilename)
 	general->Get("EnableCheats", &bEnableCheats, false);
 	general->Get("ScreenshotsAsPNG", &bScreenshotsAsPNG, false);
 	general->Get("StateSlot", &iCurrentStateSlot, 0);
+	general->Get("RewindSnapshotInterval", &iRewindSnapshotInterval, 0);
+	general->Get("RewindMaxStates", &iRewindMaxStates, 20);
+	general->Get("RewindMemoryLimitMB", &iRewindMemoryLimitMB, 64);
+	general->Get("SaveStatePageStore", &bSaveStatePageStore, false);
+	general->Get("PrxCache", &bPrxCache, false);
+	general->Get("PrxCacheSizeMB", &iPrxCacheSizeMB, 64);
+	general->Get("FunctionCache", &bFunctionCache, true);
+	general->Get("MemoryMapISO", &bMemoryMapISO, false);
 	general->Get("GridView1", &bGridView1, true);
 	general->Get("GridView2", &bGridView2, true);
 	general->Get("GridView3", &bGridView3, true);
@@ -117,6 +125,7 @@ void Config::Load(const char *iniFileName, const char *controllerIniFilename)
 #endif
 	cpu->Get("FastMemory", &bFastMemory, false);
 	cpu->Get("CPUSpeed", &iLockedCPUSpeed, 0);
+	cpu->Get("HugePages", &iHugePages, 0);
 
 	IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
 	graphics->Get("ShowFPSCounter", &iShowFPSCounter, false);
@@ -216,6 +225,7 @@ void Config::Load(const char *iniFileName, const char *controllerIniFilename)
 	debugConfig->Get("FontWidth", &iFontWidth, 8);
 	debugConfig->Get("FontHeight", &iFontHeight, 12);
 	debugConfig->Get("DisplayStatusBar", &bDisplayStatusBar, true);
+	debugConfig->Get("FileTrace", &sFileTraceFilename, "");
 
 	IniFile::Section *gleshacks = iniFile.GetOrCreateSection("GLESHacks");
 	gleshacks->Get("PrescaleUV", &bPrescaleUV, false);
@@ -266,6 +276,14 @@ void Config::Save() {
 		general->Set("EnableCheats", bEnableCheats);
 		general->Set("ScreenshotsAsPNG", bScreenshotsAsPNG);
 		general->Set("StateSlot", iCurrentStateSlot);
+		general->Set("RewindSnapshotInterval", iRewindSnapshotInterval);
+		general->Set("RewindMaxStates", iRewindMaxStates);
+		general->Set("RewindMemoryLimitMB", iRewindMemoryLimitMB);
+		general->Set("SaveStatePageStore", bSaveStatePageStore);
+		general->Set("PrxCache", bPrxCache);
+		general->Set("PrxCacheSizeMB", iPrxCacheSizeMB);
+		general->Set("FunctionCache", bFunctionCache);
+		general->Set("MemoryMapISO", bMemoryMapISO);
 		general->Set("GridView1", bGridView1);
 		general->Set("GridView2", bGridView2);
 		general->Set("GridView3", bGridView3);
@@ -287,6 +305,7 @@ void Config::Save() {
 		cpu->Set("SeparateIOThread", bSeparateIOThread);
 		cpu->Set("FastMemory", bFastMemory);
 		cpu->Set("CPUSpeed", iLockedCPUSpeed);
+		cpu->Set("HugePages", iHugePages);
 
 		IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
 		graphics->Set("ShowFPSCounter", iShowFPSCounter);
@@ -357,6 +376,7 @@ void Config::Save() {
 		debugConfig->Set("FontWidth", iFontWidth);
 		debugConfig->Set("FontHeight", iFontHeight);
 		debugConfig->Set("DisplayStatusBar", bDisplayStatusBar);
+		debugConfig->Set("FileTrace", sFileTraceFilename);
 		if (!iniFile.Save(iniFilename_.c_str())) {
 			ERROR_LOG(LOADER, "Error saving config - can't write ini %s", iniFilename_.c_str());
 			return;
@@ -54,6 +54,8 @@ public:
 	bool bSeparateCPUThread;
 	bool bSeparateIOThread;
 	int iLockedCPUSpeed;
+	// HugePageMode for the memory arena and JIT code space, Linux only.
+	int iHugePages;
 	bool bAutoSaveSymbolMap;
 	std::string sReportHost;
 	std::vector<std::string> recentIsos;
@@ -90,6 +92,14 @@ public:
 	int iForceMaxEmulatedFPS;
 	int iMaxRecent;
 	int iCurrentStateSlot;
+	int iRewindSnapshotInterval;  // in flips, 0 = rewind disabled
+	int iRewindMaxStates;
+	int iRewindMemoryLimitMB;
+	bool bSaveStatePageStore;  // dedupe slot pages in a shared per-game store
+	bool bPrxCache;  // keep decrypted modules on the memstick to skip decrypting them again
+	int iPrxCacheSizeMB;
+	bool bFunctionCache;  // keep function scan results per game instead of rescanning each boot
+	bool bMemoryMapISO;  // read uncompressed ISOs through a memory mapping when possible
 	bool bEnableCheats;
 	bool bReloadCheats;
 
@@ -157,6 +167,7 @@ public:
 	int iFontWidth;
 	int iFontHeight;
 	bool bDisplayStatusBar;
+	std::string sFileTraceFilename;  // record file IO here (see FileTrace.h), empty for off
 
 	std::string currentDirectory;
 	std::string externalDirectory; 
@@ -551,6 +551,7 @@ int PSPSaveDialog::Update()
 		Memory::Memcpy(&originalRequest, requestAddr, size);
 		param.SetPspParam(&request);
 	}
+	param.UpdateIcons();
 
 	buttons = __CtrlPeekButtons();
 	UpdateFade();
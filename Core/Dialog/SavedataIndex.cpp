@@ -0,0 +1,189 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "Common/FileUtil.h"
+#include "Core/Dialog/SavedataIndex.h"
+#include "Core/ELF/ParamSFO.h"
+#include "Core/FileSystems/MetaFileSystem.h"
+#include "Core/System.h"
+
+static const u32 INDEX_MAGIC = 0x49535050;  // PPSI
+static const u32 INDEX_VERSION = 1;
+static const char *INDEX_PATH = "ms0:/PSP/SYSTEM/CACHE/SAVEDATA.ppsi";
+
+namespace
+{
+	u64 FileTime(const PSPFileInfo &info)
+	{
+		if (!info.exists)
+			return 0;
+		tm t = info.mtime;
+		return (u64)mktime(&t);
+	}
+
+	void CopySFOString(ParamSFOData &sfoFile, const char *name, char *str, int strLength)
+	{
+		std::string value = sfoFile.GetValueString(name);
+		strncpy(str, value.c_str(), strLength - 1);
+		str[strLength - 1] = 0;
+	}
+}
+
+SavedataIndex::SavedataIndex()
+	: dirty_(false)
+{
+}
+
+void SavedataIndex::Load()
+{
+	// A different memstick gets its own index.
+	std::string filename;
+	if (!pspFileSystem.GetHostPath(INDEX_PATH, filename))
+		filename.clear();
+	if (filename == indexFilename_)
+		return;
+
+	Flush();
+	indexFilename_ = filename;
+	records_.clear();
+	dirty_ = false;
+	if (indexFilename_.empty())
+		return;
+
+	File::IOFile file(indexFilename_, "rb");
+	Header header;
+	if (!file || !file.ReadArray(&header, 1) || header.magic != INDEX_MAGIC || header.version != INDEX_VERSION)
+		return;
+
+	std::vector<Record> records(header.count);
+	if (header.count == 0 || !file.ReadArray(&records[0], records.size()))
+		return;
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		records[i].dirPath[sizeof(records[i].dirPath) - 1] = 0;
+		records_[records[i].dirPath] = records[i];
+	}
+}
+
+void SavedataIndex::Flush()
+{
+	if (!dirty_ || indexFilename_.empty())
+		return;
+	dirty_ = false;
+
+	std::vector<Record> records;
+	records.reserve(records_.size());
+	for (std::map<std::string, Record>::iterator it = records_.begin(); it != records_.end(); ++it)
+		records.push_back(it->second);
+
+	Header header;
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.count = (u32)records.size();
+	header.reserved = 0;
+
+	const size_t slash = indexFilename_.find_last_of("/\\");
+	if (slash != std::string::npos)
+		File::CreateFullPath(indexFilename_.substr(0, slash));
+	// Written to the side and renamed, so a crash never leaves half an index.
+	const std::string tempFilename = indexFilename_ + ".tmp";
+	{
+		File::IOFile file(tempFilename, "wb");
+		if (!file || !file.WriteArray(&header, 1) || (!records.empty() && !file.WriteArray(&records[0], records.size())))
+		{
+			WARN_LOG(HLE, "Unable to write savedata index %s", tempFilename.c_str());
+			return;
+		}
+	}
+	File::Delete(indexFilename_);
+	File::Rename(tempFilename, indexFilename_);
+}
+
+void SavedataIndex::Refresh(const std::string &dirPath, const PSPFileInfo &sfoInfo, Record &record)
+{
+	Entry &entry = record.entry;
+	memset(&entry, 0, sizeof(entry));
+
+	PSPFileInfo icon0Info = pspFileSystem.GetFileInfo(dirPath + "/ICON0.PNG");
+	entry.hasIcon0 = icon0Info.exists;
+	entry.icon0Size = icon0Info.exists ? icon0Info.size : 0;
+
+	const std::string sfoPath = dirPath + "/PARAM.SFO";
+	if (sfoInfo.exists && sfoInfo.size > 0)
+	{
+		std::vector<u8> sfoData((size_t)sfoInfo.size);
+		u32 handle = pspFileSystem.OpenFile(sfoPath, FILEACCESS_READ);
+		if (handle != 0)
+		{
+			size_t readSize = pspFileSystem.ReadFile(handle, &sfoData[0], sfoInfo.size);
+			pspFileSystem.CloseFile(handle);
+
+			ParamSFOData sfoFile;
+			if (readSize == sfoData.size() && sfoFile.ReadSFO(&sfoData[0], sfoData.size()))
+			{
+				entry.hasSFO = 1;
+				CopySFOString(sfoFile, "TITLE", entry.title, sizeof(entry.title));
+				CopySFOString(sfoFile, "SAVEDATA_TITLE", entry.saveTitle, sizeof(entry.saveTitle));
+				CopySFOString(sfoFile, "SAVEDATA_DETAIL", entry.saveDetail, sizeof(entry.saveDetail));
+			}
+		}
+	}
+	record.sfoTime = FileTime(sfoInfo);
+	record.sfoSize = sfoInfo.exists ? sfoInfo.size : -1;
+}
+
+void SavedataIndex::Get(const std::string &dirPath, Entry &entry)
+{
+	Load();
+
+	const PSPFileInfo dirInfo = pspFileSystem.GetFileInfo(dirPath);
+	const PSPFileInfo sfoInfo = pspFileSystem.GetFileInfo(dirPath + "/PARAM.SFO");
+	const u64 dirTime = FileTime(dirInfo);
+	const u64 sfoTime = FileTime(sfoInfo);
+	const s64 sfoSize = sfoInfo.exists ? sfoInfo.size : -1;
+
+	std::map<std::string, Record>::iterator it = records_.find(dirPath);
+	if (it != records_.end() && it->second.dirTime == dirTime && it->second.sfoTime == sfoTime && it->second.sfoSize == sfoSize)
+	{
+		entry = it->second.entry;
+		return;
+	}
+
+	// Paths that don't fit aren't kept, just read each time.
+	Record record;
+	memset(&record, 0, sizeof(record));
+	Refresh(dirPath, sfoInfo, record);
+	record.dirTime = dirTime;
+	entry = record.entry;
+	if (dirPath.size() < sizeof(record.dirPath) && dirInfo.exists)
+	{
+		strcpy(record.dirPath, dirPath.c_str());
+		records_[dirPath] = record;
+		dirty_ = true;
+	}
+}
+
+void SavedataIndex::Invalidate(const std::string &dirPath)
+{
+	Load();
+	if (records_.erase(dirPath) != 0)
+		dirty_ = true;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Common/CommonTypes.h"
+
+struct PSPFileInfo;
+
+// Index of save directories on the memstick, so the savedata dialogs can list saves
+// without reading and parsing every PARAM.SFO each time.
+//
+// An entry is reread when the modification time of its directory or PARAM.SFO, or the
+// size of PARAM.SFO, has changed.  Rewriting a file in place doesn't always touch the
+// directory, so saving and deleting invalidate entries too.  The index is a file on the
+// memstick it describes, PSP/SYSTEM/CACHE/SAVEDATA.ppsi.
+//
+// Not thread safe, use from the emu thread.
+class SavedataIndex
+{
+public:
+	struct Entry
+	{
+		u32 hasSFO;
+		u32 hasIcon0;
+		s64 icon0Size;
+		char title[128];
+		char saveTitle[128];
+		char saveDetail[1024];
+	};
+
+	SavedataIndex();
+
+	// dirPath is the full save directory, like ms0:/PSP/SAVEDATA/ULUS10000DATA00.
+	void Get(const std::string &dirPath, Entry &entry);
+	void Invalidate(const std::string &dirPath);
+	// Writes the index if anything changed since it was loaded.
+	void Flush();
+
+private:
+	struct Record
+	{
+		char dirPath[128];
+		u64 dirTime;
+		u64 sfoTime;
+		s64 sfoSize;
+		Entry entry;
+	};
+
+	struct Header
+	{
+		u32 magic;
+		u32 version;
+		u32 count;
+		u32 reserved;
+	};
+
+	void Load();
+	void Refresh(const std::string &dirPath, const PSPFileInfo &sfoInfo, Record &record);
+
+	std::string indexFilename_;
+	std::map<std::string, Record> records_;
+	bool dirty_;
+};
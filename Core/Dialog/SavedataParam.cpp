@@ -17,7 +17,10 @@
 
 
 #include "base/logging.h"
+#include "Common/FileUtil.h"
+#include "Common/TaskScheduler.h"
 #include "Core/Reporting.h"
+#include "Core/Dialog/SavedataIndex.h"
 #include "Core/Dialog/SavedataParam.h"
 #include "Core/Dialog/PSPSaveDialog.h"
 #include "Core/HLE/sceKernelMemory.h"
@@ -39,6 +42,25 @@ static const std::string SFO_FILENAME = "PARAM.SFO";
 
 std::string savePath = "ms0:/PSP/SAVEDATA/";
 
+static SavedataIndex saveIndex;
+
+// An ICON0 being read and decoded on a worker.  Workers never go through pspFileSystem, guest
+// file handles have to stay deterministic, so they read hostPath or get pngData already read.
+struct SaveIconJob
+{
+	SaveIconJob() : size(0), textureData(0), width(0), height(0), decoded(false) {}
+
+	std::string hostPath;
+	std::vector<u8> pngData;
+	std::string saveName;
+	s64 size;
+	unsigned char *textureData;
+	int width;
+	int height;
+	bool decoded;
+	TaskHandle task;
+};
+
 namespace
 {
 	int getSizeNormalized(int size)
@@ -47,13 +69,6 @@ namespace
 		return ((int)((size + sizeCluster - 1) / sizeCluster)) * sizeCluster;
 	}
 
-	void SetStringFromSFO(ParamSFOData &sfoFile, const char *name, char *str, int strLength)
-	{
-		std::string value = sfoFile.GetValueString(name);
-		strncpy(str, value.c_str(), strLength - 1);
-		str[strLength - 1] = 0;
-	}
-
 	bool ReadPSPFile(std::string filename, u8 **data, s64 dataSize, s64 *readSize)
 	{
 		u32 handle = pspFileSystem.OpenFile(filename, FILEACCESS_READ);
@@ -74,6 +89,18 @@ namespace
 		return result != 0;
 	}
 
+	void LoadSaveIcon(SaveIconJob *job)
+	{
+		if (job->pngData.empty())
+		{
+			File::IOFile file(job->hostPath, "rb");
+			job->pngData.resize((size_t)job->size);
+			if (!file || !file.ReadBytes(&job->pngData[0], job->pngData.size()))
+				return;
+		}
+		job->decoded = pngLoadPtr(&job->pngData[0], (int)job->pngData.size(), &job->width, &job->height, &job->textureData, false) != 0;
+	}
+
 	bool WritePSPFile(std::string filename, u8 *data, SceSize dataSize)
 	{
 		u32 handle = pspFileSystem.OpenFile(filename, (FileAccess)(FILEACCESS_WRITE | FILEACCESS_CREATE));
@@ -255,6 +282,8 @@ bool SavedataParam::Delete(SceUtilitySavedataParam* param, int saveId)
 	}
 
 	pspFileSystem.RmDir(dirPath);
+	saveIndex.Invalidate(dirPath);
+	saveIndex.Flush();
 	return true;
 }
 
@@ -445,6 +474,8 @@ bool SavedataParam::Save(SceUtilitySavedataParam* param, const std::string &save
 		WritePSPFile(snd0path, param->snd0FileData.buf, param->snd0FileData.bufSize);
 	}
 
+	saveIndex.Invalidate(dirPath);
+	saveIndex.Flush();
 	return true;
 }
 
@@ -1013,6 +1044,7 @@ bool SavedataParam::GetSize(SceUtilitySavedataParam *param)
 
 void SavedataParam::Clear()
 {
+	CancelIcons();
 	if (saveDataList)
 	{
 		for (int i = 0; i < saveNameListDataCount; i++)
@@ -1132,9 +1164,11 @@ int SavedataParam::SetPspParam(SceUtilitySavedataParam *param)
 				DEBUG_LOG(HLE,"Don't Exist");
 			}
 			saveNameListDataCount = 0;
+			saveIndex.Flush();
 			return 0;
 		}
 	}
+	saveIndex.Flush();
 	return 0;
 }
 
@@ -1144,27 +1178,78 @@ bool SavedataParam::CreatePNGIcon(u8* pngData, int pngSize, SaveFileInfo& info)
 	int w,h;
 
 	int success = pngLoadPtr(pngData, (int)pngSize, &w, &h, &textureData, false);
-
-	u32 texSize = w*h*4;
-	u32 atlasPtr;
-	if (success)
-		atlasPtr = kernelMemory.Alloc(texSize, true, "SaveData Icon");
-	if (success && atlasPtr != (u32)-1)
+	if (!success)
 	{
-		info.textureData = atlasPtr;
-		Memory::Memcpy(atlasPtr, textureData, texSize);
-		free(textureData);
-		info.textureWidth = w;
-		info.textureHeight = h;
+		WARN_LOG(HLE, "Unable to load PNG data for savedata.");
+		return false;
 	}
-	else
+
+	bool created = CreateIconTexture(textureData, w, h, info);
+	free(textureData);
+	return created;
+}
+
+bool SavedataParam::CreateIconTexture(const u8 *textureData, int w, int h, SaveFileInfo &info)
+{
+	u32 texSize = w*h*4;
+	u32 atlasPtr = kernelMemory.Alloc(texSize, true, "SaveData Icon");
+	if (atlasPtr == (u32)-1)
 	{
-		WARN_LOG(HLE, "Unable to load PNG data for savedata.");
+		WARN_LOG(HLE, "Unable to allocate memory for savedata icon.");
 		return false;
 	}
+
+	info.textureData = atlasPtr;
+	Memory::Memcpy(atlasPtr, textureData, texSize);
+	info.textureWidth = w;
+	info.textureHeight = h;
 	return true;
 }
 
+void SavedataParam::UpdateIcons(bool wait)
+{
+	for (size_t i = 0; i < iconJobs.size(); )
+	{
+		SaveIconJob *job = iconJobs[i];
+		if (!wait && !job->task.IsDone())
+		{
+			++i;
+			continue;
+		}
+		job->task.Wait();
+
+		if (job->decoded)
+		{
+			for (int j = 0; j < saveNameListDataCount; j++)
+			{
+				SaveFileInfo &saveInfo = saveDataList[j];
+				if (saveInfo.size != 0 && saveInfo.textureData == 0 && saveInfo.saveName == job->saveName)
+				{
+					CreateIconTexture(job->textureData, job->width, job->height, saveInfo);
+					break;
+				}
+			}
+			free(job->textureData);
+		}
+		else
+			WARN_LOG(HLE, "Unable to load PNG data for savedata.");
+
+		delete job;
+		iconJobs.erase(iconJobs.begin() + i);
+	}
+}
+
+void SavedataParam::CancelIcons()
+{
+	for (size_t i = 0; i < iconJobs.size(); i++)
+	{
+		iconJobs[i]->task.Wait();
+		free(iconJobs[i]->textureData);
+		delete iconJobs[i];
+	}
+	iconJobs.clear();
+}
+
 void SavedataParam::SetFileInfo(SaveFileInfo &saveInfo, PSPFileInfo &info, std::string saveName)
 {
 	saveInfo.size = info.size;
@@ -1178,33 +1263,45 @@ void SavedataParam::SetFileInfo(SaveFileInfo &saveInfo, PSPFileInfo &info, std::
 	saveInfo.saveTitle[0] = 0;
 	saveInfo.saveDetail[0] = 0;
 
-	// Search save image icon0
-	// TODO : If icon0 don't exist, need to use icon1 which is a moving icon. Also play sound
-	std::string fileDataPath2 = savePath + GetGameName(pspParam) + saveName + "/" + ICON0_FILENAME;
-	PSPFileInfo info2 = pspFileSystem.GetFileInfo(fileDataPath2);
-	if (info2.exists)
+	// PARAM.SFO info comes from the index, which only rereads it if it changed.
+	const std::string dirPath = savePath + GetGameName(pspParam) + saveName;
+	SavedataIndex::Entry entry;
+	saveIndex.Get(dirPath, entry);
+	if (entry.hasSFO)
 	{
-		u8 *textureDataPNG = new u8[(size_t)info2.size];
-		ReadPSPFile(fileDataPath2, &textureDataPNG, info2.size, NULL);
-		CreatePNGIcon(textureDataPNG, (int)info2.size, saveInfo);
-		delete[] textureDataPNG;
+		memcpy(saveInfo.title, entry.title, sizeof(saveInfo.title));
+		memcpy(saveInfo.saveTitle, entry.saveTitle, sizeof(saveInfo.saveTitle));
+		memcpy(saveInfo.saveDetail, entry.saveDetail, sizeof(saveInfo.saveDetail));
 	}
 
-	// Load info in PARAM.SFO
-	fileDataPath2 = savePath + GetGameName(pspParam) + saveName + "/" + SFO_FILENAME;
-	info2 = pspFileSystem.GetFileInfo(fileDataPath2);
-	if (info2.exists)
+	// Search save image icon0, it's decoded on a worker and shows up once UpdateIcons sees it done.
+	// TODO : If icon0 don't exist, need to use icon1 which is a moving icon. Also play sound
+	if (entry.hasIcon0 && entry.icon0Size > 0)
 	{
-		u8 *sfoParam = new u8[(size_t)info2.size];
-		ReadPSPFile(fileDataPath2, &sfoParam, info2.size, NULL);
-		ParamSFOData sfoFile;
-		if (sfoFile.ReadSFO(sfoParam,(size_t)info2.size))
+		const std::string iconPath = dirPath + "/" + ICON0_FILENAME;
+		SaveIconJob *job = new SaveIconJob();
+		job->saveName = saveName;
+		job->size = entry.icon0Size;
+		// Without a host file, read it here and only decode on the worker.
+		if (!pspFileSystem.GetHostPath(iconPath, job->hostPath))
 		{
-			SetStringFromSFO(sfoFile, "TITLE", saveInfo.title, sizeof(saveInfo.title));
-			SetStringFromSFO(sfoFile, "SAVEDATA_TITLE", saveInfo.saveTitle, sizeof(saveInfo.saveTitle));
-			SetStringFromSFO(sfoFile, "SAVEDATA_DETAIL", saveInfo.saveDetail, sizeof(saveInfo.saveDetail));
+			job->pngData.resize((size_t)job->size);
+			u8 *data = &job->pngData[0];
+			s64 readSize = 0;
+			if (!ReadPSPFile(iconPath, &data, job->size, &readSize))
+				readSize = 0;
+			job->pngData.resize((size_t)readSize);
+		}
+		if (job->hostPath.empty() && job->pngData.empty())
+		{
+			WARN_LOG(HLE, "Unable to read %s", iconPath.c_str());
+			delete job;
+		}
+		else
+		{
+			job->task = TaskScheduler::Submit(std::bind(&LoadSaveIcon, job));
+			iconJobs.push_back(job);
 		}
-		delete [] sfoParam;
 	}
 }
 
@@ -1368,6 +1465,11 @@ int SavedataParam::GetLastEmptySave()
 
 void SavedataParam::DoState(PointerWrap &p)
 {
+	// Icons still loading stay pending on save, allocating here would change kernel memory mid state.
+	// A loaded list gets no icons for saves that were still loading.
+	if (p.mode == p.MODE_READ)
+		CancelIcons();
+
 	// pspParam is handled in PSPSaveDialog.
 	p.Do(selectedSave);
 	p.Do(saveDataListCount);
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "Core/HLE/sceKernel.h"
 #include "Core/HLE/sceRtc.h"
 #include "Core/System.h"
@@ -271,6 +273,8 @@ struct SaveFileInfo
 	}
 };
 	
+struct SaveIconJob;
+
 class SavedataParam
 {
 public:
@@ -316,11 +320,16 @@ public:
 	int GetFirstEmptySave();
 	int GetLastEmptySave();
 
+	// Icons are decoded on worker threads, this puts the finished ones in the list.
+	void UpdateIcons(bool wait = false);
+
 	void DoState(PointerWrap &p);
 
 private:
 	void Clear();
+	void CancelIcons();
 	bool CreatePNGIcon(u8* pngData, int pngSize, SaveFileInfo& info);
+	bool CreateIconTexture(const u8 *textureData, int w, int h, SaveFileInfo &info);
 	void SetFileInfo(int idx, PSPFileInfo &info, std::string saveName);
 	void SetFileInfo(SaveFileInfo &saveInfo, PSPFileInfo &info, std::string saveName);
 	void ClearFileInfo(SaveFileInfo &saveInfo, std::string saveName);
@@ -336,4 +345,5 @@ private:
 	SaveFileInfo *noSaveIcon;
 	int saveDataListCount;
 	int saveNameListDataCount;
+	std::vector<SaveIconJob *> iconJobs;
 };
@@ -0,0 +1,252 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "Common/FileUtil.h"
+#include "Common/Hash.h"
+#include "Common/StdMutex.h"
+#include "Core/Config.h"
+#include "Core/ELF/PrxCache.h"
+#include "Core/ELF/PrxDecrypter.h"
+
+static const u32 INDEX_MAGIC = 0x49435050;  // PPCI
+static const u32 INDEX_VERSION = 2;  // 2: keys hashed with XXH64 instead of MurmurHash3.
+
+PrxCacheStats prxCacheStats;
+
+namespace {
+	bool LeastRecentlyUsed(const std::pair<u32, PrxCache::Key> &a, const std::pair<u32, PrxCache::Key> &b)
+	{
+		return a.first < b.first;
+	}
+}
+
+PrxCache::PrxCache(const std::string &directory, u64 maxBytes)
+	: directory_(directory), indexFilename_(directory + "index.ppci"), maxBytes_(maxBytes), totalBytes_(0), useCounter_(0), indexLoaded_(false)
+{
+}
+
+PrxCache::Key PrxCache::MakeKey(const u8 *encrypted, u32 size)
+{
+	Key key;
+	key.hash = HashXXH64(encrypted, size);
+	key.check = HashAdler32(encrypted, size);
+	key.size = size;
+	return key;
+}
+
+std::string PrxCache::EntryFilename(const Key &key) const
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx_%08x_%08x.elf", (unsigned long long)key.hash, key.check, key.size);
+	return directory_ + name;
+}
+
+void PrxCache::LoadIndex()
+{
+	if (indexLoaded_)
+		return;
+	indexLoaded_ = true;
+	index_.clear();
+	totalBytes_ = 0;
+	useCounter_ = 0;
+
+	File::IOFile indexFile(indexFilename_, "rb");
+	IndexHeader header;
+	if (!indexFile || !indexFile.ReadArray(&header, 1) || header.magic != INDEX_MAGIC)
+		return;
+
+	std::vector<IndexEntry> entries(header.count);
+	if (header.count == 0 || !indexFile.ReadArray(&entries[0], entries.size()))
+		return;
+
+	if (header.version != INDEX_VERSION)
+	{
+		// The keys are hashed differently, so these could never be looked up again.
+		for (size_t i = 0; i < entries.size(); ++i)
+			File::Delete(EntryFilename(entries[i].key));
+		INFO_LOG(LOADER, "PrxCache: dropped %d modules from an old index", (int)entries.size());
+		return;
+	}
+
+	useCounter_ = header.useCounter;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		// The file might have been deleted by hand, forget it then.
+		const std::string filename = EntryFilename(entries[i].key);
+		if (!File::Exists(filename) || File::GetSize(filename) != entries[i].decryptedSize)
+			continue;
+		index_[entries[i].key] = entries[i];
+		totalBytes_ += entries[i].decryptedSize;
+	}
+	INFO_LOG(LOADER, "PrxCache: %d modules, %d KB in %s", (int)index_.size(), (int)(totalBytes_ / 1024), directory_.c_str());
+}
+
+void PrxCache::SaveIndex()
+{
+	std::vector<IndexEntry> entries;
+	entries.reserve(index_.size());
+	for (std::map<Key, IndexEntry>::iterator it = index_.begin(); it != index_.end(); ++it)
+		entries.push_back(it->second);
+
+	IndexHeader header;
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.count = (u32)entries.size();
+	header.useCounter = useCounter_;
+
+	// Written to the side and renamed, so a crash never leaves half an index.
+	const std::string tempFilename = indexFilename_ + ".tmp";
+	{
+		File::IOFile indexFile(tempFilename, "wb");
+		if (!indexFile || !indexFile.WriteArray(&header, 1) || (!entries.empty() && !indexFile.WriteArray(&entries[0], entries.size())))
+		{
+			ERROR_LOG(LOADER, "PrxCache: Failed writing %s", tempFilename.c_str());
+			return;
+		}
+	}
+	File::Delete(indexFilename_);
+	File::Rename(tempFilename, indexFilename_);
+}
+
+u32 PrxCache::Lookup(const Key &key, u8 *dest, u32 maxSize)
+{
+	LoadIndex();
+	std::map<Key, IndexEntry>::iterator it = index_.find(key);
+	if (it == index_.end())
+		return 0;
+
+	IndexEntry &entry = it->second;
+	if (entry.decryptedSize > maxSize)
+		return 0;
+
+	File::IOFile file(EntryFilename(key), "rb");
+	if (!file || !file.ReadBytes(dest, entry.decryptedSize) || HashAdler32(dest, entry.decryptedSize) != entry.decryptedCheck)
+	{
+		WARN_LOG(LOADER, "PrxCache: Dropping bad entry %s", EntryFilename(key).c_str());
+		file.Close();
+		Remove(key);
+		SaveIndex();
+		return 0;
+	}
+
+	entry.lastUse = ++useCounter_;
+	entry.hits++;
+	SaveIndex();
+	return entry.decryptedSize;
+}
+
+void PrxCache::Store(const Key &key, const u8 *decrypted, u32 decryptedSize)
+{
+	LoadIndex();
+	if (decryptedSize == 0 || decryptedSize > maxBytes_ || index_.find(key) != index_.end())
+		return;
+
+	File::CreateFullPath(directory_);
+	const std::string filename = EntryFilename(key);
+	{
+		File::IOFile file(filename, "wb");
+		if (!file || !file.WriteBytes(decrypted, decryptedSize))
+		{
+			ERROR_LOG(LOADER, "PrxCache: Failed writing %s", filename.c_str());
+			file.Close();
+			File::Delete(filename);
+			return;
+		}
+	}
+
+	IndexEntry entry;
+	entry.key = key;
+	entry.decryptedSize = decryptedSize;
+	entry.decryptedCheck = HashAdler32(decrypted, decryptedSize);
+	entry.lastUse = ++useCounter_;
+	entry.hits = 0;
+	index_[key] = entry;
+	totalBytes_ += decryptedSize;
+	prxCacheStats.stores++;
+
+	EvictToFit();
+	SaveIndex();
+}
+
+void PrxCache::Remove(const Key &key)
+{
+	std::map<Key, IndexEntry>::iterator it = index_.find(key);
+	if (it == index_.end())
+		return;
+	totalBytes_ -= it->second.decryptedSize;
+	File::Delete(EntryFilename(key));
+	index_.erase(it);
+}
+
+void PrxCache::EvictToFit()
+{
+	if (totalBytes_ <= maxBytes_)
+		return;
+
+	std::vector<std::pair<u32, Key> > byUse;
+	byUse.reserve(index_.size());
+	for (std::map<Key, IndexEntry>::iterator it = index_.begin(); it != index_.end(); ++it)
+		byUse.push_back(std::make_pair(it->second.lastUse, it->first));
+	std::sort(byUse.begin(), byUse.end(), &LeastRecentlyUsed);
+
+	for (size_t i = 0; i < byUse.size() && totalBytes_ > maxBytes_; ++i)
+	{
+		Remove(byUse[i].second);
+		prxCacheStats.evictions++;
+	}
+}
+
+static PrxCache *prxCache = 0;
+static std::recursive_mutex prxCacheLock;
+
+int pspDecryptPRXCached(const u8 *inbuf, u8 *outbuf, u32 size)
+{
+	if (!g_Config.bPrxCache)
+		return pspDecryptPRX(inbuf, outbuf, size);
+
+	std::lock_guard<std::recursive_mutex> guard(prxCacheLock);
+	const std::string directory = g_Config.memCardDirectory + "PSP/SYSTEM/CACHE/PRX/";
+	const u64 maxBytes = (u64)std::max(0, g_Config.iPrxCacheSizeMB) * 1024 * 1024;
+	if (prxCache && prxCache->Directory() != directory)
+	{
+		delete prxCache;
+		prxCache = 0;
+	}
+	if (!prxCache)
+		prxCache = new PrxCache(directory, maxBytes);
+	prxCache->SetMaxBytes(maxBytes);
+
+	// The decrypted module is never larger than the encrypted one.
+	const PrxCache::Key key = PrxCache::MakeKey(inbuf, size);
+	u32 cachedSize = prxCache->Lookup(key, outbuf, size);
+	if (cachedSize != 0)
+	{
+		prxCacheStats.hits++;
+		DEBUG_LOG(LOADER, "PrxCache: Hit, %d bytes", cachedSize);
+		return (int)cachedSize;
+	}
+
+	prxCacheStats.misses++;
+	int ret = pspDecryptPRX(inbuf, outbuf, size);
+	if (ret > 0 && (u32)ret <= size)
+		prxCache->Store(key, outbuf, (u32)ret);
+	return ret;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Common/CommonTypes.h"
+
+// On disk cache of decrypted modules, so later boots and reloads can skip pspDecryptPRX.
+//
+// Each decrypted ELF is a file of its own, named after its key: a hash, checksum and size
+// of the encrypted module.  An index file keeps the size and checksum of the decrypted data,
+// hit counts, and the order of use.  When the files add up to more than the size cap, the
+// least recently used ones are deleted.
+//
+// Not thread safe, use from one thread at a time.
+class PrxCache
+{
+public:
+	struct Key
+	{
+		u64 hash;
+		u32 check;
+		u32 size;
+
+		bool operator < (const Key &other) const
+		{
+			if (hash != other.hash)
+				return hash < other.hash;
+			if (check != other.check)
+				return check < other.check;
+			return size < other.size;
+		}
+	};
+
+	// The directory should end with a slash.
+	PrxCache(const std::string &directory, u64 maxBytes);
+
+	const std::string &Directory() const { return directory_; }
+	void SetMaxBytes(u64 maxBytes) { maxBytes_ = maxBytes; }
+	u64 TotalBytes() const { return totalBytes_; }
+
+	static Key MakeKey(const u8 *encrypted, u32 size);
+
+	// Copies the decrypted module to dest, if cached and no larger than maxSize.
+	// Returns its size, or 0 on a miss.
+	u32 Lookup(const Key &key, u8 *dest, u32 maxSize);
+	void Store(const Key &key, const u8 *decrypted, u32 decryptedSize);
+
+private:
+	struct IndexEntry
+	{
+		Key key;
+		u32 decryptedSize;
+		u32 decryptedCheck;
+		u32 lastUse;
+		u32 hits;
+	};
+
+	struct IndexHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 count;
+		u32 useCounter;
+	};
+
+	void LoadIndex();
+	void SaveIndex();
+	void Remove(const Key &key);
+	void EvictToFit();
+	std::string EntryFilename(const Key &key) const;
+
+	std::string directory_;
+	std::string indexFilename_;
+	u64 maxBytes_;
+	u64 totalBytes_;
+	u32 useCounter_;
+	bool indexLoaded_;
+	std::map<Key, IndexEntry> index_;
+};
+
+struct PrxCacheStats
+{
+	u32 hits;
+	u32 misses;
+	u32 stores;
+	u32 evictions;
+};
+
+extern PrxCacheStats prxCacheStats;
+
+// Same as pspDecryptPRX, going through the cache when g_Config.bPrxCache is on.
+int pspDecryptPRXCached(const u8 *inbuf, u8 *outbuf, u32 size);
@@ -17,9 +17,20 @@
 
 
 #include "Common/FileUtil.h"
+#include "Common/ThreadPools.h"
+#include "Core/Config.h"
 #include "Core/FileSystems/BlockDevices.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <functional>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
 
 extern "C"
 {
@@ -28,6 +39,15 @@ extern "C"
 #include "ext/libkirk/kirk_engine.h"
 };
 
+bool BlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
+	bool result = true;
+	for (int i = 0; i < count; ++i) {
+		if (!ReadBlock(minBlock + i, outPtr + i * GetBlockSize()))
+			result = false;
+	}
+	return result;
+}
+
 BlockDevice *constructBlockDevice(const char *filename) {
 	// Check for CISO
 	FILE *f = File::OpenCFile(filename, "rb");
@@ -38,27 +58,119 @@ BlockDevice *constructBlockDevice(const char *filename) {
 	fseek(f, 0, SEEK_SET);
 	if (!memcmp(buffer, "CISO", 4) && size == 4)
 		return new CISOFileBlockDevice(f);
+	else if (!memcmp(buffer, "PPZI", 4) && size == 4)
+		return new PPZFileBlockDevice(f);
 	else if (!memcmp(buffer, "\x00PBP", 4) && size == 4)
 		return new NPDRMDemoBlockDevice(f);
 	else
-		return new FileBlockDevice(f);
+		return new FileBlockDevice(f, g_Config.bMemoryMapISO);
 }
 
-FileBlockDevice::FileBlockDevice(FILE *file)
-	: f(file)
+// Once this many blocks were read in a row, we start hinting read-ahead.
+static const u32 SEQUENTIAL_THRESHOLD_BLOCKS = 64;
+// How far ahead to hint or read, we renew it when half of it is used up.
+static const u32 READAHEAD_BLOCKS = 512;
+// Decompressed CSO blocks to keep around (4 MB.)
+static const size_t CSO_CACHE_BLOCKS = 2048;
+// Below this, inflating on the calling thread is faster than using the thread pool.
+static const int PARALLEL_INFLATE_BLOCKS = 32;
+// Decompressed PPZ blocks to keep around, 16 - 128 KB each.
+static const u32 PPZ_CACHE_SLOTS = 8;
+// Decrypted NPDRM blocks to keep around, usually 32 KB each.
+static const u32 NPDRM_CACHE_SLOTS = 32;
+// How many NPDRM blocks to decrypt ahead, we renew it when half of it is used up.
+static const u32 NPDRM_READAHEAD_BLOCKS = 8;
+
+BlockDeviceStats blockDeviceStats;
+
+FileBlockDevice::FileBlockDevice(FILE *file, bool allowMap)
+	: f(file), mapped(0), nextSequentialBlock(0), sequentialBlocks(0), adviseAheadBlock(0)
 {
 	fseek(f,0,SEEK_END);
 	filesize = ftell(f);
 	fseek(f,0,SEEK_SET);
+
+	if (allowMap)
+		Map();
 }
 
 FileBlockDevice::~FileBlockDevice()
 {
+	Unmap();
 	fclose(f);
 }
 
+void FileBlockDevice::Map()
+{
+#ifdef HAVE_MMAP
+	if (filesize == 0)
+		return;
+
+	// This fails on some filesystems (and for huge images in 32-bit), then we just use the FILE.
+	void *ptr = mmap(0, filesize, PROT_READ, MAP_SHARED, fileno(f), 0);
+	if (ptr == MAP_FAILED)
+	{
+		INFO_LOG(LOADER, "Could not memory map ISO, reading it normally");
+		return;
+	}
+	mapped = (u8 *)ptr;
+	INFO_LOG(LOADER, "Memory mapped ISO, %d bytes", (int)filesize);
+#endif
+}
+
+void FileBlockDevice::Unmap()
+{
+#ifdef HAVE_MMAP
+	if (mapped)
+		munmap(mapped, filesize);
+#endif
+	mapped = 0;
+}
+
+void FileBlockDevice::AdviseAccess(u32 minBlock, int count)
+{
+#ifdef HAVE_MMAP
+	if (minBlock == nextSequentialBlock)
+		sequentialBlocks += count;
+	else
+	{
+		sequentialBlocks = count;
+		adviseAheadBlock = 0;
+	}
+	nextSequentialBlock = minBlock + count;
+
+	// Random access (directory walks, seeks) gets the default kernel behavior.
+	if (sequentialBlocks < SEQUENTIAL_THRESHOLD_BLOCKS || nextSequentialBlock + READAHEAD_BLOCKS / 2 <= adviseAheadBlock)
+		return;
+
+	const u32 start = std::max(nextSequentialBlock, adviseAheadBlock);
+	const u32 end = std::min(nextSequentialBlock + READAHEAD_BLOCKS, GetNumBlocks());
+	if (end > start)
+	{
+		static const size_t pageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+		const size_t offset = ((size_t)start * GetBlockSize()) & ~pageMask;
+		const size_t length = (size_t)end * GetBlockSize() - offset;
+		madvise(mapped + offset, length, MADV_SEQUENTIAL);
+		madvise(mapped + offset, length, MADV_WILLNEED);
+	}
+	adviseAheadBlock = end;
+#endif
+}
+
+const u8 *FileBlockDevice::MappedBlocks(u32 minBlock, int count)
+{
+	if (!mapped || count <= 0 || (u64)(minBlock + count) * GetBlockSize() > filesize)
+		return 0;
+
+	AdviseAccess(minBlock, count);
+	return mapped + (size_t)minBlock * GetBlockSize();
+}
+
 bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
 {
+	if (mapped)
+		return ReadBlocks(blockNumber, 1, outPtr);
+
 	fseek(f, blockNumber * GetBlockSize(), SEEK_SET);
 	if(fread(outPtr, 1, 2048, f) != 2048)
 		DEBUG_LOG(LOADER, "Could not read 2048 bytes from block");
@@ -66,6 +178,37 @@ bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
 	return true;
 }
 
+bool FileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+
+	const size_t bytes = (size_t)count * GetBlockSize();
+	size_t readSize;
+	if (mapped)
+	{
+		const size_t offset = (size_t)minBlock * GetBlockSize();
+		readSize = offset < filesize ? std::min(bytes, filesize - offset) : 0;
+		if (readSize != 0)
+		{
+			AdviseAccess(minBlock, count);
+			memcpy(outPtr, mapped + offset, readSize);
+		}
+	}
+	else
+	{
+		fseek(f, minBlock * GetBlockSize(), SEEK_SET);
+		readSize = fread(outPtr, 1, bytes, f);
+	}
+	if (readSize != bytes)
+	{
+		DEBUG_LOG(LOADER, "Could not read %d bytes from block %d", (int)bytes, minBlock);
+		memset(outPtr + readSize, 0, bytes - readSize);
+	}
+
+	return true;
+}
+
 // .CSO format
 
 // compressed ISO(9660) header format
@@ -95,7 +238,8 @@ typedef struct ciso_header
 // TODO: Need much better error handling.
 
 CISOFileBlockDevice::CISOFileBlockDevice(FILE *file)
-	: f(file)
+	: f(file), cacheTick(0), nextSequentialBlock(0), sequentialBlocks(0),
+	  readAheadRunning(false), readAheadStart(0), readAheadCount(0), readAheadEnd(0)
 {
 	// CISO format is EXTREMELY crappy and incomplete. All tools make broken CISO.
 
@@ -153,78 +297,463 @@ CISOFileBlockDevice::CISOFileBlockDevice(FILE *file)
 
 CISOFileBlockDevice::~CISOFileBlockDevice()
 {
+	readAhead.Wait();
 	fclose(f);
 	delete [] index;
 }
 
-bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
+namespace {
+	struct InflateJob
+	{
+		const u32 *index;
+		int indexShift;
+		u32 blockSize;
+		u32 minBlock;
+		u32 firstPos;
+		const u8 *inbuffer;
+		u32 readSize;
+		u8 *outPtr;
+		u8 *ok;
+	};
+
+	// Parallelizable over blocks, each slice gets its own inflate stream.
+	void InflateBlocks(InflateJob *job, int l, int u) {
+		z_stream z;
+		z.zalloc = Z_NULL;
+		z.zfree = Z_NULL;
+		z.opaque = Z_NULL;
+		if (inflateInit2(&z, -15) != Z_OK)
+		{
+			ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z.msg) ? z.msg : "???");
+			memset(job->ok + l, 0, u - l);
+			return;
+		}
+
+		for (int i = l; i < u; ++i)
+		{
+			const u32 blockNumber = job->minBlock + i;
+			u32 idx = job->index[blockNumber];
+			u32 idx2 = job->index[blockNumber + 1];
+			const int plain = idx & 0x80000000;
+			idx = ((idx & 0x7FFFFFFF) << job->indexShift) - job->firstPos;
+			idx2 = ((idx2 & 0x7FFFFFFF) << job->indexShift) - job->firstPos;
+
+			u8 *out = job->outPtr + i * 2048;
+			memset(out, 0, 2048);
+			job->ok[i] = 0;
+			if (idx2 > job->readSize || idx2 < idx)
+			{
+				ERROR_LOG(LOADER, "block %d : could not read compressed data\n", blockNumber);
+				continue;
+			}
+
+			if (plain)
+			{
+				memcpy(out, job->inbuffer + idx, std::min(idx2 - idx, (u32)2048));
+				job->ok[i] = 1;
+				continue;
+			}
+
+			inflateReset(&z);
+			z.avail_in = idx2 - idx;
+			z.next_in = (Bytef *)job->inbuffer + idx;
+			z.avail_out = job->blockSize;
+			z.next_out = out;
+
+			int status = inflate(&z, Z_FULL_FLUSH);
+			if (status != Z_STREAM_END)
+			{
+				ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
+				continue;
+			}
+			int cmp_size = job->blockSize - z.avail_out;
+			if (cmp_size != (int)job->blockSize)
+			{
+				ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, job->blockSize);
+				continue;
+			}
+			job->ok[i] = 1;
+		}
+
+		inflateEnd(&z);
+	}
+}
+
+bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+
+	CheckReadAhead(minBlock, count);
+
+	// Serve what we can from the cache, and decompress each run of missing blocks together.
+	bool result = true;
+	int i = 0;
+	while (i < count)
+	{
+		if (ReadFromCache(minBlock + i, outPtr + i * 2048))
+		{
+			++i;
+			continue;
+		}
+
+		// This also copies the cached block that ends the run, if any.
+		int end = i + 1;
+		while (end < count && !ReadFromCache(minBlock + end, outPtr + end * 2048))
+			++end;
+
+		if (!ReadUncached(minBlock + i, end - i, outPtr + i * 2048))
+			result = false;
+
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		blockDeviceStats.cacheMisses += end - i;
+		for (int j = i; j < end; ++j)
+			AddToCache(minBlock + j, outPtr + j * 2048, false);
+		i = end + 1;
+	}
+	return result;
+}
+
+bool CISOFileBlockDevice::ReadUncached(u32 minBlock, int count, u8 *outPtr)
 {
-	if ((u32)blockNumber >= numBlocks)
+	if (minBlock >= numBlocks || (u32)count > numBlocks - minBlock)
 	{
-		memset(outPtr, 0, 2048);
+		const int valid = minBlock >= numBlocks ? 0 : (int)(numBlocks - minBlock);
+		memset(outPtr + valid * 2048, 0, (count - valid) * 2048);
+		if (valid > 0)
+			ReadUncached(minBlock, valid, outPtr);
 		return false;
 	}
 
-	u32 idx = index[blockNumber];
-	u32 idx2 = index[blockNumber+1];
-	u8 inbuffer[4096]; //too big
-	z_stream z;
+	// The compressed blocks are stored in order, so we can read all of them at once.
+	const u32 firstPos = (index[minBlock] & 0x7FFFFFFF) << indexShift;
+	const u32 lastPos = (index[minBlock + count] & 0x7FFFFFFF) << indexShift;
+	if (lastPos < firstPos)
+	{
+		ERROR_LOG(LOADER, "block %d : bad CSO index\n", minBlock);
+		memset(outPtr, 0, count * 2048);
+		return false;
+	}
 
-	int plain = idx & 0x80000000;
+	std::vector<u8> inbuffer(std::max(lastPos - firstPos, (u32)1));
+	u32 readSize;
+	{
+		// Read-ahead shares the file with us.
+		std::lock_guard<std::recursive_mutex> guard(fileLock);
+		fseek(f, firstPos, SEEK_SET);
+		readSize = (u32)fread(&inbuffer[0], 1, lastPos - firstPos, f);
+	}
+
+	std::vector<u8> ok(count);
+	InflateJob job;
+	job.index = index;
+	job.indexShift = indexShift;
+	job.blockSize = blockSize;
+	job.minBlock = minBlock;
+	job.firstPos = firstPos;
+	job.inbuffer = &inbuffer[0];
+	job.readSize = readSize;
+	job.outPtr = outPtr;
+	job.ok = &ok[0];
 
-	idx = (idx & 0x7FFFFFFF) << indexShift;
-	idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+	// Not worth waking up the workers for a few blocks.
+	if (count >= PARALLEL_INFLATE_BLOCKS)
+		GlobalThreadPool::Loop(std::bind(&InflateBlocks, &job, std::placeholders::_1, std::placeholders::_2), 0, count);
+	else
+		InflateBlocks(&job, 0, count);
 
-	u32 compressedReadPos = idx;
-	u32 compressedReadSize = idx2 - idx;
+	return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
 
-	fseek(f, compressedReadPos, SEEK_SET);
-	u32 readSize = (u32)fread(inbuffer, 1, compressedReadSize, f);
+bool CISOFileBlockDevice::ReadFromCache(u32 blockNumber, u8 *outPtr)
+{
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	BlockCache::iterator it = cache.find(blockNumber);
+	if (it == cache.end())
+		return false;
 
-	if (plain)
+	CachedBlock &cached = it->second;
+	memcpy(outPtr, cached.data, 2048);
+	cached.lastUse = ++cacheTick;
+	blockDeviceStats.cacheHits++;
+	if (cached.readAhead)
 	{
-		memset(outPtr, 0, 2048);
-		memcpy(outPtr, inbuffer, readSize);
+		blockDeviceStats.readAheadHits++;
+		cached.readAhead = false;
 	}
+	return true;
+}
+
+void CISOFileBlockDevice::AddToCache(u32 blockNumber, const u8 *data, bool readAhead)
+{
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	CachedBlock &cached = cache[blockNumber];
+	memcpy(cached.data, data, 2048);
+	cached.lastUse = ++cacheTick;
+	cached.readAhead = readAhead;
+
+	if (cache.size() > CSO_CACHE_BLOCKS)
+		DecimateCache();
+}
+
+void CISOFileBlockDevice::DecimateCache()
+{
+	// Throw out the least recently used quarter at once, so we don't have to do this often.
+	std::vector<u32> uses;
+	uses.reserve(cache.size());
+	for (BlockCache::iterator it = cache.begin(), end = cache.end(); it != end; ++it)
+		uses.push_back(it->second.lastUse);
+	std::nth_element(uses.begin(), uses.begin() + uses.size() / 4, uses.end());
+	const u32 cutoff = uses[uses.size() / 4];
+
+	for (BlockCache::iterator it = cache.begin(); it != cache.end(); )
+	{
+		if (it->second.lastUse < cutoff)
+			cache.erase(it++);
+		else
+			++it;
+	}
+}
+
+void CISOFileBlockDevice::CheckReadAhead(u32 minBlock, int count)
+{
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	if (minBlock == nextSequentialBlock)
+		sequentialBlocks += count;
 	else
 	{
-		memset(outPtr, 0, 2048);
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if(inflateInit2(&z, -15) != Z_OK)
+		sequentialBlocks = count;
+		readAheadEnd = 0;
+	}
+	nextSequentialBlock = minBlock + count;
+
+	// Only streaming gets read-ahead, and only one at a time.
+	if (sequentialBlocks < SEQUENTIAL_THRESHOLD_BLOCKS || readAheadRunning)
+		return;
+	if (readAheadEnd >= nextSequentialBlock + READAHEAD_BLOCKS / 2)
+		return;
+
+	const u32 start = std::max(nextSequentialBlock, readAheadEnd);
+	const u32 end = std::min(nextSequentialBlock + READAHEAD_BLOCKS, numBlocks);
+	if (start >= end)
+		return;
+
+	// The last one cleared readAheadRunning as its last step, so it's done with us.
+	readAheadStart = start;
+	readAheadCount = end - start;
+	readAheadEnd = end;
+	readAheadRunning = true;
+	readAhead = TaskScheduler::Submit(std::bind(&CISOFileBlockDevice::ReadAheadTask, this));
+}
+
+void CISOFileBlockDevice::ReadAheadTask()
+{
+	u32 start, end;
+	{
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		start = readAheadStart;
+		end = readAheadStart + readAheadCount;
+	}
+
+	std::vector<u8> data((end - start) * 2048);
+	ReadUncached(start, end - start, &data[0]);
+
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	for (u32 block = start; block < end; ++block)
+	{
+		// Don't overwrite (and reset the use of) what was read in the meantime.
+		if (cache.find(block) == cache.end())
+			AddToCache(block, &data[(block - start) * 2048], true);
+	}
+	blockDeviceStats.readAheadBlocks += end - start;
+	readAheadRunning = false;
+}
+
+
+PPZFileBlockDevice::PPZFileBlockDevice(FILE *file)
+	: f(file), numSectors(0), sectorsPerBlock(1), cacheTick(0)
+{
+	if (fread(&header, sizeof(header), 1, f) != 1 || !PPZ::IsValidHeader(header))
+	{
+		ERROR_LOG(LOADER, "Invalid PPZ image!");
+		return;
+	}
+
+	index.resize((u32)header.numBlocks);
+	if (!index.empty() && fread(&index[0], sizeof(PPZ::IndexEntry), index.size(), f) != index.size())
+	{
+		ERROR_LOG(LOADER, "Could not read PPZ index!");
+		return;
+	}
+
+	numSectors = (u32)(header.totalBytes / 2048);
+	sectorsPerBlock = header.blockSize / 2048;
+	slots.resize(PPZ_CACHE_SLOTS);
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		slots[i].block = (u32)-1;
+		slots[i].lastUse = 0;
+		slots[i].data.resize((u32)header.blockSize);
+	}
+	VERBOSE_LOG(LOADER, "PPZ blockSize=%i numBlocks=%i method=%i", (u32)header.blockSize, (u32)header.numBlocks, header.method);
+}
+
+PPZFileBlockDevice::~PPZFileBlockDevice()
+{
+	fclose(f);
+}
+
+PPZFileBlockDevice::CacheSlot *PPZFileBlockDevice::FindSlot(u32 block)
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].block == block)
+			return &slots[i];
+	}
+	return 0;
+}
+
+namespace {
+	struct PPZJob
+	{
+		const PPZ::Header *header;
+		const PPZ::IndexEntry *entry;
+		std::vector<u8> compressed;
+		u8 *dest;
+		u32 destSize;
+		bool ok;
+	};
+
+	// Parallelizable over jobs.
+	void DecompressPPZJobs(PPZJob *jobs, int l, int u) {
+		for (int i = l; i < u; ++i) {
+			PPZJob &job = jobs[i];
+			const u8 *src = job.compressed.empty() ? 0 : &job.compressed[0];
+			job.ok = PPZ::ReadBlockData(*job.header, *job.entry, src, job.dest, job.destSize);
+		}
+	}
+}
+
+bool PPZFileBlockDevice::LoadBlocks(u32 first, u32 count)
+{
+	// Everything already loaded is kept, and marked used so we don't evict it for the others.
+	const u32 tick = ++cacheTick;
+	for (u32 block = first; block < first + count; ++block)
+	{
+		CacheSlot *slot = FindSlot(block);
+		if (slot)
+			slot->lastUse = tick;
+	}
+
+	std::vector<PPZJob> jobs;
+	jobs.reserve(count);
+	for (u32 block = first; block < first + count; ++block)
+	{
+		if (FindSlot(block))
+			continue;
+
+		CacheSlot *slot = &slots[0];
+		for (size_t i = 1; i < slots.size(); ++i)
 		{
-			ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z.msg) ? z.msg : "???");
-			return false;
+			if (slots[i].lastUse < slot->lastUse)
+				slot = &slots[i];
 		}
-		z.avail_in = readSize;
-		z.next_out = outPtr;
-		z.avail_out = blockSize;
-		z.next_in = inbuffer;
-
-		int status = inflate(&z, Z_FULL_FLUSH);
-		if(status != Z_STREAM_END)
-			//if (status != Z_OK)
+		slot->block = block;
+		slot->lastUse = tick;
+
+		const PPZ::IndexEntry &entry = index[block];
+		jobs.push_back(PPZJob());
+		PPZJob &job = jobs.back();
+		job.header = &header;
+		job.entry = &entry;
+		job.dest = &slot->data[0];
+		job.destSize = PPZ::BlockDataSize(header, block);
+		job.ok = false;
+		job.compressed.resize((u32)entry.size & ~PPZ::BLOCK_STORED);
+		if (job.destSize < header.blockSize)
+			memset(job.dest + job.destSize, 0, (u32)header.blockSize - job.destSize);
+
+		fseeko(f, entry.offset, SEEK_SET);
+		if (!job.compressed.empty() && fread(&job.compressed[0], 1, job.compressed.size(), f) != job.compressed.size())
+			ERROR_LOG(LOADER, "PPZ block %d: could not read compressed data", block);
+	}
+
+	if (jobs.size() > 1)
+		GlobalThreadPool::Loop(std::bind(&DecompressPPZJobs, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)jobs.size());
+	else if (!jobs.empty())
+		DecompressPPZJobs(&jobs[0], 0, 1);
+
+	bool result = true;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (!jobs[i].ok)
 		{
-			ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			inflateEnd(&z);
-			return 1;
+			const u32 block = (u32)(jobs[i].entry - &index[0]);
+			ERROR_LOG(LOADER, "PPZ block %d is corrupt", block);
+			// Don't keep the garbage around, but give back zeros for now.
+			memset(jobs[i].dest, 0, (u32)header.blockSize);
+			FindSlot(block)->lastUse = 0;
+			FindSlot(block)->block = (u32)-1;
+			result = false;
 		}
-		int cmp_size = blockSize - z.avail_out;
-		if (cmp_size != (int)blockSize)
+	}
+	return result;
+}
+
+bool PPZFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool PPZFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	if (minBlock >= numSectors || (u32)count > numSectors - minBlock)
+	{
+		const int valid = minBlock >= numSectors ? 0 : (int)(numSectors - minBlock);
+		memset(outPtr + valid * 2048, 0, (count - valid) * 2048);
+		if (valid > 0)
+			ReadBlocks(minBlock, valid, outPtr);
+		return false;
+	}
+
+	bool result = true;
+	while (count > 0)
+	{
+		// Decompress as many as we can keep at once, in parallel.
+		const u32 first = minBlock / sectorsPerBlock;
+		const u32 last = std::min((minBlock + count - 1) / sectorsPerBlock, first + (u32)slots.size() - 1);
+		if (!LoadBlocks(first, last - first + 1))
+			result = false;
+
+		for (u32 block = first; block <= last; ++block)
 		{
-			ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, blockSize);
-			inflateEnd(&z);
-			return false;
+			const u32 offset = minBlock - block * sectorsPerBlock;
+			const int n = std::min(count, (int)(sectorsPerBlock - offset));
+			CacheSlot *slot = FindSlot(block);
+			if (slot)
+				memcpy(outPtr, &slot->data[offset * 2048], n * 2048);
+			else
+				memset(outPtr, 0, n * 2048);
+
+			minBlock += n;
+			outPtr += n * 2048;
+			count -= n;
 		}
-		inflateEnd(&z);
 	}
-	return true;
+	return result;
 }
 
 
 NPDRMDemoBlockDevice::NPDRMDemoBlockDevice(FILE *file)
-	: f(file)
+	: f(file), cacheTick(0), nextSequentialBlock(0), sequentialBlocks(0),
+	  readAheadRunning(false), readAheadStart(0), readAheadCount(0), readAheadEnd(0)
 {
 	MAC_KEY mkey;
 	CIPHER_KEY ckey;
@@ -260,9 +789,6 @@ NPDRMDemoBlockDevice::NPDRMDemoBlockDevice(FILE *file)
 	blockSize = blockLBAs*2048;
 	numBlocks = (lbaSize+blockLBAs-1)/blockLBAs; // total blocks;
 
-	blockBuf = new u8[blockSize];
-	tempBuf  = new u8[blockSize];
-
 	tableOffset = *(u32*)(np_header+0x6c); // table offset
 	fseek(f, psarOffset+tableOffset, SEEK_SET);
 
@@ -288,78 +814,270 @@ NPDRMDemoBlockDevice::NPDRMDemoBlockDevice(FILE *file)
 		p += 8;
 	}
 
-	currentBlock = -1;
-
+	slots.resize(NPDRM_CACHE_SLOTS);
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		slots[i].block = (u32)-1;
+		slots[i].lastUse = 0;
+		slots[i].readAhead = false;
+	}
 }
 
 NPDRMDemoBlockDevice::~NPDRMDemoBlockDevice()
 {
+	readAhead.Wait();
 	fclose(f);
 	delete [] table;
-	delete [] tempBuf;
-	delete [] blockBuf;
 }
 
 int lzrc_decompress(void *out, int out_len, void *in, int in_len);
 
-bool NPDRMDemoBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+void NPDRMDemoBlockDevice::DecryptJobs(DecryptJob *jobs, int l, int u)
 {
-	CIPHER_KEY ckey;
-	int block, lba, lzsize;
-	size_t readSize;
-	u8 *readBuf;
+	for (int i = l; i < u; ++i)
+	{
+		DecryptJob &job = jobs[i];
+		const table_info &info = table[job.block];
+		if (!job.ok)
+			continue;
 
-	lba = blockNumber-currentBlock;
-	if(lba>=0 && lba<blockLBAs){
-		memcpy(outPtr, blockBuf+lba*2048, 2048);
-		return true;
+		if ((info.flag&1)==0){
+			// skip mac check
+		}
+
+		if ((info.flag&4)==0){
+			CIPHER_KEY ckey;
+			sceDrmBBCipherInit(&ckey, 1, 2, hkey, vkey, info.offset>>4);
+			sceDrmBBCipherUpdate(&ckey, &job.data[0], info.size);
+			sceDrmBBCipherFinal(&ckey);
+		}
+
+		if (info.size < blockSize){
+			std::vector<u8> compressed;
+			compressed.swap(job.data);
+			job.data.resize(blockSize);
+			int lzsize = lzrc_decompress(&job.data[0], blockSize, &compressed[0], info.size);
+			if (lzsize != blockSize){
+				ERROR_LOG(LOADER, "LZRC decompress error! lzsize=%d\n", lzsize);
+				job.ok = false;
+			}
+		}
 	}
+}
 
-	block = blockNumber/blockLBAs;
-	lba = blockNumber%blockLBAs;
-	currentBlock = block*blockLBAs;
+bool NPDRMDemoBlockDevice::DecryptBlocks(std::vector<DecryptJob> &jobs)
+{
+	{
+		// Read-ahead shares the file with us.
+		std::lock_guard<std::recursive_mutex> guard(fileLock);
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			DecryptJob &job = jobs[i];
+			const table_info &info = table[job.block];
+			job.ok = false;
+			if (info.unk_1c != 0 || info.size <= 0 || info.size > blockSize)
+				continue;
 
-	if(table[block].unk_1c!=0){
-		if(block==(numBlocks-1))
-			return true; // demos make by fake_np
-		else
-			return false;
+			job.data.resize(info.size);
+			fseek(f, psarOffset+info.offset, SEEK_SET);
+			job.ok = fread(&job.data[0], 1, info.size, f) == (size_t)info.size;
+		}
 	}
 
-	fseek(f, psarOffset+table[block].offset, SEEK_SET);
+	if (jobs.size() > 1)
+		GlobalThreadPool::Loop(std::bind(&NPDRMDemoBlockDevice::DecryptJobs, this, &jobs[0], std::placeholders::_1, std::placeholders::_2), 0, (int)jobs.size());
+	else if (!jobs.empty())
+		DecryptJobs(&jobs[0], 0, 1);
 
-	if(table[block].size<blockSize)
-		readBuf = tempBuf;
-	else
-		readBuf = blockBuf;
+	bool result = true;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		// What couldn't be read or decrypted reads as zeros.
+		if (!jobs[i].ok)
+		{
+			// Demos made by fake_np have a bad last block.
+			if (jobs[i].block != numBlocks - 1)
+				result = false;
+			jobs[i].data.assign(blockSize, 0);
+		}
+	}
+	return result;
+}
 
-	readSize = fread(readBuf, 1, table[block].size, f);
-	if(readSize != (size_t)table[block].size){
-		if(block==(numBlocks-1))
-			return true;
-		else
-			return false;
+NPDRMDemoBlockDevice::CacheSlot *NPDRMDemoBlockDevice::FindSlot(u32 block)
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].block == block)
+			return &slots[i];
 	}
+	return 0;
+}
 
-	if((table[block].flag&1)==0){
-		// skip mac check
+void NPDRMDemoBlockDevice::AddToCache(u32 block, std::vector<u8> &data, bool readAhead)
+{
+	CacheSlot *slot = FindSlot(block);
+	if (!slot)
+	{
+		slot = &slots[0];
+		for (size_t i = 1; i < slots.size(); ++i)
+		{
+			if (slots[i].lastUse < slot->lastUse)
+				slot = &slots[i];
+		}
 	}
+	slot->block = block;
+	slot->lastUse = ++cacheTick;
+	slot->readAhead = readAhead;
+	slot->data.swap(data);
+}
+
+bool NPDRMDemoBlockDevice::ReadBlock(int blockNumber, u8 *outPtr)
+{
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool NPDRMDemoBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+
+	WaitForReadAhead(minBlock / blockLBAs, (minBlock + count - 1) / blockLBAs);
+
+	// Copy out what's cached, and collect the table blocks we still need.
+	std::vector<DecryptJob> jobs;
+	std::vector<u32> jobSectors;
+	std::vector<u8 *> jobOut;
+	{
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		u32 sector = minBlock;
+		u8 *out = outPtr;
+		int left = count;
+		while (left > 0)
+		{
+			const u32 block = sector / blockLBAs;
+			const int lba = sector % blockLBAs;
+			const int n = std::min(left, blockLBAs - lba);
 
-	if((table[block].flag&4)==0){
-		sceDrmBBCipherInit(&ckey, 1, 2, hkey, vkey, table[block].offset>>4);
-		sceDrmBBCipherUpdate(&ckey, readBuf, table[block].size);
-		sceDrmBBCipherFinal(&ckey);
+			CacheSlot *slot = FindSlot(block);
+			if (slot)
+			{
+				memcpy(out, &slot->data[lba * 2048], n * 2048);
+				slot->lastUse = ++cacheTick;
+				blockDeviceStats.cacheHits += n;
+				if (slot->readAhead)
+				{
+					blockDeviceStats.readAheadHits += blockLBAs;
+					slot->readAhead = false;
+				}
+			}
+			else
+			{
+				jobs.push_back(DecryptJob());
+				jobs.back().block = block;
+				jobSectors.push_back(sector);
+				jobOut.push_back(out);
+				blockDeviceStats.cacheMisses += n;
+			}
+
+			sector += n;
+			out += n * 2048;
+			left -= n;
+		}
 	}
 
-	if(table[block].size<blockSize){
-		lzsize = lzrc_decompress(blockBuf, 0x00100000, readBuf, table[block].size);
-		if(lzsize!=blockSize){
-			ERROR_LOG(LOADER, "LZRC decompress error! lzsize=%d\n", lzsize);
-			return false;
+	bool result = true;
+	if (!jobs.empty())
+	{
+		result = DecryptBlocks(jobs);
+
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		const u32 endSector = minBlock + count;
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			const int lba = jobSectors[i] % blockLBAs;
+			const int n = std::min((int)(endSector - jobSectors[i]), blockLBAs - lba);
+			memcpy(jobOut[i], &jobs[i].data[lba * 2048], n * 2048);
+			if (jobs[i].ok)
+				AddToCache(jobs[i].block, jobs[i].data, false);
 		}
 	}
 
-	memcpy(outPtr, blockBuf+lba*2048, 2048);
+	// Afterwards, so that it doesn't compete with this read.
+	CheckReadAhead(minBlock, count);
+	return result;
+}
 
-	return true;
+void NPDRMDemoBlockDevice::WaitForReadAhead(u32 firstBlock, u32 lastBlock)
+{
+	{
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		if (!readAheadRunning || lastBlock < readAheadStart || firstBlock >= readAheadStart + readAheadCount)
+			return;
+	}
+
+	// It's already decrypting some of these, better to wait than to do it twice.
+	// Only the reading thread starts the read-ahead, so this can't race with CheckReadAhead().
+	readAhead.Wait();
+}
+
+void NPDRMDemoBlockDevice::CheckReadAhead(u32 minBlock, int count)
+{
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	if (minBlock == nextSequentialBlock)
+		sequentialBlocks += count;
+	else
+	{
+		sequentialBlocks = count;
+		readAheadEnd = 0;
+	}
+	nextSequentialBlock = minBlock + count;
+
+	// Only streaming gets read-ahead, and only one at a time.
+	if (sequentialBlocks < SEQUENTIAL_THRESHOLD_BLOCKS || readAheadRunning)
+		return;
+	const u32 nextTableBlock = nextSequentialBlock / blockLBAs;
+	if (readAheadEnd >= nextTableBlock + NPDRM_READAHEAD_BLOCKS / 2)
+		return;
+
+	const u32 start = std::max(nextTableBlock, readAheadEnd);
+	const u32 end = std::min(nextTableBlock + NPDRM_READAHEAD_BLOCKS, numBlocks);
+	if (start >= end)
+		return;
+
+	// The last one cleared readAheadRunning as its last step, so it's done with us.
+	readAheadStart = start;
+	readAheadCount = end - start;
+	readAheadEnd = end;
+	readAheadRunning = true;
+	readAhead = TaskScheduler::Submit(std::bind(&NPDRMDemoBlockDevice::ReadAheadTask, this));
+}
+
+void NPDRMDemoBlockDevice::ReadAheadTask()
+{
+	std::vector<DecryptJob> jobs;
+	{
+		std::lock_guard<std::recursive_mutex> guard(cacheLock);
+		for (u32 block = readAheadStart; block < readAheadStart + readAheadCount; ++block)
+		{
+			if (FindSlot(block))
+				continue;
+			jobs.push_back(DecryptJob());
+			jobs.back().block = block;
+		}
+	}
+
+	DecryptBlocks(jobs);
+
+	std::lock_guard<std::recursive_mutex> guard(cacheLock);
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		// Don't overwrite (and reset the use of) what was read in the meantime.
+		if (jobs[i].ok && !FindSlot(jobs[i].block))
+		{
+			AddToCache(jobs[i].block, jobs[i].data, true);
+			blockDeviceStats.readAheadBlocks += blockLBAs;
+		}
+	}
+	readAheadRunning = false;
 }
@@ -23,47 +23,158 @@
 // The ISOFileSystemReader reads from a BlockDevice, so it automatically works
 // with CISO images.
 
+#include <map>
+#include <vector>
+
 #include "../../Globals.h"
+#include "Common/StdMutex.h"
+#include "Common/StdThread.h"
+#include "Common/TaskScheduler.h"
 #include "Core/ELF/PBPReader.h"
+#include "Core/FileSystems/PPZImage.h"
+
+struct BlockDeviceStats
+{
+	u32 cacheHits;
+	u32 cacheMisses;
+	// Blocks decompressed ahead of time, and how many of those were later used.
+	u32 readAheadBlocks;
+	u32 readAheadHits;
+	// ISOFileSystem's prefetching of sequentially read files.
+	u32 prefetchHits;
+	u32 prefetchMisses;
+};
+
+extern BlockDeviceStats blockDeviceStats;
 
 class BlockDevice
 {
 public:
 	virtual ~BlockDevice() {}
 	virtual bool ReadBlock(int blockNumber, u8 *outPtr) = 0;
+	// Reads count consecutive blocks into outPtr.  Override when this can be done faster than block by block.
+	virtual bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
+	// If the blocks can be read in place (e.g. memory mapped), returns a pointer to them, otherwise NULL.
+	// Only valid until the next call on this device.
+	virtual const u8 *MappedBlocks(u32 minBlock, int count) { return 0; }
+	// Whether MappedBlocks can succeed.  Unlike MappedBlocks, doesn't count as an access.
+	virtual bool IsMapped() const { return false; }
 	int GetBlockSize() const { return 2048;}  // forced, it cannot be changed by subclasses
 	virtual u32 GetNumBlocks() = 0;
 };
 
 
+// Decompressed blocks are kept in an LRU cache, and sequential reads trigger
+// decompressing the following blocks in a task on the TaskScheduler.
 class CISOFileBlockDevice : public BlockDevice
 {
 public:
 	CISOFileBlockDevice(FILE *file);
 	~CISOFileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	u32 GetNumBlocks() { return numBlocks;}
 
 private:
+	struct CachedBlock
+	{
+		u8 data[2048];
+		u32 lastUse;
+		bool readAhead;
+	};
+	typedef std::map<u32, CachedBlock> BlockCache;
+
+	bool ReadUncached(u32 minBlock, int count, u8 *outPtr);
+	bool ReadFromCache(u32 blockNumber, u8 *outPtr);
+	void AddToCache(u32 blockNumber, const u8 *data, bool readAhead);
+	void DecimateCache();
+	void CheckReadAhead(u32 minBlock, int count);
+	void ReadAheadTask();
+
 	FILE *f;
 	u32 *index;
 	int indexShift;
 	u32 blockSize;
 	u32 numBlocks;
+
+	// Guards f, which the read-ahead task also uses.
+	std::recursive_mutex fileLock;
+	// Guards everything below.
+	std::recursive_mutex cacheLock;
+	BlockCache cache;
+	u32 cacheTick;
+
+	u32 nextSequentialBlock;
+	u32 sequentialBlocks;
+	TaskHandle readAhead;
+	bool readAheadRunning;
+	// The blocks the running read-ahead is working on.
+	u32 readAheadStart;
+	u32 readAheadCount;
+	// Where the next read-ahead should start, when the reader gets close enough.
+	u32 readAheadEnd;
+};
+
+
+// PPZ images (see PPZImage.h.)  A few decompressed blocks are kept, since each holds many sectors.
+class PPZFileBlockDevice : public BlockDevice
+{
+public:
+	PPZFileBlockDevice(FILE *file);
+	~PPZFileBlockDevice();
+	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
+	u32 GetNumBlocks() { return numSectors; }
+
+private:
+	struct CacheSlot
+	{
+		u32 block;
+		u32 lastUse;
+		std::vector<u8> data;
+	};
+
+	bool LoadBlocks(u32 first, u32 count);
+	CacheSlot *FindSlot(u32 block);
+
+	FILE *f;
+	PPZ::Header header;
+	std::vector<PPZ::IndexEntry> index;
+	u32 numSectors;
+	u32 sectorsPerBlock;
+
+	std::vector<CacheSlot> slots;
+	u32 cacheTick;
 };
 
 
+// Uncompressed images.  Where possible (and enabled), the whole file is memory mapped,
+// so reads are just a memcpy and no FILE buffering is involved.
 class FileBlockDevice : public BlockDevice
 {
 public:
-	FileBlockDevice(FILE *file);
+	FileBlockDevice(FILE *file, bool allowMap = false);
 	~FileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
+	const u8 *MappedBlocks(u32 minBlock, int count);
 	u32 GetNumBlocks() {return (u32)(filesize / GetBlockSize());}
 
+	bool IsMapped() const { return mapped != 0; }
+
 private:
+	void Map();
+	void Unmap();
+	void AdviseAccess(u32 minBlock, int count);
+
 	FILE *f;
 	size_t filesize;
+
+	u8 *mapped;
+	// Used to detect sequential access for read-ahead hints.
+	u32 nextSequentialBlock;
+	u32 sequentialBlocks;
+	u32 adviseAheadBlock;
 };
 
 
@@ -77,6 +188,9 @@ struct table_info {
 	int unk_1c;
 };
 
+// Decrypted blocks are kept in a small LRU cache, since games often read from a few places
+// in turn (audio and video streams, say.)  Blocks are decrypted in parallel, and sequential
+// reads trigger decrypting the following blocks in a task on the TaskScheduler.
 class NPDRMDemoBlockDevice : public BlockDevice
 {
 public:
@@ -84,9 +198,35 @@ public:
 	~NPDRMDemoBlockDevice();
 
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	u32 GetNumBlocks() {return (u32)lbaSize;}
 
 private:
+	struct DecryptJob
+	{
+		u32 block;
+		// Read encrypted, then decrypted in place or replaced with the decompressed block.
+		std::vector<u8> data;
+		bool ok;
+	};
+
+	struct CacheSlot
+	{
+		u32 block;
+		u32 lastUse;
+		bool readAhead;
+		std::vector<u8> data;
+	};
+
+	// Reads and decrypts the blocks of the jobs, returns false if any failed.
+	bool DecryptBlocks(std::vector<DecryptJob> &jobs);
+	void DecryptJobs(DecryptJob *jobs, int l, int u);
+	CacheSlot *FindSlot(u32 block);
+	void AddToCache(u32 block, std::vector<u8> &data, bool readAhead);
+	void CheckReadAhead(u32 minBlock, int count);
+	void WaitForReadAhead(u32 firstBlock, u32 lastBlock);
+	void ReadAheadTask();
+
 	FILE *f;
 	u32 lbaSize;
 
@@ -99,9 +239,22 @@ private:
 	u8 hkey[16];
 	struct table_info *table;
 
-	int currentBlock;
-	u8 *blockBuf;
-	u8 *tempBuf;
+	// Guards f, which the read-ahead task also uses.
+	std::recursive_mutex fileLock;
+	// Guards everything below.
+	std::recursive_mutex cacheLock;
+	std::vector<CacheSlot> slots;
+	u32 cacheTick;
+
+	u32 nextSequentialBlock;
+	u32 sequentialBlocks;
+	TaskHandle readAhead;
+	bool readAheadRunning;
+	// The table blocks the running read-ahead is working on.
+	u32 readAheadStart;
+	u32 readAheadCount;
+	// Where the next read-ahead should start, when the reader gets close enough.
+	u32 readAheadEnd;
 };
 
 
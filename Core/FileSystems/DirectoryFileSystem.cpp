@@ -17,6 +17,7 @@
 
 #include "ChunkFile.h"
 #include "FileUtil.h"
+#include "StdMutex.h"
 #include "DirectoryFileSystem.h"
 #include "ISOFileSystem.h"
 #include "Core/HLE/sceKernel.h"
@@ -34,52 +35,110 @@
 #endif
 
 #if HOST_IS_CASE_SENSITIVE
-static bool FixFilenameCase(const std::string &path, std::string &filename)
+namespace
 {
-	// Are we lucky?
-	if (File::Exists(path + filename))
-		return true;
-
-	size_t filenameSize = filename.size();  // size in bytes, not characters
-	for (size_t i = 0; i < filenameSize; i++)
+	// A directory listing, by lowercase name.  Names can differ only in case, so there may be several.
+	struct PathCaseDir
 	{
-		filename[i] = tolower(filename[i]);
-	}
+		time_t mtime;
+		time_t scanTime;
+		std::multimap<std::string, std::string> names;
+	};
+}
 
-	//TODO: lookup filename in cache for "path"
+typedef std::map<std::string, PathCaseDir> PathCaseCache;
+static PathCaseCache pathCaseCache;
+static std::recursive_mutex pathCaseLock;
+// Plenty for a game's save directories, this is only to keep it from growing forever.
+static const size_t MAX_PATH_CASE_DIRS = 256;
 
+static std::string LowerFilename(const std::string &filename)
+{
+	std::string lower = filename;
+	for (size_t i = 0; i < lower.size(); i++)
+		lower[i] = tolower(lower[i]);
+	return lower;
+}
+
+static bool ScanPathCaseDir(const std::string &path, PathCaseDir &dir)
+{
 	struct dirent_large { struct dirent entry; char padding[FILENAME_MAX+1]; } diren;
-	struct dirent_large;
 	struct dirent *result = NULL;
 
 	DIR *dirp = opendir(path.c_str());
 	if (!dirp)
 		return false;
 
-	bool retValue = false;
-
+	dir.names.clear();
 	while (!readdir_r(dirp, (dirent*) &diren, &result) && result)
 	{
-		if (strlen(result->d_name) != filenameSize)
-			continue;
+		dir.names.insert(std::make_pair(LowerFilename(result->d_name), std::string(result->d_name)));
+	}
 
-		size_t i;
-		for (i = 0; i < filenameSize; i++)
+	closedir(dirp);
+	return true;
+}
+
+static bool FixFilenameCase(const std::string &path, std::string &filename)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+
+	std::lock_guard<std::recursive_mutex> guard(pathCaseLock);
+	PathCaseCache::iterator it = pathCaseCache.find(path);
+
+	// A change in the same second as the scan wouldn't change mtime, so that's not trusted yet.
+	if (it == pathCaseCache.end() || it->second.mtime != st.st_mtime || it->second.mtime >= it->second.scanTime)
+	{
+		if (it == pathCaseCache.end() && pathCaseCache.size() >= MAX_PATH_CASE_DIRS)
+			pathCaseCache.clear();
+
+		PathCaseDir &dir = pathCaseCache[path];
+		dir.mtime = st.st_mtime;
+		dir.scanTime = time(NULL);
+		if (!ScanPathCaseDir(path, dir))
 		{
-			if (filename[i] != tolower(result->d_name[i]))
-				break;
+			pathCaseCache.erase(path);
+			return false;
 		}
+		it = pathCaseCache.find(path);
+	}
 
-		if (i < filenameSize)
-			continue;
+	typedef std::multimap<std::string, std::string>::const_iterator NameIterator;
+	std::pair<NameIterator, NameIterator> range = it->second.names.equal_range(LowerFilename(filename));
+	if (range.first == range.second)
+		return false;
 
-		filename = result->d_name;
-		retValue = true;
+	// Are we lucky?
+	for (NameIterator name = range.first; name != range.second; ++name)
+	{
+		if (name->second == filename)
+			return true;
 	}
 
-	closedir(dirp);
+	filename = range.first->second;
+	return true;
+}
 
-	return retValue;
+void InvalidatePathCase(const std::string &fullPath)
+{
+	std::string path = fullPath;
+	if (path.empty() || path[path.size() - 1] != '/')
+		path.append(1, '/');
+
+	std::lock_guard<std::recursive_mutex> guard(pathCaseLock);
+	for (PathCaseCache::iterator it = pathCaseCache.begin(); it != pathCaseCache.end(); )
+	{
+		const std::string &dirPath = it->first;
+		// Its parent directories (for new ones) and itself or anything under it (for removed ones.)
+		bool isParent = path.compare(0, dirPath.size(), dirPath) == 0;
+		bool isChild = dirPath.compare(0, path.size(), path) == 0;
+		if (isParent || isChild)
+			pathCaseCache.erase(it++);
+		else
+			++it;
+	}
 }
 
 bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior)
@@ -237,6 +296,10 @@ bool DirectoryFileHandle::Open(std::string& basePath, std::string& fileName, Fil
 		success = hFile != 0;
 #endif
 	}
+
+	// Might have created it.
+	if (success && (access & (FILEACCESS_APPEND|FILEACCESS_CREATE|FILEACCESS_WRITE)))
+		InvalidatePathCase(fullName);
 #endif
 
 	return success;
@@ -334,7 +397,9 @@ bool DirectoryFileSystem::MkDir(const std::string &dirname) {
 	if ( ! FixPathCase(basePath,fixedCase, FPC_PARTIAL_ALLOWED) )
 		return false;
 
-	return File::CreateFullPath(GetLocalPath(fixedCase));
+	bool result = File::CreateFullPath(GetLocalPath(fixedCase));
+	InvalidatePathCase(GetLocalPath(fixedCase));
+	return result;
 #else
 	return File::CreateFullPath(GetLocalPath(dirname));
 #endif
@@ -346,7 +411,10 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 #if HOST_IS_CASE_SENSITIVE
 	// Maybe we're lucky?
 	if (File::DeleteDirRecursively(fullName))
+	{
+		InvalidatePathCase(fullName);
 		return true;
+	}
 
 	// Nope, fix case and try again
 	fullName = dirname;
@@ -361,7 +429,11 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 #else
 	return 0 == rmdir(fullName.c_str());
 #endif*/
-	return File::DeleteDirRecursively(fullName);
+	bool result = File::DeleteDirRecursively(fullName);
+#if HOST_IS_CASE_SENSITIVE
+	InvalidatePathCase(fullName);
+#endif
+	return result;
 }
 
 int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &to) {
@@ -413,6 +485,12 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 		retValue = (0 == rename(fullFrom.c_str(), fullToC));
 #endif
 	}
+
+	if (retValue)
+	{
+		InvalidatePathCase(fullFrom);
+		InvalidatePathCase(fullTo);
+	}
 #endif
 
 	// TODO: Better error codes.
@@ -442,6 +520,9 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 		retValue = (0 == unlink(fullName.c_str()));
 #endif
 	}
+
+	if (retValue)
+		InvalidatePathCase(fullName);
 #endif
 
 	return retValue;
@@ -546,16 +627,17 @@ PSPFileInfo DirectoryFileSystem::GetFileInfo(std::string filename) {
 	x.type = File::IsDirectory(fullName) ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
 	x.exists = true;
 
+	// Directories have times too, the savedata index checks them.
+	struct stat s;
+	stat(fullName.c_str(), &s);
+	localtime_r((time_t*)&s.st_atime,&x.atime);
+	localtime_r((time_t*)&s.st_ctime,&x.ctime);
+	localtime_r((time_t*)&s.st_mtime,&x.mtime);
+
 	if (x.type != FILETYPE_DIRECTORY)
 	{
-		struct stat s;
-		stat(fullName.c_str(), &s);
-
 		x.size = File::GetSize(fullName);
 		x.access = s.st_mode & 0x1FF;
-		localtime_r((time_t*)&s.st_atime,&x.atime);
-		localtime_r((time_t*)&s.st_ctime,&x.ctime);
-		localtime_r((time_t*)&s.st_mtime,&x.mtime);
 	}
 
 	return x;
@@ -55,6 +55,8 @@ enum FixPathCaseBehavior {
 };
 
 bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior);
+// FixPathCase caches directory listings.  Call after changing fullPath, forgets its directory and anything under it.
+void InvalidatePathCase(const std::string &fullPath);
 #endif
 
 struct DirectoryFileHandle
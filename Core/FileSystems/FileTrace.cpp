@@ -0,0 +1,296 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "base/timeutil.h"
+#include "Common/FileUtil.h"
+#include "Common/Log.h"
+#include "Common/StdMutex.h"
+#include "Common/StringUtils.h"
+#include "Core/CoreTiming.h"
+#include "Core/FileSystems/FileSystem.h"
+#include "Core/FileSystems/FileTrace.h"
+
+// Each line is:
+//   op handle offset size result emu_us host_us first_sector sector_count path
+// where emu_us is the emulated time in microseconds and host_us how long the op took.
+// The path is the rest of the line, and empty if the handle's open wasn't recorded.
+
+namespace FileTrace {
+
+// In FileTraceOp order.
+static const char *opNames[FILETRACE_OP_COUNT] = {
+	"open",
+	"close",
+	"read",
+	"write",
+	"seek",
+	"async_start",
+	"async_done",
+};
+
+static std::recursive_mutex traceLock;
+static volatile bool active = false;
+static FILE *traceFile = NULL;
+static std::map<u32, std::string> handlePaths;
+static std::map<IFileSystem *, std::pair<u32, u32> > pendingSectors;
+
+bool Start(const std::string &filename) {
+	std::lock_guard<std::recursive_mutex> guard(traceLock);
+	Stop();
+
+	traceFile = File::OpenCFile(filename, "w");
+	if (!traceFile) {
+		ERROR_LOG(FILESYS, "Unable to open file trace %s", filename.c_str());
+		return false;
+	}
+	fprintf(traceFile, "# PPSSPP file trace 1\n");
+	fprintf(traceFile, "# op handle offset size result emu_us host_us first_sector sector_count path\n");
+	INFO_LOG(FILESYS, "Recording file trace to %s", filename.c_str());
+	active = true;
+	return true;
+}
+
+void Stop() {
+	std::lock_guard<std::recursive_mutex> guard(traceLock);
+	active = false;
+	if (traceFile) {
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+	handlePaths.clear();
+	pendingSectors.clear();
+}
+
+bool IsActive() {
+	return active;
+}
+
+void Record(FileTraceEvent &event) {
+	std::lock_guard<std::recursive_mutex> guard(traceLock);
+	if (!active)
+		return;
+
+	event.emuUs = cyclesToUs(CoreTiming::GetTicks());
+	if (event.op == FILETRACE_OPEN) {
+		if (event.handle != 0)
+			handlePaths[event.handle] = event.path;
+	} else if (event.path.empty()) {
+		std::map<u32, std::string>::iterator it = handlePaths.find(event.handle);
+		if (it != handlePaths.end())
+			event.path = it->second;
+	}
+
+	fprintf(traceFile, "%s %u %lld %lld %lld %llu %.1f %u %u %s\n", opNames[event.op], event.handle,
+		(long long)event.offset, (long long)event.size, (long long)event.result, (unsigned long long)event.emuUs,
+		event.hostSeconds * 1000000.0, event.firstSector, event.sectorCount, event.path.c_str());
+
+	if (event.op == FILETRACE_CLOSE)
+		handlePaths.erase(event.handle);
+}
+
+void NoteSectors(IFileSystem *system, u32 firstSector, u32 sectorCount) {
+	std::lock_guard<std::recursive_mutex> guard(traceLock);
+	if (active)
+		pendingSectors[system] = std::make_pair(firstSector, sectorCount);
+}
+
+bool TakeSectors(IFileSystem *system, u32 &firstSector, u32 &sectorCount) {
+	std::lock_guard<std::recursive_mutex> guard(traceLock);
+	std::map<IFileSystem *, std::pair<u32, u32> >::iterator it = pendingSectors.find(system);
+	if (it == pendingSectors.end())
+		return false;
+	firstSector = it->second.first;
+	sectorCount = it->second.second;
+	pendingSectors.erase(it);
+	return true;
+}
+
+bool Load(const std::string &filename, std::vector<FileTraceEvent> &events) {
+	FILE *f = File::OpenCFile(filename, "r");
+	if (!f)
+		return false;
+
+	events.clear();
+	char line[2048];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineNumber++;
+		size_t len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = 0;
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		char opName[32];
+		long long offset, size, result;
+		unsigned long long emuUs;
+		double hostUs;
+		FileTraceEvent event;
+		int pathStart = 0;
+		if (sscanf(line, "%31s %u %lld %lld %lld %llu %lf %u %u %n", opName, &event.handle, &offset, &size, &result, &emuUs, &hostUs, &event.firstSector, &event.sectorCount, &pathStart) < 9) {
+			WARN_LOG(FILESYS, "Bad line %d in file trace %s", lineNumber, filename.c_str());
+			continue;
+		}
+
+		int op = 0;
+		while (op < FILETRACE_OP_COUNT && strcmp(opNames[op], opName) != 0)
+			op++;
+		if (op == FILETRACE_OP_COUNT) {
+			WARN_LOG(FILESYS, "Unknown op %s on line %d in file trace %s", opName, lineNumber, filename.c_str());
+			continue;
+		}
+
+		event.op = (FileTraceOp)op;
+		event.offset = offset;
+		event.size = size;
+		event.result = result;
+		event.emuUs = emuUs;
+		event.hostSeconds = hostUs / 1000000.0;
+		if (pathStart > 0)
+			event.path = line + pathStart;
+		events.push_back(event);
+	}
+	fclose(f);
+	return true;
+}
+
+void Replay(const std::vector<FileTraceEvent> &events, IFileSystem *fs, bool paced, FileTraceReplayStats &stats) {
+	memset(&stats, 0, sizeof(stats));
+
+	// Traced handles to ours, only for files that opened here.
+	std::map<u32, u32> handles;
+	std::vector<double> readTimes;
+	std::vector<u8> buffer;
+	const u64 firstEmuUs = events.empty() ? 0 : events[0].emuUs;
+	const double startTime = real_time_now();
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		const FileTraceEvent &event = events[i];
+		if (event.op == FILETRACE_ASYNC_START || event.op == FILETRACE_ASYNC_DONE)
+			continue;
+
+		if (paced) {
+			// Loading a state can move emulated time back.
+			const double due = event.emuUs > firstEmuUs ? (double)(event.emuUs - firstEmuUs) / 1000000.0 : 0.0;
+			const double wait = due - (real_time_now() - startTime);
+			if (wait > 0.001)
+				sleep_ms((int)(wait * 1000.0));
+		}
+
+		u32 handle = 0;
+		if (event.op != FILETRACE_OPEN) {
+			std::map<u32, u32>::iterator it = handles.find(event.handle);
+			if (it != handles.end())
+				handle = it->second;
+		}
+
+		double opStart = real_time_now();
+		switch (event.op) {
+		case FILETRACE_OPEN:
+			// Only the reads are of interest, and the disc can't be written anyway.
+			if (event.handle == 0 || (event.offset & (FILEACCESS_WRITE | FILEACCESS_APPEND | FILEACCESS_CREATE)) != 0) {
+				stats.skipped++;
+				continue;
+			}
+			handle = fs->OpenFile(event.path, FILEACCESS_READ);
+			if (handle == 0) {
+				stats.skipped++;
+				continue;
+			}
+			handles[event.handle] = handle;
+			break;
+
+		case FILETRACE_CLOSE:
+			if (handle == 0) {
+				stats.skipped++;
+				continue;
+			}
+			fs->CloseFile(handle);
+			handles.erase(event.handle);
+			break;
+
+		case FILETRACE_READ:
+			{
+				if (handle == 0 || event.size <= 0) {
+					stats.skipped++;
+					continue;
+				}
+				// Put back where the game was, in case an op in between wasn't replayed.
+				if ((s64)fs->SeekFile(handle, 0, FILEMOVE_CURRENT) != event.offset)
+					fs->SeekFile(handle, (s32)event.offset, FILEMOVE_BEGIN);
+				if (buffer.size() < (size_t)event.size)
+					buffer.resize((size_t)event.size);
+
+				opStart = real_time_now();
+				stats.bytesRead += fs->ReadFile(handle, &buffer[0], event.size);
+				readTimes.push_back(real_time_now() - opStart);
+				stats.tracedReadSeconds += event.hostSeconds;
+			}
+			break;
+
+		case FILETRACE_SEEK:
+			if (handle == 0) {
+				stats.skipped++;
+				continue;
+			}
+			fs->SeekFile(handle, (s32)event.offset, (FileMove)event.size);
+			break;
+
+		default:
+			stats.skipped++;
+			continue;
+		}
+
+		stats.ops[event.op]++;
+		stats.seconds[event.op] += real_time_now() - opStart;
+	}
+
+	for (std::map<u32, u32>::iterator it = handles.begin(); it != handles.end(); ++it)
+		fs->CloseFile(it->second);
+	stats.totalSeconds = real_time_now() - startTime;
+
+	if (!readTimes.empty()) {
+		std::sort(readTimes.begin(), readTimes.end());
+		stats.readMedianSeconds = readTimes[readTimes.size() / 2];
+		stats.readP99Seconds = readTimes[std::min(readTimes.size() - 1, readTimes.size() * 99 / 100)];
+		stats.readMaxSeconds = readTimes.back();
+	}
+}
+
+std::string GetReplayReport(const FileTraceReplayStats &stats) {
+	std::string report = StringFromFormat("File trace replay: %0.1f ms, %u events skipped\n", stats.totalSeconds * 1000.0, stats.skipped);
+	report += StringFromFormat("  %-8s %8s %12s\n", "Op", "Count", "Time");
+	for (int i = 0; i < FILETRACE_OP_COUNT; ++i) {
+		if (stats.ops[i] != 0)
+			report += StringFromFormat("  %-8s %8u %9.1f ms\n", opNames[i], stats.ops[i], stats.seconds[i] * 1000.0);
+	}
+
+	const double readSeconds = stats.seconds[FILETRACE_READ];
+	const double mbRead = (double)stats.bytesRead / (1024.0 * 1024.0);
+	report += StringFromFormat("Reads: %0.1f MB at %0.1f MB/s, median %0.3f ms, p99 %0.3f ms, max %0.3f ms\n",
+		mbRead, readSeconds > 0.0 ? mbRead / readSeconds : 0.0,
+		stats.readMedianSeconds * 1000.0, stats.readP99Seconds * 1000.0, stats.readMaxSeconds * 1000.0);
+	report += StringFromFormat("Recorded reads took %0.1f ms, replayed %0.1f ms\n", stats.tracedReadSeconds * 1000.0, readSeconds * 1000.0);
+	return report;
+}
+
+}  // namespace FileTrace
@@ -0,0 +1,104 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Common/CommonTypes.h"
+
+class IFileSystem;
+
+// Records the file IO a game does, so loading stutter can be reproduced and the block
+// devices and file systems benchmarked against real access patterns without the game.
+//
+// MetaFileSystem records opens, closes, reads, writes and seeks, sceIo records when async
+// operations are started and when their results are collected.  File systems on a block
+// device note the sectors each read covers.  Recording is off unless started, when
+// g_Config.sFileTraceFilename is set (headless --io-trace.)
+//
+// The trace is text, one event per line, see FileTrace.cpp for the columns.
+
+enum FileTraceOp {
+	FILETRACE_OPEN,
+	FILETRACE_CLOSE,
+	FILETRACE_READ,
+	FILETRACE_WRITE,
+	FILETRACE_SEEK,
+	// size is the emulated delay until the result is posted.
+	FILETRACE_ASYNC_START,
+	// hostSeconds is how long the emu thread waited on the IO thread for the result.
+	FILETRACE_ASYNC_DONE,
+
+	FILETRACE_OP_COUNT,
+};
+
+struct FileTraceEvent {
+	FileTraceEvent()
+		: op(FILETRACE_READ), handle(0), offset(0), size(0), result(0), emuUs(0), hostSeconds(0.0), firstSector(0), sectorCount(0) {}
+
+	FileTraceOp op;
+	u32 handle;
+	// The file position before the op.  For seeks, the requested position, for opens the access flags.
+	s64 offset;
+	// Bytes asked for.  For seeks, the FileMove type.
+	s64 size;
+	s64 result;
+	u64 emuUs;
+	double hostSeconds;
+	// The sectors of the block device the op covers, if on one.
+	u32 firstSector;
+	u32 sectorCount;
+	// With the mount prefix, like disc0:/PSP_GAME/USRDIR/DATA.BIN.
+	std::string path;
+};
+
+struct FileTraceReplayStats {
+	u32 ops[FILETRACE_OP_COUNT];
+	double seconds[FILETRACE_OP_COUNT];
+	// Events on files that aren't on the replayed file systems, and writes.
+	u32 skipped;
+	u64 bytesRead;
+	double totalSeconds;
+	// What the same reads took when recorded.
+	double tracedReadSeconds;
+	double readMedianSeconds;
+	double readP99Seconds;
+	double readMaxSeconds;
+};
+
+namespace FileTrace {
+	bool Start(const std::string &filename);
+	void Stop();
+	bool IsActive();
+
+	void Record(FileTraceEvent &event);
+
+	// For file systems on block devices, called during a read.  MetaFileSystem takes them
+	// afterwards, it holds the file system's lock so they can't get mixed up.
+	void NoteSectors(IFileSystem *system, u32 firstSector, u32 sectorCount);
+	bool TakeSectors(IFileSystem *system, u32 &firstSector, u32 &sectorCount);
+
+	bool Load(const std::string &filename, std::vector<FileTraceEvent> &events);
+
+	// Runs the reads of a trace against fs, which should have the disc mounted like a game
+	// would (umd0:, disc0: and so on.)  With paced, ops wait for their emulated time to come,
+	// which gives read-ahead the time it had in the game, otherwise they run back to back.
+	void Replay(const std::vector<FileTraceEvent> &events, IFileSystem *fs, bool paced, FileTraceReplayStats &stats);
+	std::string GetReplayReport(const FileTraceReplayStats &stats);
+}
@@ -17,6 +17,8 @@
 
 #include "Globals.h"
 #include "Common/Common.h"
+#include "Common/Hash.h"
+#include "Core/FileSystems/FileTrace.h"
 #include "Core/FileSystems/ISOFileSystem.h"
 #include "Core/Reporting.h"
 #include <cstring>
@@ -26,6 +28,13 @@
 
 const int sectorSize = 2048;
 
+// Sequential reads before a file is prefetched.
+static const int PREFETCH_SEQUENTIAL_READS = 2;
+// How much to read ahead, at least two reads' worth.  Larger reads don't get any.
+static const u32 PREFETCH_MIN_BYTES = 64 * 1024;
+static const u32 PREFETCH_MAX_BYTES = 512 * 1024;
+static const size_t PREFETCH_MAX_FILES = 8;
+
 bool parseLBN(std::string filename, u32 *sectorStart, u32 *readSize)
 {
 	// The format of this is: "/sce_lbn" "0x"? HEX* ANY* "_size" "0x"? HEX* ANY*
@@ -181,6 +190,9 @@ ISOFileSystem::ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevic
 
 	blockDevice = _blockDevice;
 	hAlloc = _hAlloc;
+	pathIndexCollisions = false;
+	prefetchRunning = false;
+	prefetchHandle = 0;
 
 	VolDescriptor desc;
 	blockDevice->ReadBlock(16, (u8*)&desc);
@@ -206,25 +218,96 @@ ISOFileSystem::ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevic
 	u32 rootSector = desc.root.firstDataSector();
 	u32 rootSize = desc.root.dataLength();
 
+	// Subdirectories are only read when first accessed.
 	ReadDirectory(rootSector, rootSize, treeroot, 0);
 }
 
 ISOFileSystem::~ISOFileSystem()
 {
+	WaitForPrefetch();
 	delete blockDevice;
 	delete treeroot;
 }
 
+static std::string ToLower(const std::string &str)
+{
+	std::string lower = str;
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = tolower(lower[i]);
+	return lower;
+}
+
+static u64 PathHash(const std::string &lowerPath)
+{
+	return GetMurmurHash3((const u8 *)lowerPath.c_str(), (int)lowerPath.size(), 0);
+}
+
+void ISOFileSystem::AddToIndex(const std::string &lowerPath, TreeEntry *e)
+{
+	std::pair<PathIndex::iterator, bool> result = pathIndex.insert(std::make_pair(PathHash(lowerPath), e));
+	if (!result.second && result.first->second != e)
+	{
+		WARN_LOG(FILESYS, "Path hash collision on %s, falling back to searching", lowerPath.c_str());
+		result.first->second = NULL;
+		pathIndexCollisions = true;
+	}
+}
+
+ISOFileSystem::TreeEntry *ISOFileSystem::FindInIndex(const std::string &lowerPath)
+{
+	PathIndex::iterator it = pathIndex.find(PathHash(lowerPath));
+	if (it == pathIndex.end() || it->second == NULL)
+		return NULL;
+
+	// Catch a wrong hit on a path that doesn't exist (all but impossible, but it's cheap.)
+	size_t slash = lowerPath.find_last_of('/');
+	const std::string lowerName = slash == lowerPath.npos ? lowerPath : lowerPath.substr(slash + 1);
+	if (ToLower(it->second->name) != lowerName)
+		return NULL;
+	return it->second;
+}
+
+ISOFileSystem::TreeEntry *ISOFileSystem::FindChild(TreeEntry *dir, const std::string &lowerName)
+{
+	for (size_t i = 0; i < dir->children.size(); ++i)
+	{
+		if (ToLower(dir->children[i]->name) == lowerName)
+			return dir->children[i];
+	}
+	return NULL;
+}
+
+void ISOFileSystem::EnsureDirectoryRead(TreeEntry *dir)
+{
+	if (dir->valid || !dir->isDirectory)
+		return;
+
+	size_t level = 0;
+	for (TreeEntry *cur = dir; cur != treeroot && cur != NULL; cur = cur->parent)
+		++level;
+	ReadDirectory(dir->startingPosition / 2048, (u32)dir->size, dir, level);
+}
+
 void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root, size_t level)
 {
+	std::lock_guard<std::recursive_mutex> guard(deviceLock);
+	root->valid = true;
+	const std::string lowerPrefix = root == treeroot ? "" : ToLower(EntryFullPath(root).substr(1)) + "/";
+
 	for (u32 secnum = startsector, endsector = dirsize/2048 + startsector; secnum < endsector; ++secnum)
 	{
-		u8 theSector[2048];
-		blockDevice->ReadBlock(secnum, theSector);
+		u8 sectorBuffer[2048];
+		// Parse in place if we can.
+		const u8 *theSector = blockDevice->MappedBlocks(secnum, 1);
+		if (!theSector)
+		{
+			blockDevice->ReadBlock(secnum, sectorBuffer);
+			theSector = sectorBuffer;
+		}
 
 		for (int offset = 0; offset < 2048; )
 		{
-			DirectoryEntry &dir = *(DirectoryEntry *)&theSector[offset];
+			const DirectoryEntry &dir = *(const DirectoryEntry *)&theSector[offset];
 			u8 sz = theSector[offset];
 
 			// Nothing left in this sector.  There might be more in the next one.
@@ -269,25 +352,23 @@ void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root,
 			// Let's not excessively spam the log - I commented this line out.
 			//DEBUG_LOG(FILESYS, "%s: %s %08x %08x %i", e->isDirectory?"D":"F", e->name.c_str(), dir.firstDataSectorLE, e->startingPosition, e->startingPosition);
 
+			// Relative entries don't get children, and neither do recursive ones.
+			e->valid = relative;
 			if (e->isDirectory && !relative)
 			{
 				if (dir.firstDataSector() == startsector)
 				{
 					ERROR_LOG(FILESYS, "WARNING: Appear to have a recursive file system, breaking recursion");
+					e->valid = true;
 				}
-				else
+				else if (!restrictTree.empty() && (level >= restrictTree.size() || restrictTree[level] != e->name))
 				{
-					bool doRecurse = true;
-					if (!restrictTree.empty())
-						doRecurse = level < restrictTree.size() && restrictTree[level] == e->name;
-
-					if (doRecurse)
-						ReadDirectory(dir.firstDataSector(), dir.dataLength(), e, level + 1);
-					else
-						continue;
+					delete e;
+					continue;
 				}
 			}
 			root->children.push_back(e);
+			AddToIndex(lowerPrefix + ToLower(e->name), e);
 		}
 	}
 }
@@ -309,55 +390,53 @@ ISOFileSystem::TreeEntry *ISOFileSystem::GetFromPath(std::string path, bool catc
 	if (path == "umd0")
 		return &entireISO;
 
-	TreeEntry *e = treeroot;
 	if (path.length() == 0)
+		return treeroot;
+
+	// Normalize to the form used in the index: lowercase, single slashes, none at the end.
+	std::string lowerPath;
+	lowerPath.reserve(path.size());
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		if (path[i] == '/' && (lowerPath.empty() || lowerPath[lowerPath.size() - 1] == '/'))
+			continue;
+		lowerPath.push_back(tolower(path[i]));
+	}
+	if (!lowerPath.empty() && lowerPath[lowerPath.size() - 1] == '/')
+		lowerPath.resize(lowerPath.size() - 1);
+	if (lowerPath.empty())
+		return treeroot;
+
+	TreeEntry *e = FindInIndex(lowerPath);
+	if (e)
 		return e;
 
+	// Not seen yet, so read the directories along the way.
+	e = treeroot;
+	size_t pos = 0;
 	while (true)
 	{
-		TreeEntry *ne = 0;
-		std::string name = "";
-		if (path.length()>0)
-		{
-			for (size_t i=0; i<e->children.size(); i++)
-			{
-				std::string n = (e->children[i]->name);
-				for (size_t j = 0; j < n.size(); j++) {
-					n[j] = tolower(n[j]);
-				}
-				std::string curPath = path.substr(0, path.find_first_of('/'));
-				for (size_t j = 0; j < curPath.size(); j++) {
-					curPath[j] = tolower(curPath[j]);
-				}
+		EnsureDirectoryRead(e);
 
-				if (curPath == n)
-				{
-					//yay we got it
-					ne = e->children[i];
-					name = n;
-					break;
-				}
-			}
-		}
-		if (ne)
-		{
-			e = ne;
-			size_t l = name.length();
-			path.erase(0, l);
-			if (path.length() == 0 || (path.length()==1 && path[0] == '/'))
-				return e;
-			path.erase(0, 1);
-			while (path[0] == '/')
-				path.erase(0, 1);
-		}
-		else
+		size_t end = lowerPath.find('/', pos);
+		const std::string prefix = lowerPath.substr(0, end);
+		TreeEntry *ne = FindInIndex(prefix);
+		if (!ne && pathIndexCollisions)
+			ne = FindChild(e, prefix.substr(pos));
+
+		if (!ne)
 		{
 			if (catchError)
 			{
-				ERROR_LOG(FILESYS,"File %s not found", path.c_str());
+				ERROR_LOG(FILESYS,"File %s not found", path.substr(pos).c_str());
 			}
 			return 0;
 		}
+
+		e = ne;
+		if (end == lowerPath.npos)
+			return e;
+		pos = end + 1;
 	}
 }
 
@@ -433,6 +512,9 @@ void ISOFileSystem::CloseFile(u32 handle)
 		//CloseHandle((*iter).second.hFile);
 		hAlloc->FreeHandle(handle);
 		entries.erase(iter);
+
+		std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+		prefetches.erase(handle);
 	}
 	else
 	{
@@ -447,6 +529,66 @@ bool ISOFileSystem::OwnsHandle(u32 handle)
 	return (iter != entries.end());
 }
 
+u32 ISOFileSystem::ReadBytes(u32 positionOnIso, s64 size, u8 *pointer)
+{
+	std::lock_guard<std::recursive_mutex> guard(deviceLock);
+	u32 totalRead = 0;
+	int secNum = positionOnIso / 2048;
+	int posInSector = positionOnIso & 2047;
+	s64 remain = size;		
+
+	// Mapped images can be copied from directly, no matter the alignment.
+	if (remain > 0)
+	{
+		const int sectorCount = (int)((posInSector + remain + 2047) / 2048);
+		const u8 *mappedData = blockDevice->MappedBlocks(secNum, sectorCount);
+		if (mappedData)
+		{
+			memcpy(pointer, mappedData + posInSector, (size_t)remain);
+			totalRead += (u32)remain;
+			remain = 0;
+		}
+	}
+
+	u8 theSector[2048];
+
+	// Partial first sector.
+	if (remain > 0 && posInSector != 0)
+	{
+		blockDevice->ReadBlock(secNum, theSector);
+		size_t bytesToCopy = 2048 - posInSector;
+		if ((s64)bytesToCopy > remain)
+			bytesToCopy = (size_t)remain;
+
+		memcpy(pointer, theSector + posInSector, bytesToCopy);
+		totalRead += (u32)bytesToCopy;
+		pointer += bytesToCopy;
+		remain -= bytesToCopy;
+		secNum++;
+	}
+
+	// Whole sectors go straight to the destination, in one request.
+	if (remain >= 2048)
+	{
+		int sectors = (int)(remain / 2048);
+		blockDevice->ReadBlocks(secNum, sectors, pointer);
+		totalRead += sectors * 2048;
+		pointer += sectors * 2048;
+		remain -= sectors * 2048;
+		secNum += sectors;
+	}
+
+	// Partial last sector.
+	if (remain > 0)
+	{
+		blockDevice->ReadBlock(secNum, theSector);
+		memcpy(pointer, theSector, (size_t)remain);
+		totalRead += (u32)remain;
+		remain = 0;
+	}
+	return totalRead;
+}
+
 size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
 	EntryMap::iterator iter = entries.find(handle);
@@ -457,11 +599,11 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 		if (e.isBlockSectorMode)
 		{
 			// Whole sectors! Shortcut to this simple code.
-			for (int i = 0; i < size; i++)
-			{
-				blockDevice->ReadBlock(e.seekPos, pointer + i * 2048);
-				e.seekPos++;
-			}
+			std::lock_guard<std::recursive_mutex> guard(deviceLock);
+			if (FileTrace::IsActive())
+				FileTrace::NoteSectors(this, e.seekPos, (u32)size);
+			blockDevice->ReadBlocks(e.seekPos, (int)size, pointer);
+			e.seekPos += (unsigned int)size;
 			return (size_t)size;
 		}
 
@@ -488,28 +630,16 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 			positionOnIso = e.file->startingPosition + e.seekPos;
 		}
 		//okay, we have size and position, let's rock
+		if (size > 0 && FileTrace::IsActive())
+			FileTrace::NoteSectors(this, positionOnIso / 2048, (u32)(((positionOnIso & 2047) + size + 2047) / 2048));
+		u32 totalRead;
+		if (size > 0 && ReadPrefetched(handle, e, positionOnIso, (u32)size, pointer))
+			totalRead = (u32)size;
+		else
+			totalRead = ReadBytes(positionOnIso, size, pointer);
 
-		u32 totalRead = 0;
-		int secNum = positionOnIso / 2048;
-		int posInSector = positionOnIso & 2047;
-		s64 remain = size;		
-
-		u8 theSector[2048];
-
-		while (remain > 0)
-		{
-			blockDevice->ReadBlock(secNum, theSector);
-			size_t bytesToCopy = 2048 - posInSector;
-			if ((s64)bytesToCopy > remain)
-				bytesToCopy = (size_t)remain;
-
-			memcpy(pointer, theSector + posInSector, bytesToCopy);
-			totalRead += (u32)bytesToCopy;
-			pointer += bytesToCopy;
-			remain -= bytesToCopy;
-			posInSector = 0;
-			secNum++;
-		}
+		if (size > 0)
+			CheckPrefetch(handle, e, positionOnIso, (u32)size);
 		e.seekPos += (unsigned int)size;
 		return totalRead;
 	}
@@ -521,6 +651,136 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 	}
 }
 
+bool ISOFileSystem::ReadPrefetched(u32 handle, OpenFileEntry &e, u32 positionOnIso, u32 size, u8 *pointer)
+{
+	const bool streaming = positionOnIso == e.nextSequentialPos && e.sequentialReads >= PREFETCH_SEQUENTIAL_READS;
+	bool covered = false;
+	bool ready = false;
+	{
+		std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+		PrefetchMap::iterator it = prefetches.find(handle);
+		if (it != prefetches.end())
+		{
+			const Prefetch &prefetch = it->second;
+			covered = positionOnIso >= prefetch.start && (u64)positionOnIso + size <= (u64)prefetch.start + prefetch.size;
+			ready = prefetch.ready;
+		}
+	}
+
+	if (!covered)
+	{
+		if (streaming)
+			blockDeviceStats.prefetchMisses++;
+		return false;
+	}
+
+	// Still reading it, but that's still sooner than starting over.
+	if (!ready)
+		WaitForPrefetch();
+
+	std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+	PrefetchMap::iterator it = prefetches.find(handle);
+	if (it == prefetches.end() || !it->second.ready)
+	{
+		blockDeviceStats.prefetchMisses++;
+		return false;
+	}
+
+	memcpy(pointer, &it->second.data[positionOnIso - it->second.start], size);
+	blockDeviceStats.prefetchHits++;
+	return true;
+}
+
+void ISOFileSystem::CheckPrefetch(u32 handle, OpenFileEntry &e, u32 positionOnIso, u32 size)
+{
+	if (positionOnIso == e.nextSequentialPos)
+		e.sequentialReads++;
+	else
+		e.sequentialReads = 1;
+	e.nextSequentialPos = positionOnIso + size;
+
+	if (e.sequentialReads < PREFETCH_SEQUENTIAL_READS || size > PREFETCH_MAX_BYTES / 2)
+		return;
+	// Nothing to gain if it's already in memory, the mapping's own readahead handles it.
+	if (blockDevice->IsMapped())
+		return;
+
+	const u64 fileEnd = e.isRawSector ? (u64)e.sectorStart * 2048 + e.openSize : (u64)e.file->startingPosition + e.file->size;
+	const u64 deviceEnd = (u64)blockDevice->GetNumBlocks() * blockDevice->GetBlockSize();
+	const u64 start = e.nextSequentialPos;
+	const u64 end = std::min(start + std::max(size * 2, PREFETCH_MIN_BYTES), std::min(fileEnd, deviceEnd));
+	if (start >= end)
+		return;
+
+	std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+	PrefetchMap::iterator it = prefetches.find(handle);
+	if (it != prefetches.end())
+	{
+		// Still have the next read, or it's on the way.
+		const Prefetch &prefetch = it->second;
+		if (start >= prefetch.start && start + size <= (u64)prefetch.start + prefetch.size)
+			return;
+	}
+	else if (prefetches.size() >= PREFETCH_MAX_FILES)
+		return;
+
+	// Only one at a time.  Streams are usually read a chunk per frame, so it'll keep up.
+	// The last one cleared prefetchRunning as its last step, so it's done with us.
+	if (prefetchRunning)
+		return;
+
+	Prefetch &prefetch = prefetches[handle];
+	prefetch.start = (u32)start;
+	prefetch.size = (u32)(end - start);
+	prefetch.ready = false;
+	prefetch.data.clear();
+
+	prefetchHandle = handle;
+	prefetchRunning = true;
+	prefetchTask = TaskScheduler::Submit(std::bind(&ISOFileSystem::PrefetchTask, this));
+}
+
+void ISOFileSystem::PrefetchTask()
+{
+	u32 handle, start, size;
+	{
+		std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+		handle = prefetchHandle;
+		PrefetchMap::iterator it = prefetches.find(handle);
+		if (it == prefetches.end())
+		{
+			prefetchRunning = false;
+			return;
+		}
+		start = it->second.start;
+		size = it->second.size;
+	}
+
+	std::vector<u8> data(size);
+	ReadBytes(start, size, &data[0]);
+
+	std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+	PrefetchMap::iterator it = prefetches.find(handle);
+	// The file may have been closed in the meantime.
+	if (it != prefetches.end() && it->second.start == start && it->second.size == size)
+	{
+		it->second.data.swap(data);
+		it->second.ready = true;
+	}
+	prefetchRunning = false;
+}
+
+void ISOFileSystem::WaitForPrefetch()
+{
+	// Reads may come from several IO threads, so take a copy to wait on.
+	TaskHandle task;
+	{
+		std::lock_guard<std::recursive_mutex> guard(prefetchLock);
+		task = prefetchTask;
+	}
+	task.Wait();
+}
+
 size_t ISOFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size) 
 {
 	ERROR_LOG(HLE,"Hey, what are you doing? You can't write to an ISO!");
@@ -603,6 +863,7 @@ std::vector<PSPFileInfo> ISOFileSystem::GetDirListing(std::string path)
 	{
 		return myVector;
 	}
+	EnsureDirectoryRead(entry);
 
 	for (size_t i=0; i<entry->children.size(); i++)
 	{
@@ -659,6 +920,8 @@ void ISOFileSystem::DoState(PointerWrap &p)
 
 	if (p.mode == p.MODE_READ)
 	{
+		WaitForPrefetch();
+		prefetches.clear();
 		entries.clear();
 		for (int i = 0; i < n; ++i)
 		{
@@ -20,6 +20,7 @@
 #include <map>
 #include <list>
 
+#include "Common/TaskScheduler.h"
 #include "FileSystem.h"
 
 #include "BlockDevices.h"
@@ -50,7 +51,7 @@ public:
 private:
 	struct TreeEntry
 	{
-		TreeEntry(){}
+		TreeEntry() : valid(false) {}
 		~TreeEntry()
 		{
 			for (size_t i = 0; i < children.size(); ++i)
@@ -63,6 +64,8 @@ private:
 		u32 startingPosition;
 		s64 size;
 		bool isDirectory;
+		// For directories, whether children has been read yet.  They're read on first access.
+		bool valid;
 
 		TreeEntry *parent;
 		std::vector<TreeEntry*> children;
@@ -70,12 +73,26 @@ private:
 
 	struct OpenFileEntry
 	{
+		OpenFileEntry() : nextSequentialPos(0), sequentialReads(0) {}
+
 		TreeEntry *file;
 		unsigned int seekPos;  // TODO: Make 64-bit?
 		bool isRawSector;   // "/sce_lbn" mode
 		bool isBlockSectorMode;  // "umd:" mode: all sizes and offsets are in 2048 byte chunks
 		u32 sectorStart;
 		u32 openSize;
+		// For detecting streaming, in bytes on the ISO.
+		u32 nextSequentialPos;
+		int sequentialReads;
+	};
+
+	// Data read ahead for a file being read sequentially.
+	struct Prefetch
+	{
+		u32 start;
+		u32 size;
+		bool ready;
+		std::vector<u8> data;
 	};
 	
 
@@ -87,10 +104,35 @@ private:
 
 	TreeEntry entireISO;
 
+	// Held while using blockDevice, since prefetching uses it from a task.
+	std::recursive_mutex deviceLock;
+	std::recursive_mutex prefetchLock;
+	typedef std::map<u32, Prefetch> PrefetchMap;
+	PrefetchMap prefetches;
+	TaskHandle prefetchTask;
+	bool prefetchRunning;
+	u32 prefetchHandle;
+
+	// Every entry read so far, by a hash of its lowercase path (without the leading slash.)
+	typedef std::map<u64, TreeEntry *> PathIndex;
+	PathIndex pathIndex;
+	// If two paths ever hash the same, neither is indexed and we have to search.
+	bool pathIndexCollisions;
+
 	// Don't use this in the emu, not savestated.
 	std::vector<std::string> restrictTree;
 
 	void ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root, size_t level);
+	void EnsureDirectoryRead(TreeEntry *dir);
+	void AddToIndex(const std::string &lowerPath, TreeEntry *e);
+	TreeEntry *FindInIndex(const std::string &lowerPath);
+	TreeEntry *FindChild(TreeEntry *dir, const std::string &lowerName);
 	TreeEntry *GetFromPath(std::string path, bool catchError=true);
+
+	u32 ReadBytes(u32 positionOnIso, s64 size, u8 *pointer);
+	bool ReadPrefetched(u32 handle, OpenFileEntry &e, u32 positionOnIso, u32 size, u8 *pointer);
+	void CheckPrefetch(u32 handle, OpenFileEntry &e, u32 positionOnIso, u32 size);
+	void PrefetchTask();
+	void WaitForPrefetch();
 	std::string EntryFullPath(TreeEntry *e);
 };
@@ -17,11 +17,28 @@
 
 #include <set>
 #include <algorithm>
+#include "base/timeutil.h"
 #include "Common/StringUtils.h"
+#include "Core/FileSystems/FileTrace.h"
 #include "Core/FileSystems/MetaFileSystem.h"
 #include "Core/HLE/sceKernelThread.h"
 #include "Core/Reporting.h"
 
+static void RecordTrace(FileTraceOp op, u32 handle, s64 offset, s64 size, s64 result, double startTime, IFileSystem *system, const std::string &path = "")
+{
+	FileTraceEvent event;
+	event.op = op;
+	event.handle = handle;
+	event.offset = offset;
+	event.size = size;
+	event.result = result;
+	event.hostSeconds = real_time_now() - startTime;
+	if (op == FILETRACE_READ)
+		FileTrace::TakeSectors(system, event.firstSector, event.sectorCount);
+	event.path = path;
+	FileTrace::Record(event);
+}
+
 static bool ApplyPathStringToComponentsVector(std::vector<std::string> &vector, const std::string &pathString)
 {
 	size_t len = pathString.length();
@@ -259,6 +276,12 @@ void MetaFileSystem::Shutdown()
 		delete *iter;
 	}
 
+	for (auto iter = systemLocks.begin(); iter != systemLocks.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	systemLocks.clear();
+
 	fileSystems.clear();
 	currentDir.clear();
 	startingDirectory = "";
@@ -280,7 +303,14 @@ u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access, const char
 	MountPoint *mount;
 	if (MapFilePath(filename, of, &mount))
 	{
-		return mount->system->OpenFile(of, access, mount->prefix.c_str());
+		lock_guard systemGuard(SystemLock(mount->system));
+		if (!FileTrace::IsActive())
+			return mount->system->OpenFile(of, access, mount->prefix.c_str());
+
+		const double startTime = real_time_now();
+		u32 handle = mount->system->OpenFile(of, access, mount->prefix.c_str());
+		RecordTrace(FILETRACE_OPEN, handle, access, 0, handle, startTime, mount->system, mount->prefix + of);
+		return handle;
 	}
 	else
 	{
@@ -295,6 +325,7 @@ PSPFileInfo MetaFileSystem::GetFileInfo(std::string filename)
 	IFileSystem *system;
 	if (MapFilePath(filename, of, &system))
 	{
+		lock_guard systemGuard(SystemLock(system));
 		return system->GetFileInfo(of);
 	}
 	else
@@ -310,6 +341,7 @@ bool MetaFileSystem::GetHostPath(const std::string &inpath, std::string &outpath
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(inpath, of, &system)) {
+		lock_guard systemGuard(SystemLock(system));
 		return system->GetHostPath(of, outpath);
 	} else {
 		return false;
@@ -323,6 +355,7 @@ std::vector<PSPFileInfo> MetaFileSystem::GetDirListing(std::string path)
 	IFileSystem *system;
 	if (MapFilePath(path, of, &system))
 	{
+		lock_guard systemGuard(SystemLock(system));
 		return system->GetDirListing(of);
 	}
 	else
@@ -380,6 +413,7 @@ bool MetaFileSystem::MkDir(const std::string &dirname)
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
 	{
+		lock_guard systemGuard(SystemLock(system));
 		return system->MkDir(of);
 	}
 	else
@@ -395,6 +429,7 @@ bool MetaFileSystem::RmDir(const std::string &dirname)
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
 	{
+		lock_guard systemGuard(SystemLock(system));
 		return system->RmDir(of);
 	}
 	else
@@ -427,6 +462,7 @@ int MetaFileSystem::RenameFile(const std::string &from, const std::string &to)
 		if (osystem != rsystem)
 			return SCE_KERNEL_ERROR_XDEV;
 
+		lock_guard systemGuard(SystemLock(osystem));
 		return osystem->RenameFile(of, rf);
 	}
 	else
@@ -442,6 +478,7 @@ bool MetaFileSystem::RemoveFile(const std::string &filename)
 	IFileSystem *system;
 	if (MapFilePath(filename, of, &system))
 	{
+		lock_guard systemGuard(SystemLock(system));
 		return system->RemoveFile(of);
 	}
 	else
@@ -455,27 +492,72 @@ void MetaFileSystem::CloseFile(u32 handle)
 	lock_guard guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
+	{
+		lock_guard systemGuard(SystemLock(sys));
+		if (!FileTrace::IsActive())
+		{
+			sys->CloseFile(handle);
+			return;
+		}
+
+		const double startTime = real_time_now();
 		sys->CloseFile(handle);
+		RecordTrace(FILETRACE_CLOSE, handle, 0, 0, 0, startTime, sys);
+	}
 }
 
 size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
-	lock_guard guard(lock);
-	IFileSystem *sys = GetHandleOwner(handle);
-	if (sys)
+	IFileSystem *sys;
+	recursive_mutex *systemLock;
+	{
+		lock_guard guard(lock);
+		sys = GetHandleOwner(handle);
+		if (!sys)
+			return 0;
+		systemLock = &SystemLock(sys);
+	}
+
+	// Reads and writes may take a while, so only block others using the same file system.
+	if (!FileTrace::IsActive())
+	{
+		lock_guard systemGuard(*systemLock);
 		return sys->ReadFile(handle,pointer,size);
-	else
-		return 0;
+	}
+
+	// Timed from before the lock, waiting on another thread's IO is part of the stutter.
+	const double startTime = real_time_now();
+	lock_guard systemGuard(*systemLock);
+	const s64 offset = (s64)sys->SeekFile(handle, 0, FILEMOVE_CURRENT);
+	size_t result = sys->ReadFile(handle,pointer,size);
+	RecordTrace(FILETRACE_READ, handle, offset, size, result, startTime, sys);
+	return result;
 }
 
 size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 {
-	lock_guard guard(lock);
-	IFileSystem *sys = GetHandleOwner(handle);
-	if (sys)
+	IFileSystem *sys;
+	recursive_mutex *systemLock;
+	{
+		lock_guard guard(lock);
+		sys = GetHandleOwner(handle);
+		if (!sys)
+			return 0;
+		systemLock = &SystemLock(sys);
+	}
+
+	if (!FileTrace::IsActive())
+	{
+		lock_guard systemGuard(*systemLock);
 		return sys->WriteFile(handle,pointer,size);
-	else
-		return 0;
+	}
+
+	const double startTime = real_time_now();
+	lock_guard systemGuard(*systemLock);
+	const s64 offset = (s64)sys->SeekFile(handle, 0, FILEMOVE_CURRENT);
+	size_t result = sys->WriteFile(handle,pointer,size);
+	RecordTrace(FILETRACE_WRITE, handle, offset, size, result, startTime, sys);
+	return result;
 }
 
 size_t MetaFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
@@ -483,11 +565,31 @@ size_t MetaFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
 	lock_guard guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
-		return sys->SeekFile(handle,position,type);
+	{
+		lock_guard systemGuard(SystemLock(sys));
+		if (!FileTrace::IsActive())
+			return sys->SeekFile(handle,position,type);
+
+		const double startTime = real_time_now();
+		size_t result = sys->SeekFile(handle,position,type);
+		// GetSeekPos is a seek too, but not one worth tracing.
+		if (position != 0 || type != FILEMOVE_CURRENT)
+			RecordTrace(FILETRACE_SEEK, handle, position, type, result, startTime, sys);
+		return result;
+	}
 	else
 		return 0;
 }
 
+recursive_mutex &MetaFileSystem::SystemLock(IFileSystem *system)
+{
+	lock_guard guard(lock);
+	std::map<IFileSystem *, recursive_mutex *>::iterator it = systemLocks.find(system);
+	if (it == systemLocks.end())
+		it = systemLocks.insert(std::make_pair(system, new recursive_mutex())).first;
+	return *it->second;
+}
+
 void MetaFileSystem::DoState(PointerWrap &p)
 {
 	lock_guard guard(lock);
@@ -506,7 +608,10 @@ void MetaFileSystem::DoState(PointerWrap &p)
 	}
 
 	for (u32 i = 0; i < n; ++i)
+	{
+		lock_guard systemGuard(SystemLock(fileSystems[i].system));
 		fileSystems[i].system->DoState(p);
+	}
 
 	p.DoMarker("MetaFileSystem");
 }
@@ -43,6 +43,11 @@ private:
 	int lastOpenError;
 	recursive_mutex lock;
 
+	// Held while using a file system, so IO on different ones (like the UMD and memstick) can happen at once.
+	// Always take lock first if both are needed.
+	std::map<IFileSystem *, recursive_mutex *> systemLocks;
+	recursive_mutex &SystemLock(IFileSystem *system);
+
 public:
 	MetaFileSystem()
 	{
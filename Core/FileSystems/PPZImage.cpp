@@ -0,0 +1,346 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "Common/StdThread.h"
+#include "Core/FileSystems/PPZImage.h"
+
+#include "zlib.h"
+#include "ext/snappy/snappy-c.h"
+
+namespace PPZ {
+
+// Blocks handed to each thread per batch, keeps the ordering simple and memory bounded.
+static const int BLOCKS_PER_THREAD = 8;
+
+static bool Seek64(FILE *f, u64 pos)
+{
+#ifdef _WIN32
+	return _fseeki64(f, pos, SEEK_SET) == 0;
+#else
+	return fseeko(f, (off_t)pos, SEEK_SET) == 0;
+#endif
+}
+
+static u64 FileSize64(FILE *f)
+{
+#ifdef _WIN32
+	_fseeki64(f, 0, SEEK_END);
+	u64 size = _ftelli64(f);
+#else
+	fseeko(f, 0, SEEK_END);
+	u64 size = ftello(f);
+#endif
+	Seek64(f, 0);
+	return size;
+}
+
+bool IsValidHeader(const Header &header)
+{
+	if (memcmp(header.magic, "PPZI", 4) != 0 || header.version != VERSION || header.headerSize != sizeof(Header))
+		return false;
+	if (header.blockSize < MIN_BLOCK_SIZE || header.blockSize > MAX_BLOCK_SIZE || ((u32)header.blockSize & 2047) != 0)
+		return false;
+	if (header.method != METHOD_SNAPPY && header.method != METHOD_ZLIB)
+		return false;
+	return (u64)header.numBlocks * header.blockSize >= header.totalBytes;
+}
+
+u32 BlockDataSize(const Header &header, u32 block)
+{
+	const u64 start = (u64)block * header.blockSize;
+	if (start >= header.totalBytes)
+		return 0;
+	return (u32)std::min((u64)header.blockSize, (u64)header.totalBytes - start);
+}
+
+u32 BlockCRC(const u8 *data, size_t size)
+{
+	return (u32)crc32(crc32(0, Z_NULL, 0), data, (uInt)size);
+}
+
+bool CompressBlock(int method, const u8 *src, size_t srcSize, std::vector<u8> &dest)
+{
+	if (method == METHOD_SNAPPY)
+	{
+		size_t size = snappy_max_compressed_length(srcSize);
+		dest.resize(size);
+		if (snappy_compress((const char *)src, srcSize, (char *)&dest[0], &size) != SNAPPY_OK)
+			return false;
+		dest.resize(size);
+	}
+	else
+	{
+		uLongf size = compressBound((uLong)srcSize);
+		dest.resize(size);
+		if (compress2(&dest[0], &size, src, (uLong)srcSize, Z_BEST_COMPRESSION) != Z_OK)
+			return false;
+		dest.resize(size);
+	}
+	return dest.size() < srcSize;
+}
+
+bool DecompressBlock(int method, const u8 *src, size_t srcSize, u8 *dest, size_t destSize)
+{
+	if (method == METHOD_SNAPPY)
+	{
+		size_t size = destSize;
+		return snappy_uncompress((const char *)src, srcSize, (char *)dest, &size) == SNAPPY_OK && size == destSize;
+	}
+
+	uLongf size = (uLongf)destSize;
+	return uncompress(dest, &size, src, (uLong)srcSize) == Z_OK && size == destSize;
+}
+
+bool ReadBlockData(const Header &header, const IndexEntry &entry, const u8 *src, u8 *dest, u32 destSize)
+{
+	const u32 size = (u32)entry.size & ~BLOCK_STORED;
+	if ((u32)entry.size & BLOCK_STORED)
+	{
+		if (size != destSize)
+			return false;
+		memcpy(dest, src, destSize);
+	}
+	else if (!DecompressBlock(header.method, src, size, dest, destSize))
+		return false;
+
+	return BlockCRC(dest, destSize) == entry.crc;
+}
+
+namespace {
+	struct BatchJob
+	{
+		const Header *header;
+		int method;
+		int threads;
+		int thread;
+		int count;
+		// Uncompressed data for the batch, blockSize apart.
+		u8 *raw;
+		// Packing: one per block.  Unpacking: a single buffer for the batch.
+		std::vector<u8> *compressed;
+		IndexEntry *entries;
+		// Unpacking: the uncompressed size of each block.
+		const u32 *sizes;
+		bool ok;
+	};
+
+	// Each thread takes every threads-th block of the batch.
+	void CompressBatch(BatchJob *job)
+	{
+		const u32 blockSize = job->header->blockSize;
+		for (int i = job->thread; i < job->count; i += job->threads)
+		{
+			IndexEntry &entry = job->entries[i];
+			const u8 *src = job->raw + (size_t)i * blockSize;
+			entry.crc = BlockCRC(src, (u32)entry.size);
+			if (!CompressBlock(job->method, src, (u32)entry.size, job->compressed[i]))
+			{
+				job->compressed[i].assign(src, src + entry.size);
+				entry.size |= BLOCK_STORED;
+			}
+			else
+				entry.size = (u32)job->compressed[i].size();
+		}
+	}
+
+	void DecompressBatch(BatchJob *job)
+	{
+		const u32 blockSize = job->header->blockSize;
+		for (int i = job->thread; i < job->count; i += job->threads)
+		{
+			// Here the offsets are into the batch's compressed buffer.
+			const IndexEntry &entry = job->entries[i];
+			const u8 *src = job->compressed->empty() ? 0 : &(*job->compressed)[(size_t)(u64)entry.offset];
+			if (!ReadBlockData(*job->header, entry, src, job->raw + (size_t)i * blockSize, job->sizes[i]))
+				job->ok = false;
+		}
+	}
+
+	void RunBatch(void (*func)(BatchJob *), BatchJob &base, std::vector<BatchJob> &jobs)
+	{
+		std::vector<std::thread *> threads;
+		for (int t = 0; t < base.threads; ++t)
+		{
+			jobs[t] = base;
+			jobs[t].thread = t;
+			jobs[t].ok = true;
+			// The calling thread does the last share.
+			if (t < base.threads - 1)
+				threads.push_back(new std::thread(func, &jobs[t]));
+		}
+		func(&jobs[base.threads - 1]);
+		for (size_t t = 0; t < threads.size(); ++t)
+		{
+			threads[t]->join();
+			delete threads[t];
+		}
+	}
+}
+
+bool PackImage(FILE *in, FILE *out, u32 blockSize, int method, int threads, std::string *error)
+{
+	if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE || (blockSize & 2047) != 0)
+	{
+		*error = "Block size must be a multiple of 2048 between 16 KB and 128 KB";
+		return false;
+	}
+	threads = std::max(1, threads);
+
+	Header header;
+	memcpy(header.magic, "PPZI", 4);
+	header.version = VERSION;
+	header.headerSize = sizeof(Header);
+	header.blockSize = blockSize;
+	header.totalBytes = FileSize64(in);
+	header.numBlocks = (u32)((header.totalBytes + blockSize - 1) / blockSize);
+	header.method = (u8)method;
+	memset(header.reserved, 0, sizeof(header.reserved));
+
+	// The index goes before the data, fill it in at the end.
+	std::vector<IndexEntry> index((u32)header.numBlocks);
+	if (fwrite(&header, sizeof(header), 1, out) != 1 || (!index.empty() && fwrite(&index[0], sizeof(IndexEntry), index.size(), out) != index.size()))
+	{
+		*error = "Could not write header";
+		return false;
+	}
+	u64 offset = sizeof(Header) + index.size() * sizeof(IndexEntry);
+
+	const int batchBlocks = threads * BLOCKS_PER_THREAD;
+	std::vector<u8> raw((size_t)batchBlocks * blockSize);
+	std::vector<std::vector<u8> > compressed(batchBlocks);
+	std::vector<BatchJob> jobs(threads);
+	for (u32 first = 0; first < header.numBlocks; first += batchBlocks)
+	{
+		const int count = (int)std::min((u32)batchBlocks, (u32)header.numBlocks - first);
+		const u64 end = std::min((u64)(first + count) * blockSize, (u64)header.totalBytes);
+		const size_t bytes = (size_t)(end - (u64)first * blockSize);
+		if (fread(&raw[0], 1, bytes, in) != bytes)
+		{
+			*error = "Could not read input";
+			return false;
+		}
+		for (int i = 0; i < count; ++i)
+			index[first + i].size = BlockDataSize(header, first + i);
+
+		BatchJob base;
+		base.header = &header;
+		base.method = method;
+		base.threads = threads;
+		base.count = count;
+		base.raw = &raw[0];
+		base.compressed = &compressed[0];
+		base.entries = &index[first];
+		base.sizes = 0;
+		RunBatch(&CompressBatch, base, jobs);
+
+		for (int i = 0; i < count; ++i)
+		{
+			index[first + i].offset = offset;
+			if (fwrite(&compressed[i][0], 1, compressed[i].size(), out) != compressed[i].size())
+			{
+				*error = "Could not write output";
+				return false;
+			}
+			offset += compressed[i].size();
+		}
+	}
+
+	if (!Seek64(out, sizeof(Header)) || (!index.empty() && fwrite(&index[0], sizeof(IndexEntry), index.size(), out) != index.size()))
+	{
+		*error = "Could not write index";
+		return false;
+	}
+	return true;
+}
+
+bool UnpackImage(FILE *in, FILE *out, int threads, std::string *error)
+{
+	threads = std::max(1, threads);
+
+	Header header;
+	if (fread(&header, sizeof(header), 1, in) != 1 || !IsValidHeader(header))
+	{
+		*error = "Not a valid PPZ image";
+		return false;
+	}
+	std::vector<IndexEntry> index((u32)header.numBlocks);
+	if (!index.empty() && fread(&index[0], sizeof(IndexEntry), index.size(), in) != index.size())
+	{
+		*error = "Could not read index";
+		return false;
+	}
+
+	const int batchBlocks = threads * BLOCKS_PER_THREAD;
+	std::vector<u8> raw((size_t)batchBlocks * header.blockSize);
+	std::vector<u8> compressed;
+	std::vector<u32> sizes(batchBlocks);
+	std::vector<IndexEntry> entries(batchBlocks);
+	std::vector<BatchJob> jobs(threads);
+	for (u32 first = 0; first < header.numBlocks; first += batchBlocks)
+	{
+		const int count = (int)std::min((u32)batchBlocks, (u32)header.numBlocks - first);
+		compressed.clear();
+		for (int i = 0; i < count; ++i)
+		{
+			const IndexEntry &entry = index[first + i];
+			const u32 size = (u32)entry.size & ~BLOCK_STORED;
+			entries[i] = entry;
+			entries[i].offset = compressed.size();
+			compressed.resize(compressed.size() + size);
+			if (!Seek64(in, entry.offset) || (size != 0 && fread(&compressed[(size_t)(u64)entries[i].offset], 1, size, in) != size))
+			{
+				*error = "Could not read block data";
+				return false;
+			}
+			sizes[i] = BlockDataSize(header, first + i);
+		}
+
+		BatchJob base;
+		base.header = &header;
+		base.method = header.method;
+		base.threads = threads;
+		base.count = count;
+		base.raw = &raw[0];
+		base.compressed = &compressed;
+		base.entries = &entries[0];
+		base.sizes = &sizes[0];
+		RunBatch(&DecompressBatch, base, jobs);
+
+		for (int t = 0; t < threads; ++t)
+		{
+			if (!jobs[t].ok)
+			{
+				*error = "Corrupt block in image";
+				return false;
+			}
+		}
+
+		const u64 end = std::min((u64)(first + count) * header.blockSize, (u64)header.totalBytes);
+		const size_t bytes = (size_t)(end - (u64)first * header.blockSize);
+		if (fwrite(&raw[0], 1, bytes, out) != bytes)
+		{
+			*error = "Could not write output";
+			return false;
+		}
+	}
+	return true;
+}
+
+}  // namespace PPZ
@@ -0,0 +1,88 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+// PPZ compressed disc images.
+//
+// The image is split into large blocks (16 - 128 KB) which are compressed independently,
+// with snappy (fast to decompress, the default) or zlib (smaller.)  A 64-bit index gives the
+// position, size, and CRC32 of each block, so any block can be read and verified on its own.
+//
+// Layout: Header, then IndexEntry[numBlocks], then the block data.  All little endian.
+//
+// This doesn't depend on the rest of the emulator, so the command line tool can share it.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Common/Common.h"
+
+namespace PPZ {
+
+enum Method
+{
+	METHOD_SNAPPY = 1,
+	METHOD_ZLIB = 2,
+};
+
+enum
+{
+	VERSION = 1,
+	MIN_BLOCK_SIZE = 16 * 1024,
+	MAX_BLOCK_SIZE = 128 * 1024,
+	DEFAULT_BLOCK_SIZE = 64 * 1024,
+	// Set in IndexEntry::size when the block didn't compress and is stored as is.
+	BLOCK_STORED = 0x80000000,
+};
+
+struct Header
+{
+	char magic[4];  // PPZI
+	u32_le version;
+	u32_le headerSize;
+	u32_le blockSize;
+	u64_le totalBytes;
+	u32_le numBlocks;
+	u8 method;
+	u8 reserved[3];
+};
+
+struct IndexEntry
+{
+	u64_le offset;
+	u32_le size;
+	u32_le crc;  // Of the uncompressed data.
+};
+
+bool IsValidHeader(const Header &header);
+// The uncompressed size of a block, only the last one can be short.
+u32 BlockDataSize(const Header &header, u32 block);
+
+u32 BlockCRC(const u8 *data, size_t size);
+// Returns false if it didn't get smaller, then the block should be stored as is.
+bool CompressBlock(int method, const u8 *src, size_t srcSize, std::vector<u8> &dest);
+bool DecompressBlock(int method, const u8 *src, size_t srcSize, u8 *dest, size_t destSize);
+// Handles stored blocks and checks the CRC.
+bool ReadBlockData(const Header &header, const IndexEntry &entry, const u8 *src, u8 *dest, u32 destSize);
+
+// Both use the given number of threads for compression.  On failure, error explains why.
+bool PackImage(FILE *in, FILE *out, u32 blockSize, int method, int threads, std::string *error);
+bool UnpackImage(FILE *in, FILE *out, int threads, std::string *error);
+
+}  // namespace PPZ
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
 #include "Common/FileUtil.h"
 #include "Common/StringUtils.h"
 #include "Common/ChunkFile.h"
@@ -36,9 +38,11 @@
 #endif
 
 const std::string INDEX_FILENAME = ".ppsspp-index.lst";
+// Open host files kept around for reads from umd0: and similar.
+static const size_t MAX_CACHED_HANDLES = 16;
 
 VirtualDiscFileSystem::VirtualDiscFileSystem(IHandleAllocator *_hAlloc, std::string _basePath)
-	: basePath(_basePath),currentBlockIndex(0) {
+	: basePath(_basePath),currentBlockIndex(0),handleCacheTick(0) {
 
 #ifdef _WIN32
 		if (!endsWith(basePath, "\\"))
@@ -53,6 +57,7 @@ VirtualDiscFileSystem::VirtualDiscFileSystem(IHandleAllocator *_hAlloc, std::str
 }
 
 VirtualDiscFileSystem::~VirtualDiscFileSystem() {
+	ClearHandleCache();
 	for (auto iter = entries.begin(), end = entries.end(); iter != end; ++iter) {
 		if (iter->second.type != VFILETYPE_ISO) {
 			iter->second.Close();
@@ -155,6 +160,12 @@ void VirtualDiscFileSystem::DoState(PointerWrap &p)
 
 	FileListEntry dummy = {""};
 	fileList.resize(fileListSize, dummy);
+	if (p.mode == p.MODE_READ)
+	{
+		// The indexes may now point to different files.
+		blockIndex.clear();
+		ClearHandleCache();
+	}
 
 	for (int i = 0; i < fileListSize; i++)
 	{
@@ -272,24 +283,90 @@ int VirtualDiscFileSystem::getFileListIndex(std::string& fileName)
 	return (int)fileList.size()-1;
 }
 
-int VirtualDiscFileSystem::getFileListIndex(u32 accessBlock, u32 accessSize, bool blockMode)
+void VirtualDiscFileSystem::RebuildBlockIndex()
 {
+	blockIndex.resize(fileList.size());
 	for (size_t i = 0; i < fileList.size(); i++)
 	{
-		if (fileList[i].firstBlock <= accessBlock)
-		{
-			u32 sectorOffset = (accessBlock-fileList[i].firstBlock)*2048;
-			u32 totalFileSize = blockMode ? (fileList[i].totalSize+2047) & ~2047 : fileList[i].totalSize;
+		blockIndex[i].firstBlock = fileList[i].firstBlock;
+		blockIndex[i].maxEndBlock = fileList[i].firstBlock + (fileList[i].totalSize + 2047) / 2048;
+		blockIndex[i].fileIndex = (u32)i;
+	}
+
+	// Stable, so that overlapping files keep their order.
+	std::stable_sort(blockIndex.begin(), blockIndex.end());
+	for (size_t i = 1; i < blockIndex.size(); i++)
+		blockIndex[i].maxEndBlock = std::max(blockIndex[i].maxEndBlock, blockIndex[i - 1].maxEndBlock);
+}
+
+bool VirtualDiscFileSystem::BlockBeforeEntry(u32 block, const BlockIndexEntry &entry)
+{
+	return block < entry.firstBlock;
+}
+
+int VirtualDiscFileSystem::getFileListIndex(u32 accessBlock, u32 accessSize, bool blockMode)
+{
+	if (blockIndex.size() != fileList.size())
+		RebuildBlockIndex();
+
+	// Only files starting at or before the block can have it.  Go back from the last of those
+	// until none of the earlier ones reach the block.
+	std::vector<BlockIndexEntry>::const_iterator it = std::upper_bound(blockIndex.begin(), blockIndex.end(), accessBlock, &BlockBeforeEntry);
+	int found = -1;
+	while (it != blockIndex.begin())
+	{
+		--it;
+		if (it->maxEndBlock < accessBlock)
+			break;
+
+		const FileListEntry &entry = fileList[it->fileIndex];
+		u32 sectorOffset = (accessBlock-entry.firstBlock)*2048;
+		u32 totalFileSize = blockMode ? (entry.totalSize+2047) & ~2047 : entry.totalSize;
 
-			u32 endOffset = sectorOffset+accessSize;
-			if (endOffset <= totalFileSize)
+		u32 endOffset = sectorOffset+accessSize;
+		// If files overlap, the first one listed wins.
+		if (endOffset <= totalFileSize && (found == -1 || it->fileIndex < (u32)found))
+			found = (int)it->fileIndex;
+	}
+
+	return found;
+}
+
+VirtualDiscFileSystem::OpenFileEntry *VirtualDiscFileSystem::GetCachedHandle(u32 fileIndex)
+{
+	HandleCache::iterator it = handleCache.find(fileIndex);
+	if (it == handleCache.end())
+	{
+		if (handleCache.size() >= MAX_CACHED_HANDLES)
+		{
+			HandleCache::iterator oldest = handleCache.begin();
+			for (HandleCache::iterator cached = handleCache.begin(); cached != handleCache.end(); ++cached)
 			{
-				return (int)i;
+				if (cached->second.lastUse < oldest->second.lastUse)
+					oldest = cached;
 			}
+			oldest->second.file.Close();
+			handleCache.erase(oldest);
+		}
+
+		CachedHandle cached;
+		if (fileList[fileIndex].handler != NULL) {
+			cached.file.handler = fileList[fileIndex].handler;
 		}
+		if (!cached.file.Open(basePath, fileList[fileIndex].fileName, FILEACCESS_READ))
+			return NULL;
+		it = handleCache.insert(std::make_pair(fileIndex, cached)).first;
 	}
 
-	return -1;
+	it->second.lastUse = ++handleCacheTick;
+	return &it->second.file;
+}
+
+void VirtualDiscFileSystem::ClearHandleCache()
+{
+	for (HandleCache::iterator it = handleCache.begin(); it != handleCache.end(); ++it)
+		it->second.file.Close();
+	handleCache.clear();
 }
 
 u32 VirtualDiscFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename)
@@ -424,8 +501,7 @@ size_t VirtualDiscFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size) {
 	if (iter != entries.end())
 	{
 		// it's the whole iso... it could reference any of the files on the disc.
-		// For now let's just open and close the files on demand. Can certainly be done
-		// better though
+		// The files are kept open for a while, since these reads tend to come in runs.
 		if (iter->second.type == VFILETYPE_ISO)
 		{
 			int fileIndex = getFileListIndex(iter->second.curOffset,size*2048,true);
@@ -435,13 +511,8 @@ size_t VirtualDiscFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size) {
 				return 0;
 			}
 
-			OpenFileEntry temp;
-			if (fileList[fileIndex].handler != NULL) {
-				temp.handler = fileList[fileIndex].handler;
-			}
-			bool success = temp.Open(basePath, fileList[fileIndex].fileName, FILEACCESS_READ);
-
-			if (!success)
+			OpenFileEntry *file = GetCachedHandle(fileIndex);
+			if (!file)
 			{
 				ERROR_LOG(HLE,"VirtualDiscFileSystem: Error opening file %s", fileList[fileIndex].fileName.c_str());
 				return 0;
@@ -450,21 +521,19 @@ size_t VirtualDiscFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size) {
 			u32 startOffset = (iter->second.curOffset-fileList[fileIndex].firstBlock)*2048;
 			size_t bytesRead;
 
-			temp.Seek(startOffset, FILEMOVE_BEGIN);
+			file->Seek(startOffset, FILEMOVE_BEGIN);
 
 			u32 remainingSize = fileList[fileIndex].totalSize-startOffset;
 			if (remainingSize < size * 2048)
 			{
 				// the file doesn't fill the whole last sector
 				// read what's there and zero fill the rest like on a real disc
-				bytesRead = temp.Read(pointer, remainingSize);
+				bytesRead = file->Read(pointer, remainingSize);
 				memset(&pointer[bytesRead], 0, size * 2048 - bytesRead);
 			} else {
-				bytesRead = temp.Read(pointer, size * 2048);
+				bytesRead = file->Read(pointer, size * 2048);
 			}
 
-			temp.Close();
-
 			iter->second.curOffset += size;
 			return size;
 		}
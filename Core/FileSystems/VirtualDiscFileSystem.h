@@ -173,5 +173,32 @@ private:
 	std::vector<FileListEntry> fileList;
 	u32 currentBlockIndex;
 
+	// fileList sorted by firstBlock, for finding the file at a block.  Rebuilt when fileList grows.
+	struct BlockIndexEntry {
+		u32 firstBlock;
+		// The furthest any file up to this one in the index reaches, in blocks.
+		u32 maxEndBlock;
+		u32 fileIndex;
+
+		bool operator < (const BlockIndexEntry &other) const
+		{
+			return firstBlock < other.firstBlock;
+		}
+	};
+	std::vector<BlockIndexEntry> blockIndex;
+	void RebuildBlockIndex();
+	static bool BlockBeforeEntry(u32 block, const BlockIndexEntry &entry);
+
+	// Host files kept open for reads from the whole disc, by fileList index.
+	struct CachedHandle {
+		OpenFileEntry file;
+		u32 lastUse;
+	};
+	typedef std::map<u32, CachedHandle> HandleCache;
+	HandleCache handleCache;
+	u32 handleCacheTick;
+	OpenFileEntry *GetCachedHandle(u32 fileIndex);
+	void ClearHandleCache();
+
 	std::map<std::string, Handler *> handlers;
 };
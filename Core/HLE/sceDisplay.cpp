@@ -26,11 +26,15 @@
 #include "base/timeutil.h"
 
 #include "Common/Thread.h"
+#include "Core/BootProfiler.h"
 #include "Core/CoreTiming.h"
 #include "Core/CoreParameter.h"
 #include "Core/Reporting.h"
 #include "Core/Config.h"
 #include "Core/System.h"
+#include "Core/ELF/PrxCache.h"
+#include "Core/FileSystems/BlockDevices.h"
+#include "Core/HW/AsyncIOManager.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/sceDisplay.h"
 #include "Core/HLE/sceKernel.h"
@@ -353,7 +357,13 @@ void __DisplayGetDebugStats(char stats[2048]) {
 		"Texture invalidations: %i\n"
 		"Vertex shaders loaded: %i\n"
 		"Fragment shaders loaded: %i\n"
-		"Combined shaders loaded: %i\n",
+		"Combined shaders loaded: %i\n"
+		"UMD cache hits: %i, misses: %i\n"
+		"UMD read-ahead blocks: %i, used: %i\n"
+		"UMD file prefetch hits: %i, misses: %i\n"
+		"Async IO queue depth: %i (max %i)\n"
+		"Async IO operations: %i, %0.2f ms (slowest %0.2f ms)\n"
+		"PRX cache hits: %i, misses: %i\n",
 		gpuStats.numVBlanks,
 		gpuStats.msProcessingDisplayLists * 1000.0f,
 		kernelStats.msInSyscalls * 1000.0f,
@@ -379,10 +389,24 @@ void __DisplayGetDebugStats(char stats[2048]) {
 		gpuStats.numTextureInvalidations,
 		gpuStats.numVertexShaders,
 		gpuStats.numFragmentShaders,
-		gpuStats.numShaders
+		gpuStats.numShaders,
+		blockDeviceStats.cacheHits,
+		blockDeviceStats.cacheMisses,
+		blockDeviceStats.readAheadBlocks,
+		blockDeviceStats.readAheadHits,
+		blockDeviceStats.prefetchHits,
+		blockDeviceStats.prefetchMisses,
+		asyncIOStats.queueDepth,
+		asyncIOStats.maxQueueDepth,
+		asyncIOStats.operations,
+		asyncIOStats.msServiceTime,
+		asyncIOStats.msSlowestOperation,
+		prxCacheStats.hits,
+		prxCacheStats.misses
 		);
 
 	gpuStats.ResetFrame();
+	asyncIOStats.ResetFrame();
 	kernelStats.ResetFrame();
 }
 
@@ -532,6 +556,8 @@ void hleEnterVblank(u64 userdata, int cyclesLate) {
 		}
 
 		gpuStats.numFlips++;
+		if (BootProfiler::IsActive())
+			BootProfiler::Finish(true);
 
 		bool throttle, skipFrame;
 		DoFrameTiming(throttle, skipFrame, (float)numVBlanksSinceFlip * (1.0f / 60.0f));
@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <cstdlib>
+#include "base/timeutil.h"
 #include "native/thread/thread.h"
 #include "native/thread/threadutil.h"
 #include "Core/Config.h"
@@ -30,6 +31,7 @@
 #include "Core/Reporting.h"
 
 #include "Core/FileSystems/FileSystem.h"
+#include "Core/FileSystems/FileTrace.h"
 #include "Core/FileSystems/MetaFileSystem.h"
 #include "Core/FileSystems/ISOFileSystem.h"
 #include "Core/FileSystems/DirectoryFileSystem.h"
@@ -114,6 +116,8 @@ static std::thread *ioManagerThread;
 // TODO: Is it better to just put all on the thread?
 // Let's try. (was 256)
 const int IO_THREAD_MIN_DATA_SIZE = 0;
+// Mostly waiting on the disk, so this doesn't need to match the core count.
+const int IO_WORKER_THREADS = 4;
 
 #define SCE_STM_FDIR 0x1000
 #define SCE_STM_FREG 0x2000
@@ -279,6 +283,17 @@ void __IoFreeFd(int fd, u32 &error) {
 // TODO: Closed files are a bit special: until the fd is reused (?), the async result is still available.
 // Clearly a buffer is used, it doesn't seem like they are actually kernel objects.
 
+static void __IoTraceAsync(FileTraceOp op, FileNode *f, s64 size, s64 result, double startTime) {
+	FileTraceEvent event;
+	event.op = op;
+	event.handle = f->handle;
+	event.size = size;
+	event.result = result;
+	if (startTime != 0.0)
+		event.hostSeconds = real_time_now() - startTime;
+	FileTrace::Record(event);
+}
+
 // TODO: We don't do any of that yet.
 // For now, let's at least delay the callback mnotification.
 void __IoAsyncNotify(u64 userdata, int cyclesLate) {
@@ -315,12 +330,15 @@ void __IoSyncNotify(u64 userdata, int cyclesLate) {
 		f->pendingAsyncResult = false;
 		f->hasAsyncResult = true;
 
+		const double startTime = FileTrace::IsActive() ? real_time_now() : 0.0;
 		AsyncIOResult managerResult;
 		if (ioManager.WaitResult(f->handle, managerResult)) {
 			result = managerResult;
 		} else {
 			ERROR_LOG(HLE, "Unable to complete IO operation.");
 		}
+		if (startTime != 0.0)
+			__IoTraceAsync(FILETRACE_ASYNC_DONE, f, 0, result, startTime);
 	}
 
 	SceUID waitID = __KernelGetWaitID(threadID, WAITTYPE_IO, error);
@@ -374,6 +392,7 @@ void __IoInit() {
 	ioManager.SetThreadEnabled(ioManagerThreadEnabled);
 	if (ioManagerThreadEnabled) {
 		ioManagerThread = new std::thread(&__IoManagerThread);
+		ioManager.StartWorkers(IO_WORKER_THREADS);
 	}
 }
 
@@ -390,6 +409,7 @@ void __IoDoState(PointerWrap &p) {
 void __IoShutdown() {
 	ioManagerThreadEnabled = false;
 	ioManager.SyncThread();
+	ioManager.StopWorkers();
 	ioManager.FinishEventLoop();
 	if (ioManagerThread != NULL) {
 		delete ioManagerThread;
@@ -463,12 +483,16 @@ void __IoCompleteAsyncIO(int fd) {
 	u32 error;
 	FileNode *f = __IoGetFd(fd, error);
 	if (f) {
+		// How long the emu thread is stuck waiting on the IO thread here is the interesting part.
+		const double startTime = FileTrace::IsActive() ? real_time_now() : 0.0;
 		AsyncIOResult managerResult;
 		if (ioManager.WaitResult(f->handle, managerResult)) {
 			f->asyncResult = managerResult;
 		} else {
 			// It's okay, not all operations are deferred.
 		}
+		if (startTime != 0.0)
+			__IoTraceAsync(FILETRACE_ASYNC_DONE, f, 0, f->asyncResult, startTime);
 		if (f->callbackID) {
 			__KernelNotifyCallback(THREAD_CALLBACK_IO, f->callbackID, f->callbackArg);
 		}
@@ -513,6 +537,8 @@ void __IoSchedAsync(FileNode *f, int fd, int usec) {
 
 	f->pendingAsyncResult = true;
 	f->hasAsyncResult = false;
+	if (FileTrace::IsActive())
+		__IoTraceAsync(FILETRACE_ASYNC_START, f, usec, 0, 0.0);
 }
 
 void __IoSchedSync(FileNode *f, int fd, int usec) {
@@ -171,6 +171,8 @@ void __KernelShutdown()
 	__CheatShutdown();
 	__KernelModuleShutdown();
 
+	SaveState::Shutdown();
+
 	CoreTiming::ClearPendingEvents();
 	CoreTiming::UnregisterAllEvents();
 
@@ -23,12 +23,15 @@
 #include "Common/FileUtil.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/HLETables.h"
+#include "Core/BootProfiler.h"
+#include "Core/Config.h"
 #include "Core/Reporting.h"
 #include "Core/Host.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSAnalyst.h"
 #include "Core/ELF/ElfReader.h"
 #include "Core/ELF/PBPReader.h"
+#include "Core/ELF/PrxCache.h"
 #include "Core/ELF/PrxDecrypter.h"
 #include "Core/FileSystems/FileSystem.h"
 #include "Core/FileSystems/MetaFileSystem.h"
@@ -396,6 +399,15 @@ void __KernelModuleShutdown()
 	MIPSAnalyst::Shutdown();
 }
 
+// Where ScanForFunctions results are kept for the running game, if anywhere.
+static std::string FunctionCacheFilename()
+{
+	const std::string discID = g_paramSFO.GetValueString("DISC_ID");
+	if (!g_Config.bFunctionCache || discID.empty())
+		return "";
+	return g_Config.memCardDirectory + "PSP/SYSTEM/CACHE/FUNCS/" + discID + "_" + g_paramSFO.GetValueString("DISC_VERSION") + ".ppfc";
+}
+
 // Sometimes there are multiple LO16's or HI16's per pair, even though the ABI says nothing of this.
 // For multiple LO16's, we need the original (unrelocated) instruction data of the HI16.
 // For multiple HI16's, we just need to set each one.
@@ -693,7 +705,9 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		newptr = new u8[head->elf_size + head->psp_size];
 		ptr = newptr;
 		magicPtr = (u32_le *)ptr;
-		int ret = pspDecryptPRX(in, (u8*)ptr, head->psp_size);
+		BootPhaseTimer decryptTimer(BOOT_PHASE_DECRYPT);
+		int ret = pspDecryptPRXCached(in, (u8*)ptr, head->psp_size);
+		decryptTimer.Stop();
 		if (ret == MISSING_KEY) {
 			// This should happen for all "kernel" modules so disabling.
 			// Reporting::ReportMessage("Missing PRX decryption key!");
@@ -726,7 +740,10 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 	// Open ELF reader
 	ElfReader reader((void*)ptr);
 
-	if (!reader.LoadInto(loadAddress)) 	{
+	BootPhaseTimer relocateTimer(BOOT_PHASE_RELOCATE);
+	bool loaded = reader.LoadInto(loadAddress);
+	relocateTimer.Stop();
+	if (!loaded) {
 		ERROR_LOG(HLE, "LoadInto failed");
 		if (newptr)
 			delete [] newptr;
@@ -783,8 +800,10 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		u32 textStart = reader.GetSectionAddr(textSection);
 		u32 textSize = reader.GetSectionSize(textSection);
 
-		if (!reader.LoadSymbols())
+		if (!reader.LoadSymbols()) {
+			MIPSAnalyst::SetFunctionCache(FunctionCacheFilename());
 			MIPSAnalyst::ScanForFunctions(textStart, textStart+textSize);
+		}
 	}
 
 	INFO_LOG(LOADER,"Module %s: %08x %08x %08x", modinfo->name, modinfo->gp, modinfo->libent,modinfo->libstub);
@@ -820,6 +839,7 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 
 	DEBUG_LOG(LOADER,"===================================================");
 
+	BootPhaseTimer importTimer(BOOT_PHASE_IMPORTS);
 	u32_le *entryPos = (u32_le *)Memory::GetPointer(modinfo->libstub);
 	u32_le *entryEnd = (u32_le *)Memory::GetPointer(modinfo->libstubend);
 
@@ -906,6 +926,7 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 
 		DEBUG_LOG(LOADER, "-------------------------------------------------------------");
 	}
+	importTimer.Stop();
 
 	if (needReport) {
 		std::string debugInfo;
@@ -1167,6 +1188,7 @@ u32 __KernelGetModuleGP(SceUID uid)
 
 bool __KernelLoadExec(const char *filename, u32 paramPtr, std::string *error_string)
 {
+	BootPhaseTimer loadExecTimer(BOOT_PHASE_LOAD_EXEC);
 	SceKernelLoadExecParam param;
 
 	if (paramPtr)
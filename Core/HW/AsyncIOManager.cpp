@@ -15,11 +15,15 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "base/timeutil.h"
+#include "thread/threadutil.h"
 #include "Core/Reporting.h"
 #include "Core/System.h"
 #include "Core/HW/AsyncIOManager.h"
 #include "Core/FileSystems/MetaFileSystem.h"
 
+AsyncIOStats asyncIOStats;
+
 void AsyncIOManager::ScheduleOperation(AsyncIOEvent ev) {
 	lock_guard guard(resultsLock_);
 	resultsPending_.insert(ev.handle);
@@ -41,7 +45,8 @@ bool AsyncIOManager::PopResult(u32 handle, AsyncIOResult &result) {
 bool AsyncIOManager::WaitResult(u32 handle, AsyncIOResult &result) {
 	lock_guard guard(resultsLock_);
 	ScheduleEvent(IO_EVENT_SYNC);
-	while (HasEvents() && resultsPending_.find(handle) != resultsPending_.end()) {
+	// Once the sync event is processed, the operation is either done or with a worker.
+	while ((HasEvents() || IsHandleQueued(handle)) && resultsPending_.find(handle) != resultsPending_.end()) {
 		if (PopResult(handle, result)) {
 			return true;
 		}
@@ -55,6 +60,30 @@ bool AsyncIOManager::WaitResult(u32 handle, AsyncIOResult &result) {
 }
 
 void AsyncIOManager::ProcessEvent(AsyncIOEvent ev) {
+	{
+		lock_guard guard(workLock_);
+		if (!workers_.empty()) {
+			std::deque<AsyncIOEvent> &queue = handleQueues_[ev.handle];
+			queue.push_back(ev);
+			// If it already had some, the worker running those will get to this one.
+			if (queue.size() == 1) {
+				readyHandles_.push_back(ev.handle);
+				workWait_.notify_one();
+			}
+
+			asyncIOStats.queueDepth++;
+			if (asyncIOStats.queueDepth > asyncIOStats.maxQueueDepth) {
+				asyncIOStats.maxQueueDepth = asyncIOStats.queueDepth;
+			}
+			return;
+		}
+	}
+
+	RunOperation(ev);
+}
+
+void AsyncIOManager::RunOperation(const AsyncIOEvent &ev) {
+	double start = real_time_now();
 	switch (ev.type) {
 	case IO_EVENT_READ:
 		Read(ev.handle, ev.buf, ev.bytes);
@@ -67,6 +96,86 @@ void AsyncIOManager::ProcessEvent(AsyncIOEvent ev) {
 	default:
 		ERROR_LOG(HLE, "Unsupported IO event type");
 	}
+
+	double elapsed = (real_time_now() - start) * 1000.0;
+	lock_guard guard(workLock_);
+	asyncIOStats.operations++;
+	asyncIOStats.msServiceTime += elapsed;
+	if (elapsed > asyncIOStats.msSlowestOperation) {
+		asyncIOStats.msSlowestOperation = elapsed;
+	}
+}
+
+void AsyncIOManager::StartWorkers(int count) {
+	lock_guard guard(workLock_);
+	workersExit_ = false;
+	for (int i = 0; i < count; ++i) {
+		workers_.push_back(new std::thread(&AsyncIOManager::WorkerThread, this));
+	}
+}
+
+void AsyncIOManager::StopWorkers() {
+	SyncWorkers();
+
+	std::vector<std::thread *> workers;
+	{
+		lock_guard guard(workLock_);
+		workersExit_ = true;
+		workers.swap(workers_);
+	}
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i]->join();
+		delete workers[i];
+	}
+}
+
+void AsyncIOManager::WorkerThread(AsyncIOManager *manager) {
+	setCurrentThreadName("IOWorker");
+	manager->WorkerLoop();
+}
+
+void AsyncIOManager::WorkerLoop() {
+	lock_guard guard(workLock_);
+	while (!workersExit_) {
+		if (readyHandles_.empty()) {
+			// Exiting doesn't wake us, so recheck periodically.
+			workWait_.wait_for(workLock_, 16);
+			continue;
+		}
+
+		u32 handle = readyHandles_.front();
+		readyHandles_.pop_front();
+		AsyncIOEvent ev = handleQueues_[handle].front();
+
+		// Don't hold up other workers while doing the actual IO.
+		workLock_.unlock();
+		RunOperation(ev);
+		workLock_.lock();
+
+		std::deque<AsyncIOEvent> &queue = handleQueues_[handle];
+		queue.pop_front();
+		if (queue.empty()) {
+			handleQueues_.erase(handle);
+		} else {
+			// Back of the line, so a long stream of reads doesn't starve other handles.
+			readyHandles_.push_back(handle);
+			workWait_.notify_one();
+		}
+		asyncIOStats.queueDepth--;
+		workDone_.notify_one();
+	}
+}
+
+bool AsyncIOManager::IsHandleQueued(u32 handle) {
+	lock_guard guard(workLock_);
+	return handleQueues_.find(handle) != handleQueues_.end();
+}
+
+void AsyncIOManager::SyncWorkers() {
+	lock_guard guard(workLock_);
+	while (!handleQueues_.empty() && !workers_.empty()) {
+		workDone_.wait_for(workLock_, 1);
+	}
 }
 
 void AsyncIOManager::Read(u32 handle, u8 *buf, size_t bytes) {
@@ -90,6 +199,8 @@ void AsyncIOManager::EventResult(u32 handle, AsyncIOResult result) {
 
 void AsyncIOManager::DoState(PointerWrap &p) {
 	SyncThread();
+	// Results are only kept by handle, so they're the same no matter which worker ran what.
+	SyncWorkers();
 	lock_guard guard(resultsLock_);
 	p.Do(resultsPending_);
 	p.Do(results_);
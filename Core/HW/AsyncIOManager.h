@@ -15,9 +15,12 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <deque>
 #include <map>
 #include <set>
+#include <vector>
 #include "native/base/mutex.h"
+#include "native/thread/thread.h"
 #include "Core/ThreadEventQueue.h"
 
 class NoBase {
@@ -46,6 +49,25 @@ struct AsyncIOEvent {
 // TODO: Something better.
 typedef size_t AsyncIOResult;
 
+struct AsyncIOStats {
+	void ResetFrame() {
+		maxQueueDepth = queueDepth;
+		operations = 0;
+		msServiceTime = 0;
+		msSlowestOperation = 0;
+	}
+
+	// Operations queued or running, now and at most this frame.
+	int queueDepth;
+	int maxQueueDepth;
+	// Finished this frame, and how long they took to run.
+	int operations;
+	double msServiceTime;
+	double msSlowestOperation;
+};
+
+extern AsyncIOStats asyncIOStats;
+
 typedef ThreadEventQueue<NoBase, AsyncIOEvent, AsyncIOEventType, IO_EVENT_INVALID, IO_EVENT_SYNC, IO_EVENT_FINISH> IOThreadEventQueue;
 class AsyncIOManager : public IOThreadEventQueue {
 public:
@@ -56,6 +78,11 @@ public:
 	bool PopResult(u32 handle, AsyncIOResult &result);
 	bool WaitResult(u32 handle, AsyncIOResult &result);
 
+	// With workers, operations on the same handle still run in order, but different handles run at once.
+	// Without any, operations run on the event thread (or right away if that's disabled.)
+	void StartWorkers(int count);
+	void StopWorkers();
+
 protected:
 	virtual void ProcessEvent(AsyncIOEvent ref);
 	virtual bool ShouldExitEventLoop() {
@@ -63,11 +90,27 @@ protected:
 	}
 
 private:
+	static void WorkerThread(AsyncIOManager *manager);
+	void WorkerLoop();
+	void RunOperation(const AsyncIOEvent &ev);
+	bool IsHandleQueued(u32 handle);
+	void SyncWorkers();
+
 	void Read(u32 handle, u8 *buf, size_t bytes);
 	void Write(u32 handle, u8 *buf, size_t bytes);
 
 	void EventResult(u32 handle, AsyncIOResult result);
 
+	recursive_mutex workLock_;
+	condition_variable workWait_;
+	condition_variable workDone_;
+	// Operations not finished yet, per handle.  Only the front one of each can be running.
+	std::map<u32, std::deque<AsyncIOEvent> > handleQueues_;
+	// Handles with an operation no worker has picked up yet.
+	std::deque<u32> readyHandles_;
+	std::vector<std::thread *> workers_;
+	bool workersExit_;
+
 	recursive_mutex resultsLock_;
 	condition_variable resultsWait_;
 	std::set<u32> resultsPending_;
@@ -66,7 +66,7 @@ IdentifiedFileType Identify_File(std::string &filename)
 		}
 		return FILETYPE_PSP_ISO;
 	}
-	else if (!strcasecmp(extension.c_str(),".cso"))
+	else if (!strcasecmp(extension.c_str(),".cso") || !strcasecmp(extension.c_str(),".ppz"))
 	{
 		return FILETYPE_PSP_ISO;
 	}
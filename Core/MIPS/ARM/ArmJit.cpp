@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "Common/ChunkFile.h"
+#include "../../BootProfiler.h"
 #include "../../Core.h"
 #include "../../CoreTiming.h"
 #include "../MIPS.h"
@@ -165,10 +166,12 @@ void Jit::Compile(u32 em_address)
 		ClearCache();
 	}
 
+	BootPhaseTimer compileTimer(BOOT_PHASE_JIT_COMPILE);
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	DoJit(em_address, b);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink);
+	compileTimer.Stop();
 
 	// Drat.  The VFPU hit an uneaten prefix at the end of a block.
 	if (js.startDefaultPrefix && js.MayHavePrefix())
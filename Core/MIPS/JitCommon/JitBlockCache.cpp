@@ -263,6 +263,50 @@ MIPSOpcode JitBlockCache::GetOriginalFirstOp(int block_num)
 	return blocks[block_num].originalFirstOpcode;
 }
 
+std::vector<u32> JitBlockCache::SaveAndClearEmuHackOps()
+{
+	std::vector<u32> result;
+	result.resize(num_blocks);
+
+	for (int block_num = 0; block_num < num_blocks; ++block_num)
+	{
+		JitBlock &b = blocks[block_num];
+		if (b.invalid)
+			continue;
+
+		const u32 emuhack = GetEmuHackOpForBlock(block_num).encoding;
+		if (Memory::ReadUnchecked_U32(b.originalAddress) == emuhack)
+		{
+			result[block_num] = emuhack;
+			Memory::Write_Opcode_JIT(b.originalAddress, b.originalFirstOpcode);
+		}
+		else
+			result[block_num] = 0;
+	}
+
+	return result;
+}
+
+void JitBlockCache::RestoreSavedEmuHackOps(const std::vector<u32> &saved)
+{
+	if (num_blocks != (int)saved.size())
+	{
+		ERROR_LOG(JIT, "RestoreSavedEmuHackOps: Wrong saved block size.");
+		return;
+	}
+
+	for (int block_num = 0; block_num < num_blocks; ++block_num)
+	{
+		const JitBlock &b = blocks[block_num];
+		if (b.invalid || saved[block_num] == 0)
+			continue;
+
+		// Only if we restored it, write it back.
+		if (Memory::ReadUnchecked_U32(b.originalAddress) == b.originalFirstOpcode.encoding)
+			Memory::Write_Opcode_JIT(b.originalAddress, MIPSOpcode(saved[block_num]));
+	}
+}
+
 void JitBlockCache::LinkBlockExits(int i)
 {
 	JitBlock &b = blocks[i];
@@ -111,6 +111,11 @@ public:
 
 	MIPSOpcode GetOriginalFirstOp(int block_num);
 
+	// Puts the original opcodes back in memory without destroying the blocks, so RAM can be
+	// snapshotted cheaply.  Pass the result to RestoreSavedEmuHackOps() right afterward.
+	std::vector<u32> SaveAndClearEmuHackOps();
+	void RestoreSavedEmuHackOps(const std::vector<u32> &saved);
+
 	// DOES NOT WORK CORRECTLY WITH JIT INLINING
 	void InvalidateICache(u32 address, const u32 length);
 	void DestroyBlock(int block_num, bool invalidate);
@@ -19,6 +19,9 @@
 #include "Globals.h"
 
 #include "Common/FileUtil.h"
+#include "Common/Hash.h"
+#include "Common/TaskScheduler.h"
+#include "Core/BootProfiler.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSTables.h"
 #include "Core/MIPS/MIPSAnalyst.h"
@@ -164,10 +167,136 @@ namespace MIPSAnalyst
 
 	map<u32, Function*> hashToFunction;
 
+	// What ScanForFunctions found in a module's text, as kept in the function cache.
+	struct CachedFunction
+	{
+		u32 start;
+		u32 end;
+		u32 hash;
+		u32 isStraightLeaf;
+	};
+
+	struct FunctionCacheKey
+	{
+		u32 start;
+		u32 end;
+		u64 textHash;
+
+		bool operator < (const FunctionCacheKey &other) const
+		{
+			if (textHash != other.textHash)
+				return textHash < other.textHash;
+			if (start != other.start)
+				return start < other.start;
+			return end < other.end;
+		}
+	};
+
+	struct FunctionCacheHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 numModules;
+		u32 reserved;
+	};
+
+	struct FunctionCacheModule
+	{
+		FunctionCacheKey key;
+		u32 numFunctions;
+		u32 reserved;
+	};
+
+	static const u32 FUNCTION_CACHE_MAGIC = 0x43465050;  // PPFC
+	// Bump when ScanForFunctions or HashFunctions change what they find.
+	static const u32 FUNCTION_CACHE_VERSION = 2;
+
+	std::string functionCacheFilename;
+	bool functionCacheLoaded = false;
+	map<FunctionCacheKey, vector<CachedFunction> > functionCache;
+
 	void Shutdown()
 	{
 		functions.clear();
 		hashToFunction.clear();
+		functionCacheFilename.clear();
+		functionCacheLoaded = false;
+		functionCache.clear();
+	}
+
+	void SetFunctionCache(const std::string &filename)
+	{
+		if (filename == functionCacheFilename)
+			return;
+		functionCacheFilename = filename;
+		functionCacheLoaded = false;
+		functionCache.clear();
+	}
+
+	static void LoadFunctionCache()
+	{
+		if (functionCacheLoaded)
+			return;
+		functionCacheLoaded = true;
+		functionCache.clear();
+
+		File::IOFile file(functionCacheFilename, "rb");
+		FunctionCacheHeader header;
+		if (!file || !file.ReadArray(&header, 1) || header.magic != FUNCTION_CACHE_MAGIC || header.version != FUNCTION_CACHE_VERSION)
+			return;
+
+		for (u32 i = 0; i < header.numModules; ++i)
+		{
+			FunctionCacheModule module;
+			if (!file.ReadArray(&module, 1))
+				break;
+			vector<CachedFunction> &cached = functionCache[module.key];
+			cached.resize(module.numFunctions);
+			if (module.numFunctions != 0 && !file.ReadArray(&cached[0], cached.size()))
+			{
+				WARN_LOG(CPU, "Function cache %s is truncated", functionCacheFilename.c_str());
+				functionCache.erase(module.key);
+				break;
+			}
+		}
+	}
+
+	static void SaveFunctionCache()
+	{
+		const size_t slash = functionCacheFilename.find_last_of('/');
+		if (slash != std::string::npos)
+			File::CreateFullPath(functionCacheFilename.substr(0, slash + 1));
+		// Written to the side and renamed, so a crash never leaves half a cache.
+		const std::string tempFilename = functionCacheFilename + ".tmp";
+		{
+			File::IOFile file(tempFilename, "wb");
+			FunctionCacheHeader header = { FUNCTION_CACHE_MAGIC, FUNCTION_CACHE_VERSION, (u32)functionCache.size(), 0 };
+			bool written = file && file.WriteArray(&header, 1);
+			for (map<FunctionCacheKey, vector<CachedFunction> >::iterator it = functionCache.begin(); written && it != functionCache.end(); ++it)
+			{
+				FunctionCacheModule module = { it->first, (u32)it->second.size(), 0 };
+				written = file.WriteArray(&module, 1);
+				if (written && !it->second.empty())
+					written = file.WriteArray(&it->second[0], it->second.size());
+			}
+			if (!written)
+			{
+				WARN_LOG(CPU, "Could not store function cache %s", tempFilename.c_str());
+				return;
+			}
+		}
+		File::Delete(functionCacheFilename);
+		File::Rename(tempFilename, functionCacheFilename);
+	}
+
+	static bool MakeFunctionCacheKey(u32 startAddr, u32 endAddr, FunctionCacheKey &key)
+	{
+		if (functionCacheFilename.empty() || endAddr <= startAddr || !Memory::IsValidAddress(startAddr) || !Memory::IsValidAddress(endAddr - 1))
+			return false;
+		key.start = startAddr;
+		key.end = endAddr;
+		key.textHash = HashXXH64(Memory::GetPointer(startAddr), endAddr - startAddr);
+		return true;
 	}
 
 	// hm pointless :P
@@ -211,11 +340,11 @@ namespace MIPSAnalyst
 		return true;
 	}
 
-	void HashFunctions()
+	static void HashFunctionRange(int lower, int upper)
 	{
-		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
+		for (int i = lower; i < upper; ++i)
 		{
-			Function &f=*iter;
+			Function &f = functions[i];
 			u32 hash = 0x1337babe;
 			for (u32 addr = f.start; addr <= f.end; addr += 4)
 			{
@@ -234,8 +363,79 @@ namespace MIPSAnalyst
 		}
 	}
 
+	// Each function hashes on its own, so they're split across the task workers.
+	static void HashFunctions(size_t first)
+	{
+		BootPhaseTimer hashTimer(BOOT_PHASE_HASH_FUNCTIONS);
+		TaskScheduler::ParallelFor(&HashFunctionRange, (int)first, (int)functions.size());
+	}
+
+	void HashFunctions()
+	{
+		HashFunctions(0);
+	}
+
+	static void AddFunctionSymbols(size_t first)
+	{
+		for (size_t i = first; i < functions.size(); ++i)
+		{
+			Function &f = functions[i];
+			char temp[256];
+			sprintf(temp,"z_un_%08x",f.start);
+			symbolMap.AddSymbol(temp, f.start, f.end-f.start+4, ST_FUNCTION);
+		}
+	}
+
+	static bool LoadCachedFunctions(const FunctionCacheKey &key)
+	{
+		LoadFunctionCache();
+		map<FunctionCacheKey, vector<CachedFunction> >::iterator it = functionCache.find(key);
+		if (it == functionCache.end())
+			return false;
+
+		const size_t first = functions.size();
+		const vector<CachedFunction> &cached = it->second;
+		for (size_t i = 0; i < cached.size(); ++i)
+		{
+			Function f = {cached[i].start};
+			f.end = cached[i].end;
+			f.size = f.end - f.start + 4;
+			f.hash = cached[i].hash;
+			f.hasHash = true;
+			f.isStraightLeaf = cached[i].isStraightLeaf != 0;
+			functions.push_back(f);
+		}
+		AddFunctionSymbols(first);
+		INFO_LOG(CPU, "Loaded %d functions for %08x-%08x from the function cache", (int)cached.size(), key.start, key.end);
+		return true;
+	}
+
+	static void StoreCachedFunctions(const FunctionCacheKey &key, size_t first)
+	{
+		vector<CachedFunction> &cached = functionCache[key];
+		cached.resize(functions.size() - first);
+		for (size_t i = first; i < functions.size(); ++i)
+		{
+			const Function &f = functions[i];
+			CachedFunction &c = cached[i - first];
+			c.start = f.start;
+			c.end = f.end;
+			c.hash = f.hash;
+			c.isStraightLeaf = f.isStraightLeaf ? 1 : 0;
+		}
+		SaveFunctionCache();
+	}
+
 	void ScanForFunctions(u32 startAddr, u32 endAddr /*, std::vector<u32> knownEntries*/)
 	{
+		BootPhaseTimer scanTimer(BOOT_PHASE_SCAN_FUNCTIONS);
+
+		FunctionCacheKey cacheKey;
+		const bool useCache = MakeFunctionCacheKey(startAddr, endAddr, cacheKey);
+		if (useCache && LoadCachedFunctions(cacheKey))
+			return;
+
+		const size_t firstNew = functions.size();
 		Function currentFunction = {startAddr};
 
 		u32 furthestBranch = 0;
@@ -308,14 +508,14 @@ namespace MIPSAnalyst
 		currentFunction.end = addr + 4;
 		functions.push_back(currentFunction);
 
-		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
-		{
-			(*iter).size = ((*iter).end-(*iter).start+4);
-			char temp[256];
-			sprintf(temp,"z_un_%08x",(*iter).start);
-			symbolMap.AddSymbol(std::string(temp).c_str(), (*iter).start,(*iter).end-(*iter).start+4,ST_FUNCTION);
-		}
-		HashFunctions();
+		// Earlier modules' functions are already sized, named and hashed.
+		for (size_t i = firstNew; i < functions.size(); ++i)
+			functions[i].size = functions[i].end - functions[i].start + 4;
+		AddFunctionSymbols(firstNew);
+		HashFunctions(firstNew);
+
+		if (useCache)
+			StoreCachedFunctions(cacheKey, firstNew);
 	}
 
 	struct HashMapFunc
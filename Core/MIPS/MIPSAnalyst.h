@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "Globals.h"
 #include "Core/MIPS/MIPS.h"
 
@@ -76,7 +78,11 @@ namespace MIPSAnalyst
 
 
 	bool IsRegisterUsed(u32 reg, u32 addr);
+	// Functions found are looked up in, and added to, the function cache if one is set.
 	void ScanForFunctions(u32 startAddr, u32 endAddr);
+	// Per game cache of what ScanForFunctions found, keyed on a hash of each module's text.
+	// An empty filename turns it off.  Cleared by Shutdown.
+	void SetFunctionCache(const std::string &filename);
 	void CompileLeafs();
 
 	std::vector<MIPSGPReg> GetInputRegs(MIPSOpcode op);
@@ -1,4 +1,5 @@
 #include "Common/ChunkFile.h"
+#include "Core/BootProfiler.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/MIPS/MIPS.h"
@@ -54,10 +55,12 @@ void Jit::Compile(u32 em_address)
 		ClearCache();
 	}
 
+	BootPhaseTimer compileTimer(BOOT_PHASE_JIT_COMPILE);
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	DoJit(em_address, b);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink);
+	compileTimer.Stop();
 
 	// Drat.  The VFPU hit an uneaten prefix at the end of a block.
 	if (js.startDefaultPrefix && js.MayHavePrefix())
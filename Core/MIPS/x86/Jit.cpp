@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <iterator>
 #include "Common/ChunkFile.h"
+#include "Core/BootProfiler.h"
 #include "Core/Core.h"
 #include "Core/System.h"
 #include "Core/CoreTiming.h"
@@ -245,10 +246,12 @@ void Jit::Compile(u32 em_address)
 		ClearCache();
 	}
 
+	BootPhaseTimer compileTimer(BOOT_PHASE_JIT_COMPILE);
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	DoJit(em_address, b);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink);
+	compileTimer.Stop();
 
 	// Drat.  The VFPU hit an uneaten prefix at the end of a block.
 	if (js.startDefaultPrefix && js.MayHavePrefix())
@@ -528,6 +531,7 @@ bool Jit::JitSafeMem::PrepareWrite(OpArg &dest, int size)
 		if (ImmValid())
 		{
 			MemCheckImm(MEM_WRITE);
+			MarkDirtyAsm();
 
 #ifdef _M_IX86
 			dest = M(Memory::base + (iaddr_ & Memory::MEMVIEW32_MASK & alignMask_));
@@ -640,6 +644,10 @@ OpArg Jit::JitSafeMem::PrepareMemoryOpArg(ReadType type)
 		jit_->SUB(32, R(xaddr_), Imm32(offset_));
 	}
 
+	// After safe_, so scratchpad writes that jump back up are marked too.
+	if (type == MEM_WRITE)
+		MarkDirtyAsm();
+
 #ifdef _M_IX86
 	return MDisp(xaddr_, (u32) Memory::base + offset_);
 #else
@@ -663,6 +671,41 @@ void Jit::JitSafeMem::PrepareSlowAccess()
 	jit_->SetJumpTarget(tooLow);
 }
 
+void Jit::JitSafeMem::MarkDirtyAsm()
+{
+	if (!Memory::IsDirtyTracking())
+		return;
+
+	// Callers often already have the value to write in ECX/EDX, so preserve them.
+	if (iaddr_ != (u32) -1)
+	{
+		u8 *page = &Memory::g_dirtyPages[(iaddr_ & Memory::DIRTY_ADDRESS_MASK) >> Memory::DIRTY_PAGE_SHIFT];
+#ifdef _M_IX86
+		jit_->MOV(8, M(page), Imm8(1));
+#else
+		jit_->PUSH(RDX);
+		jit_->MOV(64, R(RDX), ImmPtr(page));
+		jit_->MOV(8, MatR(RDX), Imm8(1));
+		jit_->POP(RDX);
+#endif
+		return;
+	}
+
+	jit_->PUSH(ECX);
+	jit_->LEA(32, ECX, MDisp(xaddr_, offset_));
+	jit_->AND(32, R(ECX), Imm32(Memory::DIRTY_ADDRESS_MASK));
+	jit_->SHR(32, R(ECX), Imm8(Memory::DIRTY_PAGE_SHIFT));
+#ifdef _M_IX86
+	jit_->MOV(8, MDisp(ECX, (u32) Memory::g_dirtyPages), Imm8(1));
+#else
+	jit_->PUSH(RDX);
+	jit_->MOV(64, R(RDX), ImmPtr(Memory::g_dirtyPages));
+	jit_->MOV(8, MComplex(RDX, RCX, SCALE_1, 0), Imm8(1));
+	jit_->POP(RDX);
+#endif
+	jit_->POP(ECX);
+}
+
 bool Jit::JitSafeMem::PrepareSlowWrite()
 {
 	// If it's immediate, we only need a slow write on invalid.
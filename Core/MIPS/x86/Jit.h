@@ -376,6 +376,7 @@ private:
 		void PrepareSlowAccess();
 		void MemCheckImm(ReadType type);
 		void MemCheckAsm(ReadType type);
+		void MarkDirtyAsm();
 		bool ImmValid();
 
 		Jit *jit_;
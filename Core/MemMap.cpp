@@ -26,6 +26,7 @@
 #include "MIPS/JitCommon/JitCommon.h"
 #include "HLE/HLE.h"
 #include "CPU.h"
+#include "System.h"
 #include "Debugger/SymbolMap.h"
 
 namespace Memory
@@ -55,6 +56,12 @@ u8 *m_pKernelRAM;	// RAM mirrored up to "kernel space". Fully accessible at all
 u8 *m_pPhysicalVRAM;
 u8 *m_pUncachedVRAM;
 
+u8 *g_dirtyPages = NULL;
+// The last epoch each page was seen dirty in, folded from g_dirtyPages when the epoch ends.
+static u32 *dirtyPageEpochs = NULL;
+static u32 dirtyEpoch = 1;
+static const u32 DIRTY_PAGE_COUNT = (DIRTY_ADDRESS_MASK + 1) >> DIRTY_PAGE_SHIFT;
+
 // Holds the ending address of the PSP's user space.
 // Required for HD Remasters to work properly.
 // These replace RAM_SIZE and RAM_MASK, respectively.
@@ -101,10 +108,19 @@ void DoState(PointerWrap &p)
 	p.DoMarker("VRAM");
 	p.DoArray(m_pScratchPad, SCRATCHPAD_SIZE);
 	p.DoMarker("ScratchPad");
+
+	// Loading a state rewrites everything behind the tracker's back.
+	if (p.mode == PointerWrap::MODE_READ)
+	{
+		MarkDirty(PSP_GetKernelMemoryBase(), g_MemorySize);
+		MarkDirty(PSP_GetVidMemBase(), VRAM_SIZE);
+		MarkDirty(PSP_GetScratchpadMemoryBase(), SCRATCHPAD_SIZE);
+	}
 }
 
 void Shutdown()
 {
+	SetDirtyTracking(false);
 	u32 flags = 0;
 	MemoryMap_Shutdown(views, num_views, flags, &g_arena);
 	g_arena.ReleaseSpace();
@@ -157,6 +173,7 @@ void Memset(const u32 _Address, const u8 _iValue, const u32 _iLength)
 	if (ptr != NULL)
 	{
 		memset(ptr,_iValue,_iLength);
+		MarkDirty(_Address, _iLength);
 	}
 	else
 	{
@@ -165,6 +182,129 @@ void Memset(const u32 _Address, const u8 _iValue, const u32 _iLength)
 	}
 }
 
+bool SetDirtyTracking(bool enable)
+{
+	if (enable == IsDirtyTracking())
+		return true;
+
+#if !defined(_M_IX86) && !defined(_M_X64)
+	// Only the x86 JIT marks pages for its stores.
+	if (enable && PSP_CoreParameter().cpuCore == CPU_JIT)
+	{
+		WARN_LOG(MEMMAP, "Dirty page tracking needs the interpreter on this platform");
+		return false;
+	}
+#endif
+
+	if (enable)
+	{
+		dirtyPageEpochs = new u32[DIRTY_PAGE_COUNT];
+		memset(dirtyPageEpochs, 0, DIRTY_PAGE_COUNT * sizeof(u32));
+		dirtyEpoch = 1;
+		g_dirtyPages = new u8[DIRTY_PAGE_COUNT];
+		// Until now, we don't know what was written, so everything is dirty.
+		memset(g_dirtyPages, 1, DIRTY_PAGE_COUNT);
+	}
+	else
+	{
+		delete [] g_dirtyPages;
+		g_dirtyPages = NULL;
+		delete [] dirtyPageEpochs;
+		dirtyPageEpochs = NULL;
+	}
+
+	// Compiled stores need to start or stop marking pages.
+	if (MIPSComp::jit)
+		MIPSComp::jit->ClearCache();
+	return true;
+}
+
+u32 GetDirtyEpoch()
+{
+	return dirtyEpoch;
+}
+
+static void FoldDirtyPages(u32 start, u32 size)
+{
+	const u32 first = (start & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+	const u32 last = ((start + size - 1) & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+	for (u32 page = first; page <= last; ++page)
+	{
+		if (g_dirtyPages[page])
+		{
+			g_dirtyPages[page] = 0;
+			dirtyPageEpochs[page] = dirtyEpoch;
+		}
+	}
+}
+
+u32 NextDirtyEpoch()
+{
+	if (!IsDirtyTracking())
+		return ++dirtyEpoch;
+
+	FoldDirtyPages(PSP_GetScratchpadMemoryBase(), SCRATCHPAD_SIZE);
+	// Includes the VRAM mirrors.
+	FoldDirtyPages(PSP_GetVidMemBase(), 0x00800000);
+	FoldDirtyPages(PSP_GetKernelMemoryBase(), g_MemorySize);
+	return ++dirtyEpoch;
+}
+
+static inline bool IsPageDirtySince(u32 page, u32 epoch)
+{
+	return dirtyPageEpochs[page] >= epoch || (g_dirtyPages[page] != 0 && dirtyEpoch >= epoch);
+}
+
+bool IsDirtySince(const u32 address, const u32 size, u32 epoch)
+{
+	// Without tracking, we can't say it's clean.
+	if (!IsDirtyTracking() || size == 0)
+		return true;
+
+	const u32 first = (address & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+	const u32 last = ((address + size - 1) & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+	const bool isVRAM = (address & 0x3F800000) == 0x04000000;
+	for (u32 page = first; page <= last; ++page)
+	{
+		if (!isVRAM)
+		{
+			if (IsPageDirtySince(page, epoch))
+				return true;
+			continue;
+		}
+
+		// VRAM is mirrored 4 times, any of them may have been written.
+		const u32 vramPage = page & ((VRAM_MASK & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT);
+		const u32 vramBase = PSP_GetVidMemBase() >> DIRTY_PAGE_SHIFT;
+		for (u32 mirror = 0; mirror < 4; ++mirror)
+		{
+			if (IsPageDirtySince(vramBase + mirror * (VRAM_SIZE >> DIRTY_PAGE_SHIFT) + vramPage, epoch))
+				return true;
+		}
+	}
+	return false;
+}
+
+void GetDirtyPagesSince(u32 epoch, std::vector<u32> &pages)
+{
+	if (!IsDirtyTracking())
+		return;
+
+	const u32 ranges[][2] = {
+		{ PSP_GetScratchpadMemoryBase(), SCRATCHPAD_SIZE },
+		{ PSP_GetVidMemBase(), VRAM_SIZE },
+		{ PSP_GetKernelMemoryBase(), g_MemorySize },
+	};
+	for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i)
+	{
+		for (u32 addr = ranges[i][0], end = ranges[i][0] + ranges[i][1]; addr < end; addr += DIRTY_PAGE_SIZE)
+		{
+			if (IsDirtySince(addr, 1, epoch))
+				pages.push_back(addr);
+		}
+	}
+}
+
 void GetString(std::string& _string, const u32 em_address)
 {
 	char stringBuffer[2048];
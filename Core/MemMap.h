@@ -20,6 +20,7 @@
 
 // Includes
 #include <string>
+#include <vector>
 #include "Common.h"
 #include "CommonTypes.h"
 
@@ -245,6 +246,47 @@ inline const char* GetCharPointer(const u32 address) {
   return (const char *)GetPointer(address);
 }
 
+// Opt-in tracking of which pages were written.  Writes are tracked in the Write_* slow paths,
+// Memcpy/Memset, WriteStruct, x86 JIT stores, and state loads.  Direct writes through
+// GetPointer() (IO, the GPU, many HLE functions) are not, so this is only a hint: nothing
+// that must be exact, like rewind, can rely on it.
+//
+// Time is split into epochs.  Anything written during or after epoch N is "dirty since N".
+enum
+{
+	DIRTY_PAGE_SHIFT = 12,
+	DIRTY_PAGE_SIZE = 1 << DIRTY_PAGE_SHIFT,
+	// Mirrors are folded with this, same as MEMVIEW32_MASK.
+	DIRTY_ADDRESS_MASK = 0x3FFFFFFF,
+};
+
+// One byte per page of the 1 GB address space, NULL when not tracking.  The JIT writes this directly.
+extern u8 *g_dirtyPages;
+
+// Clears the JIT cache, so must be called on the CPU thread.  Returns false if the
+// current CPU core can't track its stores (the ARM and PPC JITs).
+bool SetDirtyTracking(bool enable);
+inline bool IsDirtyTracking() {
+	return g_dirtyPages != NULL;
+}
+
+inline void MarkDirty(const u32 address, const u32 size) {
+	if (g_dirtyPages != NULL && size != 0) {
+		const u32 first = (address & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+		const u32 last = ((address + size - 1) & DIRTY_ADDRESS_MASK) >> DIRTY_PAGE_SHIFT;
+		for (u32 page = first; page <= last; ++page)
+			g_dirtyPages[page] = 1;
+	}
+}
+
+u32 GetDirtyEpoch();
+// Ends the current epoch, and returns the number of the new one.
+u32 NextDirtyEpoch();
+// Whether anything in the range was written since the start of epoch.
+bool IsDirtySince(const u32 address, const u32 size, u32 epoch);
+// Appends the start address of each RAM, VRAM, and scratchpad page written since epoch.
+void GetDirtyPagesSince(u32 epoch, std::vector<u32> &pages);
+
 void Memset(const u32 _Address, const u8 _Data, const u32 _iLength);
 
 inline void Memcpy(const u32 to_address, const void *from_data, const u32 len)
@@ -252,6 +294,7 @@ inline void Memcpy(const u32 to_address, const void *from_data, const u32 len)
 	u8 *to = GetPointer(to_address);
 	if (to) {
 		memcpy(to, from_data, len);
+		MarkDirty(to_address, len);
 	}
 	// if not, GetPointer will log.
 }
@@ -283,6 +326,7 @@ void WriteStruct(u32 address, T *ptr)
 {
 	size_t sz = sizeof(*ptr);
 	memcpy(GetPointer(address), ptr, sz);
+	MarkDirty(address, (u32)sz);
 }
 
 // Expect this to be some form of auto class on big endian.
@@ -111,6 +111,7 @@ template <typename T>
 inline void WriteToHardware(u32 address, const T data)
 {
 	// Could just do a base-relative write, too.... TODO
+	MarkDirty(address, sizeof(T));
 
 	if ((address & 0x3E000000) == 0x08000000) {
 		*(T*)&m_pRAM[address & g_MemoryMask] = data;
@@ -35,6 +35,7 @@
 
 #include "System.h"
 #include "PSPLoaders.h"
+#include "BootProfiler.h"
 #include "HLE/HLE.h"
 #include "HLE/sceKernel.h"
 #include "HLE/sceKernelThread.h"
@@ -46,6 +47,7 @@
 // to determine if the emulator should enable extra memory and
 // double-sized texture coordinates.
 void InitMemoryForGameISO(std::string fileToStart) {
+	BootPhaseTimer mountTimer(BOOT_PHASE_MOUNT);
 	IFileSystem* umd2;
 
 	// check if it's a disc directory
@@ -198,6 +200,7 @@ bool Load_PSP_ELF_PBP(const char *filename, std::string *error_string)
 	// This is really just for headless, might need tweaking later.
 	if (!PSP_CoreParameter().mountIso.empty())
 	{
+		BootPhaseTimer mountTimer(BOOT_PHASE_MOUNT);
 		auto bd = constructBlockDevice(PSP_CoreParameter().mountIso.c_str());
 		if (bd != NULL) {
 			ISOFileSystem *umd2 = new ISOFileSystem(&pspFileSystem, bd);
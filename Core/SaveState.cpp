@@ -18,7 +18,10 @@
 #include <vector>
 
 #include "Common/StdMutex.h"
+#include "Common/StdThread.h"
 #include "Common/FileUtil.h"
+#include "Common/ChunkFile.h"
+#include "Common/ChunkStore.h"
 
 #include "Core/SaveState.h"
 #include "Core/Core.h"
@@ -30,6 +33,9 @@
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/System.h"
+#include "Core/Config.h"
+#include "Core/Util/StateRingbuffer.h"
+#include "GPU/GPUState.h"
 #include "UI/OnScreenDisplay.h"
 #include "i18n/i18n.h"
 
@@ -45,6 +51,7 @@ namespace SaveState
 		SAVESTATE_SAVE,
 		SAVESTATE_LOAD,
 		SAVESTATE_VERIFY,
+		SAVESTATE_REWIND,
 	};
 
 	struct Operation
@@ -60,10 +67,60 @@ namespace SaveState
 		void *cbUserData;
 	};
 
+	// Snapshots the current state into memory.  This is the only part of saving that
+	// has to happen on the emulation thread.
+	static bool SaveToRam(std::vector<u8> &data)
+	{
+		SaveStart state;
+		std::vector<u32> savedBlocks;
+		// Don't want JIT emuhacks in the snapshot, but a full ClearCache() each time would hurt.
+		if (MIPSComp::jit)
+			savedBlocks = MIPSComp::jit->GetBlockCache()->SaveAndClearEmuHackOps();
+
+		bool result = CChunkFileReader::SaveToBuffer(data, state);
+
+		if (MIPSComp::jit)
+			MIPSComp::jit->GetBlockCache()->RestoreSavedEmuHackOps(savedBlocks);
+		return result;
+	}
+
+	static bool LoadFromRam(u8 *data)
+	{
+		SaveStart state;
+		return CChunkFileReader::LoadPtr(data, state);
+	}
+
 	static bool needsProcess = false;
 	static std::vector<Operation> pending;
 	static std::recursive_mutex mutex;
 
+	static StateRingbuffer rewindStates;
+	// When the last rewind state was captured, in flips.
+	static int rewindLastFlip = 0;
+
+	// Slot saves and loads do their compression and file I/O on this thread, so
+	// the emulation thread only stalls for the snapshot or for applying the state.
+	struct IOTask
+	{
+		IOTask(const Operation &o) : op(o), result(false), done(false)
+		{
+		}
+
+		Operation op;
+		std::vector<u8> data;
+		// Page store for manifests, resolved on the emu thread since it needs the file system.
+		std::string storeBasePath;
+		std::string reason;
+		bool result;
+		bool done;
+	};
+
+	static std::thread *ioThread = 0;
+	// A load that's reading on ioThread.  Nothing else is processed until it's applied.
+	static IOTask *pendingLoad = 0;
+	// Shared page store for the current game's slots, only touched from ioThread.
+	static ChunkStore *slotStore = 0;
+
 	void SaveStart::DoState(PointerWrap &p)
 	{
 		// Gotta do CoreTiming first since we'll restore into it.
@@ -110,17 +167,28 @@ namespace SaveState
 		Enqueue(Operation(SAVESTATE_VERIFY, std::string(""), callback, cbUserData));
 	}
 
+	void Rewind(Callback callback, void *cbUserData)
+	{
+		Enqueue(Operation(SAVESTATE_REWIND, std::string(""), callback, cbUserData));
+	}
+
+	bool CanRewind()
+	{
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		return !rewindStates.Empty();
+	}
+
 
 	// Slot utilities
 
-	std::string GenerateSaveSlotFilename(int slot)
+	static std::string GenerateSaveStatePath(const char *name)
 	{
 		char discID[256];
 		char temp[256];
 		sprintf(discID, "%s_%s",
 			g_paramSFO.GetValueString("DISC_ID").c_str(),
 			g_paramSFO.GetValueString("DISC_VERSION").c_str());
-		sprintf(temp, "ms0:/PSP/PPSSPP_STATE/%s_%i.ppst", discID, slot);
+		sprintf(temp, "ms0:/PSP/PPSSPP_STATE/%s%s", discID, name);
 		std::string hostPath;
 		if (pspFileSystem.GetHostPath(std::string(temp), hostPath)) {
 			return hostPath;
@@ -129,9 +197,51 @@ namespace SaveState
 		}
 	}
 
+	std::string GenerateSaveSlotFilename(int slot)
+	{
+		char temp[256];
+		sprintf(temp, "_%i.ppst", slot);
+		return GenerateSaveStatePath(temp);
+	}
+
+	// Manifest for a slot saved in the page store (see ChunkStore.)
+	static std::string GenerateSaveSlotManifest(int slot)
+	{
+		char temp[256];
+		sprintf(temp, "_%i.ppsm", slot);
+		return GenerateSaveStatePath(temp);
+	}
+
+	static bool IsManifestFilename(const std::string &fn)
+	{
+		return fn.size() > 5 && fn.compare(fn.size() - 5, 5, ".ppsm") == 0;
+	}
+
+	// Either the manifest or the full file, whichever exists.  Only one is kept per slot.
+	static std::string FindSaveSlotFile(int slot)
+	{
+		std::string fn = GenerateSaveSlotManifest(slot);
+		if (!fn.empty() && File::Exists(fn))
+			return fn;
+		return GenerateSaveSlotFilename(slot);
+	}
+
+	// All slots of a game share one store.  Only called from ioThread.
+	static ChunkStore *GetSlotStore(const std::string &basePath)
+	{
+		if (slotStore && slotStore->BasePath() != basePath)
+		{
+			delete slotStore;
+			slotStore = 0;
+		}
+		if (!slotStore)
+			slotStore = new ChunkStore(basePath);
+		return slotStore;
+	}
+
 	void LoadSlot(int slot, Callback callback, void *cbUserData)
 	{
-		std::string fn = GenerateSaveSlotFilename(slot);
+		std::string fn = FindSaveSlotFile(slot);
 		if (!fn.empty()) {
 			Load(fn, callback, cbUserData);
 		} else {
@@ -143,7 +253,7 @@ namespace SaveState
 
 	void SaveSlot(int slot, Callback callback, void *cbUserData)
 	{
-		std::string fn = GenerateSaveSlotFilename(slot);
+		std::string fn = g_Config.bSaveStatePageStore ? GenerateSaveSlotManifest(slot) : GenerateSaveSlotFilename(slot);
 		if (!fn.empty()) {
 			Save(fn, callback, cbUserData);
 		} else {
@@ -155,7 +265,7 @@ namespace SaveState
 
 	bool HasSaveInSlot(int slot)
 	{
-		std::string fn = GenerateSaveSlotFilename(slot);
+		std::string fn = FindSaveSlotFile(slot);
 		return File::Exists(fn);
 	}
 
@@ -175,11 +285,11 @@ namespace SaveState
 		return false;
 	}
 
-	int GetMostRecentSaveSlot() {
+	int GetNewestSlot() {
 		int newestSlot = -1;
 		tm newestDate = {0};
 		for (int i = 0; i < SAVESTATESLOTS; i++) {
-			std::string fn = GenerateSaveSlotFilename(i);
+			std::string fn = FindSaveSlotFile(i);
 			if (File::Exists(fn)) {
 				tm time = File::GetModifTime(fn);
 				if (newestDate < time) {
@@ -201,8 +311,116 @@ namespace SaveState
 		return copy;
 	}
 
+	static void WaitForIOThread()
+	{
+		if (ioThread)
+		{
+			ioThread->join();
+			delete ioThread;
+			ioThread = 0;
+		}
+	}
+
+	static void SaveThread(IOTask *task)
+	{
+		I18NCategory *s = GetI18NCategory("Screen");
+		const std::string &fn = task->op.filename;
+		bool result;
+		if (IsManifestFilename(fn))
+		{
+			result = GetSlotStore(task->storeBasePath)->SaveFile(fn, REVISION, task->data);
+			// Don't leave an older full state behind to confuse the slot.
+			std::string oldFn = fn.substr(0, fn.size() - 5) + ".ppst";
+			if (result && File::Exists(oldFn))
+				File::Delete(oldFn);
+		}
+		else
+		{
+			result = CChunkFileReader::SaveFile(fn, REVISION, task->data);
+			bool isSlotFile = fn.size() > 5 && fn.compare(fn.size() - 5, 5, ".ppst") == 0;
+			std::string oldFn = isSlotFile ? fn.substr(0, fn.size() - 5) + ".ppsm" : "";
+			if (result && isSlotFile && File::Exists(oldFn))
+				File::Delete(oldFn);
+		}
+		if (result)
+			osm.Show(s->T("Saved State"), 2.0);
+		else
+			osm.Show(s->T("Save State Failed"), 2.0);
+
+		if (task->op.callback != NULL)
+			task->op.callback(result, task->op.cbUserData);
+		delete task;
+	}
+
+	static void LoadThread(IOTask *task)
+	{
+		if (IsManifestFilename(task->op.filename))
+			task->result = GetSlotStore(task->storeBasePath)->LoadFile(task->op.filename, REVISION, task->data, &task->reason);
+		else
+			task->result = CChunkFileReader::LoadFile(task->op.filename, REVISION, task->data, &task->reason);
+
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		task->done = true;
+		// The state itself has to be applied on the emulation thread.
+		needsProcess = true;
+	}
+
+	// Returns false if the pending load is still reading.
+	static bool FinishPendingLoad()
+	{
+		{
+			std::lock_guard<std::recursive_mutex> guard(mutex);
+			if (!pendingLoad->done)
+				return false;
+		}
+		WaitForIOThread();
+
+		IOTask *task = pendingLoad;
+		pendingLoad = 0;
+
+		bool result = task->result;
+		if (result)
+		{
+			if (MIPSComp::jit)
+				MIPSComp::jit->ClearCache();
+			SaveStart state;
+			result = CChunkFileReader::LoadPtr(&task->data[0], state);
+			INFO_LOG(COMMON, "ChunkReader: Done loading %s", task->op.filename.c_str());
+		}
+
+		I18NCategory *s = GetI18NCategory("Screen");
+		if (result)
+			osm.Show(s->T("Loaded State"), 2.0);
+		else
+			osm.Show(s->T(task->reason.c_str(), "Load savestate failed"), 2.0);
+
+		if (task->op.callback != NULL)
+			task->op.callback(result, task->op.cbUserData);
+		delete task;
+		return true;
+	}
+
+	static void CheckRewindState()
+	{
+		if (g_Config.iRewindSnapshotInterval <= 0 || gpuStats.numFlips == 0)
+			return;
+		// Flips reset on restart, so handle going backward too.
+		int diff = gpuStats.numFlips - rewindLastFlip;
+		if (diff >= 0 && diff < g_Config.iRewindSnapshotInterval)
+			return;
+		rewindLastFlip = gpuStats.numFlips;
+
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		const size_t memoryLimit = (size_t)std::max(g_Config.iRewindMemoryLimitMB, 1) * 1024 * 1024;
+		if (!rewindStates.Save(&SaveToRam, std::max(g_Config.iRewindMaxStates, 1), memoryLimit))
+			WARN_LOG(COMMON, "Savestate: Unable to capture rewind state");
+	}
+
 	void Process()
 	{
+		if (__KernelIsRunning())
+			CheckRewindState();
+
 		if (!needsProcess)
 			return;
 		needsProcess = false;
@@ -213,6 +431,10 @@ namespace SaveState
 			return;
 		}
 
+		// Anything queued behind a load has to wait until it's applied.
+		if (pendingLoad && !FinishPendingLoad())
+			return;
+
 		std::vector<Operation> operations = Flush();
 		SaveStart state;
 
@@ -220,33 +442,53 @@ namespace SaveState
 		{
 			Operation &op = operations[i];
 			bool result;
-			std::string reason;
+			// Async operations call the callback themselves.
+			bool async = false;
 
 			I18NCategory *s = GetI18NCategory("Screen"); 
 
 			switch (op.type)
 			{
 			case SAVESTATE_LOAD:
-				if (MIPSComp::jit)
-					MIPSComp::jit->ClearCache();
 				INFO_LOG(COMMON, "Loading state from %s", op.filename.c_str());
-				result = CChunkFileReader::Load(op.filename, REVISION, state, &reason);
-				if(result)
-					osm.Show(s->T("Loaded State"), 2.0);
-				else {
-					osm.Show(s->T(reason.c_str(), "Load savestate failed"), 2.0);
+				WaitForIOThread();
+				pendingLoad = new IOTask(op);
+				pendingLoad->storeBasePath = GenerateSaveStatePath("");
+				if (Core_IsInactive())
+				{
+					// Nothing to stall, and nobody would come back to apply it.
+					LoadThread(pendingLoad);
+					FinishPendingLoad();
+					async = true;
+					break;
 				}
-				break;
+
+				ioThread = new std::thread(&LoadThread, pendingLoad);
+				{
+					std::lock_guard<std::recursive_mutex> guard(mutex);
+					pending.insert(pending.begin(), operations.begin() + i + 1, operations.end());
+				}
+				return;
 
 			case SAVESTATE_SAVE:
-				if (MIPSComp::jit)
-					MIPSComp::jit->ClearCache();
 				INFO_LOG(COMMON, "Saving state to %s", op.filename.c_str());
-				result = CChunkFileReader::Save(op.filename, REVISION, state);
-				if(result)
-					osm.Show(s->T("Saved State"), 2.0);
-				else
-					osm.Show(s->T("Save State Failed"), 2.0);
+				{
+					IOTask *task = new IOTask(op);
+					task->storeBasePath = GenerateSaveStatePath("");
+					result = SaveToRam(task->data);
+					if (result)
+					{
+						// Only one write at a time, so saves to the same file stay in order.
+						WaitForIOThread();
+						ioThread = new std::thread(&SaveThread, task);
+						async = true;
+					}
+					else
+					{
+						delete task;
+						osm.Show(s->T("Save State Failed"), 2.0);
+					}
+				}
 				break;
 
 			case SAVESTATE_VERIFY:
@@ -254,13 +496,29 @@ namespace SaveState
 				result = CChunkFileReader::Verify(state);
 				break;
 
+			case SAVESTATE_REWIND:
+				if (MIPSComp::jit)
+					MIPSComp::jit->ClearCache();
+				INFO_LOG(COMMON, "Rewinding to recent savestate snapshot");
+				{
+					std::lock_guard<std::recursive_mutex> guard(mutex);
+					result = rewindStates.Restore(&LoadFromRam);
+				}
+				if (result)
+					osm.Show(s->T("Loaded State"), 2.0);
+				else
+					osm.Show(s->T("No rewind save states"), 2.0);
+				// Wait a full interval before capturing again, or we'd just snapshot what we loaded.
+				rewindLastFlip = gpuStats.numFlips;
+				break;
+
 			default:
 				ERROR_LOG(COMMON, "Savestate failure: unknown operation type %d", op.type);
 				result = false;
 				break;
 			}
 
-			if (op.callback != NULL)
+			if (!async && op.callback != NULL)
 				op.callback(result, op.cbUserData);
 		}
 	}
@@ -271,5 +529,24 @@ namespace SaveState
 		pspFileSystem.MkDir("ms0:/PSP/PPSSPP_STATE");
 
 		std::lock_guard<std::recursive_mutex> guard(mutex);
+		rewindStates.Clear();
+		rewindLastFlip = 0;
+	}
+
+	void Shutdown()
+	{
+		WaitForIOThread();
+		if (pendingLoad)
+		{
+			if (pendingLoad->op.callback != NULL)
+				pendingLoad->op.callback(false, pendingLoad->op.cbUserData);
+			delete pendingLoad;
+			pendingLoad = 0;
+		}
+		delete slotStore;
+		slotStore = 0;
+
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		rewindStates.Clear();
 	}
 }
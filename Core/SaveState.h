@@ -28,6 +28,8 @@ namespace SaveState
 	const int SAVESTATESLOTS = 5;
 
 	void Init();
+	// Waits for any save still writing in the background.
+	void Shutdown();
 
 	void SaveSlot(int slot, Callback callback, void *cbUserData = 0);
 	void LoadSlot(int slot, Callback callback, void *cbUserData = 0);
@@ -48,6 +50,13 @@ namespace SaveState
 	// Warning: callback will be called on a different thread.
 	void Verify(Callback callback = 0, void *cbUserData = 0);
 
+	// Load the most recent in-memory rewind state, and step back one (async.)
+	// Rewind states are captured every g_Config.iRewindSnapshotInterval flips.
+	// Warning: callback will be called on a different thread.
+	void Rewind(Callback callback = 0, void *cbUserData = 0);
+	// Returns true if there's a rewind state to go back to.
+	bool CanRewind();
+
 	// Check if there's any save stating needing to be done.  Normally called once per frame.
 	void Process();
 };
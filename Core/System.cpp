@@ -30,6 +30,7 @@
 #include "Core/MIPS/JitCommon/JitCommon.h"
 
 #include "Core/System.h"
+#include "Core/BootProfiler.h"
 #include "Core/PSPMixer.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/sceKernel.h"
@@ -39,12 +40,20 @@
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/CoreParameter.h"
+#include "Core/FileSystems/FileTrace.h"
 #include "Core/FileSystems/MetaFileSystem.h"
 #include "Core/Loaders.h"
 #include "Core/PSPLoaders.h"
 #include "Core/ELF/ParamSFO.h"
 #include "Core/SaveState.h"
 #include "Common/LogManager.h"
+#include "Common/CPUDetect.h"
+#include "Common/Hash.h"
+#include "Common/MemoryUtil.h"
+extern "C"
+{
+#include "ext/libkirk/AES.h"
+}
 
 #include "GPU/GPUState.h"
 #include "GPU/GPUInterface.h"
@@ -153,6 +162,14 @@ void CPU_Init() {
 		break;
 	}
 
+	// Kirk, PRX and savedata crypto all go through libkirk's AES.
+	AES_set_hw_enabled(cpu_info.bAES);
+	// And texture and vertex cache hashing through CRC32C.
+	SetHashHardwareEnabled(cpu_info.bSSE4_2);
+	// Before the arena and the JIT's code space are allocated.
+	SetHugePageMode(g_Config.iHugePages);
+
+	BootPhaseTimer coreInitTimer(BOOT_PHASE_CORE_INIT);
 	Memory::Init();
 	mipsr4k.Reset();
 	mipsr4k.pc = 0;
@@ -169,8 +186,13 @@ void CPU_Init() {
 
 	CoreTiming::Init();
 
+	// Started before anything is mounted, so the trace has every open.
+	if (!g_Config.sFileTraceFilename.empty())
+		FileTrace::Start(g_Config.sFileTraceFilename);
+
 	// Init all the HLE modules
 	HLEInit();
+	coreInitTimer.Stop();
 
 	// TODO: Check Game INI here for settings, patches and cheats, and modify coreParameter accordingly
 
@@ -202,6 +224,7 @@ void CPU_Shutdown() {
 		host->ShutdownSound();
 		mixer = 0;  // deleted in ShutdownSound
 	}
+	FileTrace::Stop();
 	pspFileSystem.Shutdown();
 	Memory::Shutdown();
 	currentCPU = 0;
@@ -256,6 +279,8 @@ void Core_UpdateState(CoreState newState) {
 
 bool PSP_Init(const CoreParameter &coreParam, std::string *error_string) {
 	INFO_LOG(HLE, "PPSSPP %s", PPSSPP_GIT_VERSION);
+	BootProfiler::Start();
+	BootPhaseTimer initTimer(BOOT_PHASE_INIT);
 
 	coreParameter = coreParam;
 	coreParameter.errorString = "";
@@ -271,7 +296,10 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string) {
 	bool success = coreParameter.fileToStart != "";
 	*error_string = coreParameter.errorString;
 	if (success) {
+		BootPhaseTimer gpuTimer(BOOT_PHASE_GPU_INIT);
 		GPU_Init();
+	} else {
+		BootProfiler::Finish(false);
 	}
 	return success;
 }
@@ -281,6 +309,7 @@ bool PSP_IsInited() {
 }
 
 void PSP_Shutdown() {
+	BootProfiler::Finish(false);
 	if (coreState == CORE_RUNNING)
 		coreState = CORE_ERROR;
 	if (cpuThread != NULL) {
@@ -0,0 +1,50 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+
+#include "base/timeutil.h"
+#include "../../Globals.h"
+
+// Helpers for the timing loops in the unit tests and headless.
+
+// Stores a result a benchmark loop computed, so the compiler can't throw the loop away.
+inline void BenchmarkSink(u64 value)
+{
+	static volatile u64 sink;
+	sink = value;
+}
+
+// Calls func reps times, then prints "name: N unit/s, T ms" for amount units of work per call.
+// Whatever func returns goes to BenchmarkSink(), so a loop that only computes a value is kept.
+// Returns the seconds per call, never zero.
+inline double RunBenchmark(const char *name, const std::function<u64()> &func, double amount, const char *unit, int reps = 1)
+{
+	u64 sum = 0;
+	double start = real_time_now();
+	for (int i = 0; i < reps; ++i)
+		sum += func();
+	double seconds = (real_time_now() - start) / reps;
+	BenchmarkSink(sum);
+	if (seconds < 0.000001)
+		seconds = 0.000001;
+	printf("%s: %0.1f %s/s, %0.3f ms\n", name, amount / seconds, unit, seconds * 1000.0);
+	return seconds;
+}
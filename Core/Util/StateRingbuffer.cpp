@@ -0,0 +1,135 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+
+#include "ext/snappy/snappy-c.h"
+#include "Core/Util/StateRingbuffer.h"
+
+// dest ^= src, dest must be at least as large as src.
+static void XorInto(std::vector<u8> &dest, const std::vector<u8> &src)
+{
+	const size_t words = src.size() / sizeof(u64);
+	u64 *d64 = (u64 *)&dest[0];
+	const u64 *s64 = (const u64 *)&src[0];
+	for (size_t i = 0; i < words; ++i)
+		d64[i] ^= s64[i];
+	for (size_t i = words * sizeof(u64); i < src.size(); ++i)
+		dest[i] ^= src[i];
+}
+
+StateRingbuffer::StateRingbuffer() : deltaBytes_(0), maxStates_(1), memoryLimit_(0)
+{
+}
+
+StateRingbuffer::~StateRingbuffer()
+{
+	WaitForCompress();
+}
+
+bool StateRingbuffer::Save(const CaptureFunc &capture, size_t maxStates, size_t memoryLimit)
+{
+	WaitForCompress();
+	maxStates_ = maxStates;
+	memoryLimit_ = memoryLimit;
+
+	if (!capture(next_))
+	{
+		next_.clear();
+		return false;
+	}
+
+	compressTask_ = TaskScheduler::Submit(std::bind(&StateRingbuffer::CompressDelta, this));
+	return true;
+}
+
+bool StateRingbuffer::Restore(const LoadFunc &load)
+{
+	WaitForCompress();
+	if (current_.empty())
+		return false;
+
+	if (!load(&current_[0]))
+		return false;
+
+	// Keep the oldest state around, so repeated rewinds stop there.
+	if (!deltas_.empty())
+	{
+		Delta &delta = deltas_.back();
+		size_t size = 0;
+		snappy_uncompressed_length((const char *)&delta.data[0], delta.data.size(), &size);
+		scratch_.resize(size);
+		snappy_uncompress((const char *)&delta.data[0], delta.data.size(), (char *)&scratch_[0], &size);
+
+		current_.resize(std::max(current_.size(), size), 0);
+		XorInto(current_, scratch_);
+		current_.resize(delta.prevSize);
+
+		deltaBytes_ -= delta.data.size();
+		deltas_.pop_back();
+	}
+	return true;
+}
+
+void StateRingbuffer::Clear()
+{
+	WaitForCompress();
+	current_.clear();
+	next_.clear();
+	deltas_.clear();
+	deltaBytes_ = 0;
+}
+
+bool StateRingbuffer::Empty()
+{
+	WaitForCompress();
+	return current_.empty();
+}
+
+void StateRingbuffer::CompressDelta()
+{
+	if (!current_.empty())
+	{
+		// The delta turns next_ back into current_.
+		scratch_ = next_;
+		scratch_.resize(std::max(next_.size(), current_.size()), 0);
+		XorInto(scratch_, current_);
+
+		deltas_.push_back(Delta());
+		Delta &delta = deltas_.back();
+		delta.prevSize = (u32)current_.size();
+		size_t compressedSize = snappy_max_compressed_length(scratch_.size());
+		delta.data.resize(compressedSize);
+		snappy_compress((const char *)&scratch_[0], scratch_.size(), (char *)&delta.data[0], &compressedSize);
+		delta.data.resize(compressedSize);
+		deltaBytes_ += compressedSize;
+	}
+	current_.swap(next_);
+	next_.clear();
+
+	// The oldest delta is only needed to reach the oldest state, so just drop it.
+	while (!deltas_.empty() && (deltas_.size() + 1 > maxStates_ || current_.size() + deltaBytes_ > memoryLimit_))
+	{
+		deltaBytes_ -= deltas_.front().data.size();
+		deltas_.pop_front();
+	}
+}
+
+void StateRingbuffer::WaitForCompress()
+{
+	compressTask_.Wait();
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../../Globals.h"
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "Common/TaskScheduler.h"
+
+// Rewind states only ever live in memory.  The newest one is kept uncompressed, and each
+// older one is stored as a snappy compressed XOR against the state captured after it.
+// Most of RAM doesn't change between captures, so the deltas are mostly zeros.
+// Every byte is XORed each time: plenty of writers (GetPointer users, IO, the GPU) bypass
+// dirty page tracking, so it can't be used to skip anything here.
+class StateRingbuffer
+{
+public:
+	// Fills the buffer with a new state.
+	typedef std::function<bool(std::vector<u8> &)> CaptureFunc;
+	// Applies a state captured earlier.
+	typedef std::function<bool(u8 *)> LoadFunc;
+
+	StateRingbuffer();
+	~StateRingbuffer();
+
+	// Captures on the calling thread; the delta is built and compressed in a task.
+	bool Save(const CaptureFunc &capture, size_t maxStates, size_t memoryLimit);
+	// Loads the newest state, then steps back so the next call goes further back.
+	bool Restore(const LoadFunc &load);
+	void Clear();
+	bool Empty();
+
+private:
+	struct Delta
+	{
+		std::vector<u8> data;
+		u32 prevSize;
+	};
+
+	void CompressDelta();
+	void WaitForCompress();
+
+	std::vector<u8> current_;
+	std::vector<u8> next_;
+	std::vector<u8> scratch_;
+	std::deque<Delta> deltas_;
+	size_t deltaBytes_;
+	size_t maxStates_;
+	size_t memoryLimit_;
+	TaskHandle compressTask_;
+};
@@ -18,6 +18,7 @@
 #include <map>
 #include <algorithm>
 
+#include "Common/Hash.h"
 #include "Core/MemMap.h"
 #include "Core/Reporting.h"
 #include "GPU/ge_constants.h"
@@ -26,7 +27,6 @@
 #include "GPU/GLES/Framebuffer.h"
 #include "Core/Config.h"
 
-#include "ext/xxhash.h"
 #include "native/ext/cityhash/city.h"
 
 #ifdef _M_SSE
@@ -843,34 +843,8 @@ static inline u32 QuickClutHash(const u8 *clut, u32 bytes) {
 
 static inline u32 QuickTexHash(u32 addr, int bufw, int w, int h, GETextureFormat format) {
 	const u32 sizeInRAM = (bitsPerPixel[format] * bufw * h) / 8;
-	const u32 *checkp = (const u32 *) Memory::GetPointer(addr);
-	u32 check = 0;
-
-#ifdef _M_SSE
-	// Make sure both the size and start are aligned, OR will get either.
-	if ((((u32)(intptr_t)checkp | sizeInRAM) & 0x1f) == 0) {
-		__m128i cursor = _mm_set1_epi32(0);
-		const __m128i *p = (const __m128i *)checkp;
-		for (u32 i = 0; i < sizeInRAM / 16; i += 2) {
-			cursor = _mm_add_epi32(cursor, _mm_load_si128(&p[i]));
-			cursor = _mm_xor_si128(cursor, _mm_load_si128(&p[i + 1]));
-		}
-		// Add the four parts into the low i32.
-		cursor = _mm_add_epi32(cursor, _mm_srli_si128(cursor, 8));
-		cursor = _mm_add_epi32(cursor, _mm_srli_si128(cursor, 4));
-		check = _mm_cvtsi128_si32(cursor);
-	} else {
-#else
-	// TODO: ARM NEON implementation (using CPUDetect to be sure it has NEON.)
-	{
-#endif
-		for (u32 i = 0; i < sizeInRAM / 8; ++i) {
-			check += *checkp++;
-			check ^= *checkp++;
-		}
-	}
-
-	return check;
+	// The entry only has room for 32 bits.
+	return (u32)HashFast64(Memory::GetPointer(addr), sizeInRAM);
 }
 
 inline bool TextureCache::TexCacheEntry::Matches(u16 dim2, u8 format2, int maxLevel2) {
@@ -897,7 +871,7 @@ void TextureCache::UpdateCurrentClut() {
 	// If not, we're going to hash random data, which hopefully doesn't cause a performance issue.
 	const u32 clutExtendedBytes = clutTotalBytes_ + clutBaseBytes;
 
-	clutHash_ = XXH32((const char *)clutBufRaw_, clutExtendedBytes, 0xC0108888);
+	clutHash_ = (u32)HashFast64(clutBufRaw_, clutExtendedBytes, 0xC0108888);
 
 	// Avoid a copy when we don't need to convert colors.
 	if (clutFormat != GE_CMODE_32BIT_ABGR8888) {
@@ -17,6 +17,7 @@
 
 #include "base/timeutil.h"
 
+#include "Common/Hash.h"
 #include "Common/MemoryUtil.h"
 #include "Core/MemMap.h"
 #include "Core/Host.h"
@@ -27,7 +28,6 @@
 
 #include "native/gfx_es2/gl_state.h"
 #include "native/ext/cityhash/city.h"
-#include "ext/xxhash.h"
 
 #include "GPU/Math3D.h"
 #include "GPU/GPUState.h"
@@ -961,14 +961,14 @@ u32 TransformDrawEngine::ComputeHash() {
 	// It is really very expensive to check all the vertex data so often.
 	for (int i = 0; i < numDrawCalls; i++) {
 		if (!drawCalls[i].inds) {
-			fullhash += XXH32((const char *)drawCalls[i].verts, vertexSize * drawCalls[i].vertexCount, 0x1DE8CAC4);
+			fullhash += (u32)HashFast64((const u8 *)drawCalls[i].verts, vertexSize * drawCalls[i].vertexCount, 0x1DE8CAC4);
 		} else {
 			// This could get seriously expensive with sparse indices. Need to combine hashing ranges the same way
 			// we do when drawing.
-			fullhash += XXH32((const char *)drawCalls[i].verts + vertexSize * drawCalls[i].indexLowerBound,
+			fullhash += (u32)HashFast64((const u8 *)drawCalls[i].verts + vertexSize * drawCalls[i].indexLowerBound,
 				vertexSize * (drawCalls[i].indexUpperBound - drawCalls[i].indexLowerBound), 0x029F3EE1);
 			int indexSize = (dec_->VertexType() & GE_VTYPE_IDX_MASK) == GE_VTYPE_IDX_16BIT ? 2 : 1;
-			fullhash += XXH32((const char *)drawCalls[i].inds, indexSize * drawCalls[i].vertexCount, 0x955FD1CA);
+			fullhash += (u32)HashFast64((const u8 *)drawCalls[i].inds, indexSize * drawCalls[i].vertexCount, 0x955FD1CA);
 		}
 	}
 
@@ -29,7 +29,9 @@ win32 {
 	HEADERS += ../Common/stdafx.h
 }
 
-SOURCES += ../Common/ConsoleListener.cpp \
+SOURCES += ../Common/ChunkFile.cpp \
+	../Common/ChunkStore.cpp \
+	../Common/ConsoleListener.cpp \
 	../Common/ExtendedTrace.cpp \
 	../Common/FPURoundModeGeneric.cpp \
 	../Common/FileSearch.cpp \
@@ -43,12 +45,14 @@ SOURCES += ../Common/ConsoleListener.cpp \
 	../Common/Misc.cpp \
 	../Common/MsgHandler.cpp \
 	../Common/StringUtils.cpp \
+	../Common/TaskScheduler.cpp \
 	../Common/Thread.cpp \
 	../Common/ThreadPools.cpp \
 	../Common/Timer.cpp \
 	../Common/Version.cpp \
 	../Common/Crypto/*.cpp
 HEADERS += ../Common/ChunkFile.h \
+	../Common/ChunkStore.h \
 	../Common/ConsoleListener.h \
 	../Common/ExtendedTrace.h \
 	../Common/FileSearch.h \
@@ -61,6 +65,7 @@ HEADERS += ../Common/ChunkFile.h \
 	../Common/MemoryUtil.h \
 	../Common/MsgHandler.h \
 	../Common/StringUtils.h \
+	../Common/TaskScheduler.h \
 	../Common/Thread.h \
 	../Common/ThreadPools.h \
 	../Common/Timer.h \
@@ -234,7 +234,7 @@ void MainWindow::CoreEmitWait(bool isWaiting)
 
 void MainWindow::on_action_FileLoad_triggered()
 {
-	QString filename = QFileDialog::getOpenFileName(NULL, "Load File", g_Config.currentDirectory.c_str(), "PSP ROMs (*.pbp *.elf *.iso *.cso *.prx)");
+	QString filename = QFileDialog::getOpenFileName(NULL, "Load File", g_Config.currentDirectory.c_str(), "PSP ROMs (*.pbp *.elf *.iso *.cso *.ppz *.prx)");
 	if (QFile::exists(filename))
 	{
 		QFileInfo info(filename);
@@ -0,0 +1,102 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+// PPZTool
+//
+// Packs ISO images into PPZ images (see Core/FileSystems/PPZImage.h) and back.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Common/StdThread.h"
+#include "Core/FileSystems/PPZImage.h"
+
+static int Usage()
+{
+	printf("Usage:\n");
+	printf("  ppztool pack [-b blockKB] [-z] [-j threads] input.iso output.ppz\n");
+	printf("  ppztool unpack [-j threads] input.ppz output.iso\n\n");
+	printf("  -b  Block size in KB, 16 to 128 (default 64.)\n");
+	printf("  -z  Use zlib, smaller but slower to read than the default snappy.\n");
+	printf("  -j  Number of threads (default: all cores.)\n");
+	return 1;
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2)
+		return Usage();
+
+	const bool pack = !strcmp(argv[1], "pack");
+	if (!pack && strcmp(argv[1], "unpack"))
+		return Usage();
+
+	u32 blockSize = PPZ::DEFAULT_BLOCK_SIZE;
+	int method = PPZ::METHOD_SNAPPY;
+	int threads = (int)std::thread::hardware_concurrency();
+	const char *files[2] = { 0, 0 };
+	int numFiles = 0;
+
+	for (int i = 2; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			blockSize = atoi(argv[++i]) * 1024;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-z"))
+			method = PPZ::METHOD_ZLIB;
+		else if (numFiles < 2 && argv[i][0] != '-')
+			files[numFiles++] = argv[i];
+		else
+			return Usage();
+	}
+	if (numFiles != 2)
+		return Usage();
+
+	FILE *in = fopen(files[0], "rb");
+	if (!in)
+	{
+		fprintf(stderr, "Could not open %s\n", files[0]);
+		return 1;
+	}
+	FILE *out = fopen(files[1], "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Could not create %s\n", files[1]);
+		fclose(in);
+		return 1;
+	}
+
+	std::string error;
+	bool success;
+	if (pack)
+		success = PPZ::PackImage(in, out, blockSize, method, threads, &error);
+	else
+		success = PPZ::UnpackImage(in, out, threads, &error);
+
+	fclose(in);
+	fclose(out);
+	if (!success)
+	{
+		fprintf(stderr, "%s: %s\n", files[0], error.c_str());
+		remove(files[1]);
+		return 1;
+	}
+	return 0;
+}
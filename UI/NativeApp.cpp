@@ -50,6 +50,7 @@
 
 #include "Common/FileUtil.h"
 #include "Common/LogManager.h"
+#include "Common/TaskScheduler.h"
 #include "Core/PSPMixer.h"
 #include "Core/CPU.h"
 #include "Core/Config.h"
@@ -646,6 +647,8 @@ void NativeShutdown() {
 	screenManager = 0;
 
 	g_gameInfoCache.Shutdown();
+	// Stops the workers behind GlobalThreadPool::Loop, after anything that might still queue work.
+	TaskScheduler::Shutdown();
 
 	delete host;
 	host = 0;
@@ -663,7 +663,7 @@ namespace MainWindow
 
 	void BrowseAndBoot(std::string defaultPath, bool browseDirectory) {
 		std::string fn;
-		std::string filter = "PSP ROMs (*.iso *.cso *.pbp *.elf)|*.pbp;*.elf;*.iso;*.cso;*.prx|All files (*.*)|*.*||";
+		std::string filter = "PSP ROMs (*.iso *.cso *.ppz *.pbp *.elf)|*.pbp;*.elf;*.iso;*.cso;*.ppz;*.prx|All files (*.*)|*.*||";
 		
 		for (int i=0; i<(int)filter.length(); i++) {
 			if (filter[i] == '|')
@@ -692,7 +692,7 @@ namespace MainWindow
 				NativeMessageReceived("boot", dir.c_str());
 			}
 		}
-		else if (W32Util::BrowseForFileName(true, GetHWND(), L"Load File", defaultPath.size() ? ConvertUTF8ToWString(defaultPath).c_str() : 0, ConvertUTF8ToWString(filter).c_str(), L"*.pbp;*.elf;*.iso;*.cso;",fn))
+		else if (W32Util::BrowseForFileName(true, GetHWND(), L"Load File", defaultPath.size() ? ConvertUTF8ToWString(defaultPath).c_str() : 0, ConvertUTF8ToWString(filter).c_str(), L"*.pbp;*.elf;*.iso;*.cso;*.ppz;",fn))
 		{
 			if (globalUIState == UISTATE_INGAME || globalUIState == UISTATE_PAUSEMENU) {
 				Core_EnableStepping(false);
@@ -164,6 +164,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/native/android/app-android.cpp \
   $(SRC)/ext/disarm.cpp \
   $(SRC)/ext/libkirk/AES.c \
+  $(SRC)/ext/libkirk/AES_ni.c \
   $(SRC)/ext/libkirk/amctrl.c \
   $(SRC)/ext/libkirk/SHA1.c \
   $(SRC)/ext/libkirk/bn.c \
@@ -175,6 +176,8 @@ LOCAL_SRC_FILES := \
   $(SRC)/ext/xxhash.c \
   $(SRC)/Common/Crypto/md5.cpp \
   $(SRC)/Common/Crypto/sha1.cpp \
+  $(SRC)/Common/ChunkFile.cpp \
+  $(SRC)/Common/ChunkStore.cpp \
   $(SRC)/Common/KeyMap.cpp \
   $(SRC)/Common/LogManager.cpp \
   $(SRC)/Common/MemArena.cpp \
@@ -182,6 +185,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Common/MsgHandler.cpp \
   $(SRC)/Common/FileUtil.cpp \
   $(SRC)/Common/StringUtils.cpp \
+  $(SRC)/Common/TaskScheduler.cpp \
   $(SRC)/Common/Thread.cpp \
   $(SRC)/Common/ThreadPools.cpp \
   $(SRC)/Common/Timer.cpp \
@@ -211,6 +215,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/GPU/Software/TransformUnit.cpp \
   $(SRC)/Core/ELF/ElfReader.cpp \
   $(SRC)/Core/ELF/PBPReader.cpp \
+  $(SRC)/Core/ELF/PrxCache.cpp \
   $(SRC)/Core/ELF/PrxDecrypter.cpp \
   $(SRC)/Core/ELF/ParamSFO.cpp \
   $(SRC)/Core/HW/atrac3plus.cpp \
@@ -220,6 +225,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/HW/OMAConvert.cpp.arm \
   $(SRC)/Core/HW/MediaEngine.cpp.arm \
   $(SRC)/Core/HW/SasAudio.cpp.arm \
+  $(SRC)/Core/BootProfiler.cpp \
   $(SRC)/Core/Core.cpp \
   $(SRC)/Core/Config.cpp \
   $(SRC)/Core/CoreTiming.cpp \
@@ -242,6 +248,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/Dialog/PSPOskDialog.cpp \
   $(SRC)/Core/Dialog/PSPPlaceholderDialog.cpp \
   $(SRC)/Core/Dialog/PSPSaveDialog.cpp \
+  $(SRC)/Core/Dialog/SavedataIndex.cpp \
   $(SRC)/Core/Dialog/SavedataParam.cpp \
   $(SRC)/Core/Font/PGF.cpp \
   $(SRC)/Core/HLE/HLETables.cpp \
@@ -300,8 +307,10 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/HLE/sceNp.cpp \
   $(SRC)/Core/HLE/scePauth.cpp \
   $(SRC)/Core/FileSystems/BlockDevices.cpp \
+  $(SRC)/Core/FileSystems/FileTrace.cpp \
   $(SRC)/Core/FileSystems/ISOFileSystem.cpp \
   $(SRC)/Core/FileSystems/MetaFileSystem.cpp \
+  $(SRC)/Core/FileSystems/PPZImage.cpp \
   $(SRC)/Core/FileSystems/DirectoryFileSystem.cpp \
   $(SRC)/Core/FileSystems/VirtualDiscFileSystem.cpp \
   $(SRC)/Core/FileSystems/tlzrc.cpp \
@@ -310,6 +319,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/Util/BlockAllocator.cpp \
   $(SRC)/Core/Util/ppge_atlas.cpp \
   $(SRC)/Core/Util/PPGeDraw.cpp \
+  $(SRC)/Core/Util/StateRingbuffer.cpp \
   $(SRC)/git-version.cpp
 
 
@@ -1267,16 +1267,30 @@ rijndael_set_key(rijndael_ctx *ctx, const u8 *key, int bits)
 	return 0;
 }
 
+static int aes_use_hw = 0;
+
+void AES_set_hw_enabled(int enabled)
+{
+#ifdef AES_NI_AVAILABLE
+	aes_use_hw = enabled != 0;
+#endif
+}
+
+int AES_get_hw_enabled(void)
+{
+	return aes_use_hw;
+}
+
 void
 rijndael_decrypt(rijndael_ctx *ctx, const u8 *src, u8 *dst)
 {
-	rijndaelDecrypt(ctx->dk, ctx->Nr, src, dst);
+	AES_decrypt((AES_ctx *)ctx, src, dst);
 }
 
 void
 rijndael_encrypt(rijndael_ctx *ctx, const u8 *src, u8 *dst)
 {
-	rijndaelEncrypt(ctx->ek, ctx->Nr, src, dst);
+	AES_encrypt((AES_ctx *)ctx, src, dst);
 }
 
 int AES_set_key(AES_ctx *ctx, const u8 *key, int bits)
@@ -1286,11 +1300,25 @@ int AES_set_key(AES_ctx *ctx, const u8 *key, int bits)
 
 void AES_decrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
 {
+#ifdef AES_NI_AVAILABLE
+	if (aes_use_hw)
+	{
+		AES_ni_ecb_decrypt(ctx->dk, ctx->Nr, src, dst, 1);
+		return;
+	}
+#endif
 	rijndaelDecrypt(ctx->dk, ctx->Nr, src, dst);
 }
 
 void AES_encrypt(AES_ctx *ctx, const u8 *src, u8 *dst)
 {
+#ifdef AES_NI_AVAILABLE
+	if (aes_use_hw)
+	{
+		AES_ni_ecb_encrypt(ctx->ek, ctx->Nr, src, dst, 1);
+		return;
+	}
+#endif
 	rijndaelEncrypt(ctx->ek, ctx->Nr, src, dst);
 }
 
@@ -1309,6 +1337,13 @@ void AES_cbc_encrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size)
 	u8 block_buff[16];
 	
 	int i;
+#ifdef AES_NI_AVAILABLE
+	if (aes_use_hw)
+	{
+		AES_ni_cbc_encrypt(ctx->ek, ctx->Nr, src, dst, size);
+		return;
+	}
+#endif
 	for(i = 0; i < size; i+=16)
 	{
 		//step 1: copy block to dst
@@ -1331,6 +1366,13 @@ void AES_cbc_decrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size)
 	u8 block_buff_previous[16];
 	int i;
 	
+#ifdef AES_NI_AVAILABLE
+	if (aes_use_hw)
+	{
+		AES_ni_cbc_decrypt(ctx->dk, ctx->Nr, src, dst, size);
+		return;
+	}
+#endif
 	memcpy(block_buff, src, 16);
 	memcpy(block_buff_previous, src, 16);
 	AES_decrypt(ctx, src, dst);
@@ -1449,6 +1491,11 @@ void AES_CMAC (AES_ctx *ctx, unsigned char *input, int length, unsigned char *ma
     }
 
     for ( i=0; i<16; i++ ) X[i] = 0;
+#ifdef AES_NI_AVAILABLE
+    if ( aes_use_hw )
+        AES_ni_cbc_mac(ctx->ek, ctx->Nr, X, input, n-1);
+    else
+#endif
     for ( i=0; i<n-1; i++ ) 
     {
         xor_128(X,&input[16*i],Y); /* Y := Mi (+) X  */
@@ -44,6 +44,21 @@ void AES_cbc_encrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size);
 void AES_cbc_decrypt(AES_ctx *ctx, u8 *src, u8 *dst, int size);
 void AES_CMAC(AES_ctx *ctx, unsigned char *input, int length, unsigned char *mac);
 
+/* Switches AES_* and rijndael_* to AES-NI.  Only enable when CPUID reports AES (cpu_info.bAES.) */
+void AES_set_hw_enabled(int enabled);
+int AES_get_hw_enabled(void);
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define AES_NI_AVAILABLE
+
+/* AES_ni.c, on the key schedules from rijndaelKeySetupEnc/Dec. */
+void AES_ni_ecb_encrypt(const u32 *ek, int Nr, const u8 *src, u8 *dst, int blocks);
+void AES_ni_ecb_decrypt(const u32 *dk, int Nr, const u8 *src, u8 *dst, int blocks);
+void AES_ni_cbc_encrypt(const u32 *ek, int Nr, const u8 *src, u8 *dst, int size);
+void AES_ni_cbc_decrypt(const u32 *dk, int Nr, const u8 *src, u8 *dst, int size);
+void AES_ni_cbc_mac(const u32 *ek, int Nr, u8 *mac, const u8 *input, int blocks);
+#endif
+
 int	rijndaelKeySetupEnc(unsigned int [], const unsigned char [], int);
 int	rijndaelKeySetupDec(unsigned int [], const unsigned char [], int);
 void rijndaelEncrypt(const unsigned int [], int, const unsigned char [],
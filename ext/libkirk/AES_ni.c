@@ -0,0 +1,173 @@
+/*
+ * AES-NI versions of the block loops in AES.c.
+ *
+ * They take the key schedules AES.c builds, so the two paths always share keys.  The
+ * tables there keep each round key as four big endian words, the instructions want the
+ * sixteen bytes in order, so the keys are swapped into registers once per call.  The
+ * decrypt schedule from rijndaelKeySetupDec is already the equivalent inverse cipher's,
+ * which is what AESDEC expects.
+ *
+ * Only called when AES_set_hw_enabled() was given a true value, the caller checks CPUID.
+ */
+
+#include "AES.h"
+
+#ifdef AES_NI_AVAILABLE
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#define AES_NI_TARGET
+#else
+/* Lets these functions use the instructions without building the whole file with -maes. */
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+#endif
+
+AES_NI_TARGET
+static void load_round_keys(const u32 *rk, int Nr, __m128i *keys)
+{
+	u8 bytes[16];
+	int i, j;
+	for(i = 0; i <= Nr; i++)
+	{
+		for(j = 0; j < 4; j++)
+		{
+			u32 w = rk[i * 4 + j];
+			bytes[j * 4 + 0] = (u8)(w >> 24);
+			bytes[j * 4 + 1] = (u8)(w >> 16);
+			bytes[j * 4 + 2] = (u8)(w >> 8);
+			bytes[j * 4 + 3] = (u8)w;
+		}
+		keys[i] = _mm_loadu_si128((const __m128i *)bytes);
+	}
+}
+
+AES_NI_TARGET
+static __m128i encrypt_block(const __m128i *keys, int Nr, __m128i block)
+{
+	int i;
+	block = _mm_xor_si128(block, keys[0]);
+	for(i = 1; i < Nr; i++)
+		block = _mm_aesenc_si128(block, keys[i]);
+	return _mm_aesenclast_si128(block, keys[Nr]);
+}
+
+AES_NI_TARGET
+static __m128i decrypt_block(const __m128i *keys, int Nr, __m128i block)
+{
+	int i;
+	block = _mm_xor_si128(block, keys[0]);
+	for(i = 1; i < Nr; i++)
+		block = _mm_aesdec_si128(block, keys[i]);
+	return _mm_aesdeclast_si128(block, keys[Nr]);
+}
+
+AES_NI_TARGET
+void AES_ni_ecb_encrypt(const u32 *ek, int Nr, const u8 *src, u8 *dst, int blocks)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	int i;
+	load_round_keys(ek, Nr, keys);
+	for(i = 0; i < blocks; i++)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(src + i * 16));
+		_mm_storeu_si128((__m128i *)(dst + i * 16), encrypt_block(keys, Nr, block));
+	}
+}
+
+AES_NI_TARGET
+void AES_ni_ecb_decrypt(const u32 *dk, int Nr, const u8 *src, u8 *dst, int blocks)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	int i;
+	load_round_keys(dk, Nr, keys);
+	for(i = 0; i < blocks; i++)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(src + i * 16));
+		_mm_storeu_si128((__m128i *)(dst + i * 16), decrypt_block(keys, Nr, block));
+	}
+}
+
+/* Zero IV, like AES_cbc_encrypt.  Each block needs the one before, so no interleaving here. */
+AES_NI_TARGET
+void AES_ni_cbc_encrypt(const u32 *ek, int Nr, const u8 *src, u8 *dst, int size)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i chain = _mm_setzero_si128();
+	int i;
+	load_round_keys(ek, Nr, keys);
+	for(i = 0; i < size; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+		chain = encrypt_block(keys, Nr, _mm_xor_si128(block, chain));
+		_mm_storeu_si128((__m128i *)(dst + i), chain);
+	}
+}
+
+/*
+ * Zero IV, like AES_cbc_decrypt.  Blocks decrypt independently, so four go through the
+ * rounds together to keep the AES unit busy.  Everything is loaded before it's stored,
+ * so src and dst may be the same buffer.
+ */
+AES_NI_TARGET
+void AES_ni_cbc_decrypt(const u32 *dk, int Nr, const u8 *src, u8 *dst, int size)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i chain = _mm_setzero_si128();
+	int i = 0, r;
+	load_round_keys(dk, Nr, keys);
+
+	for(; i + 64 <= size; i += 64)
+	{
+		__m128i c0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i c1 = _mm_loadu_si128((const __m128i *)(src + i + 16));
+		__m128i c2 = _mm_loadu_si128((const __m128i *)(src + i + 32));
+		__m128i c3 = _mm_loadu_si128((const __m128i *)(src + i + 48));
+		__m128i b0 = _mm_xor_si128(c0, keys[0]);
+		__m128i b1 = _mm_xor_si128(c1, keys[0]);
+		__m128i b2 = _mm_xor_si128(c2, keys[0]);
+		__m128i b3 = _mm_xor_si128(c3, keys[0]);
+		for(r = 1; r < Nr; r++)
+		{
+			b0 = _mm_aesdec_si128(b0, keys[r]);
+			b1 = _mm_aesdec_si128(b1, keys[r]);
+			b2 = _mm_aesdec_si128(b2, keys[r]);
+			b3 = _mm_aesdec_si128(b3, keys[r]);
+		}
+		b0 = _mm_aesdeclast_si128(b0, keys[Nr]);
+		b1 = _mm_aesdeclast_si128(b1, keys[Nr]);
+		b2 = _mm_aesdeclast_si128(b2, keys[Nr]);
+		b3 = _mm_aesdeclast_si128(b3, keys[Nr]);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(b0, chain));
+		_mm_storeu_si128((__m128i *)(dst + i + 16), _mm_xor_si128(b1, c0));
+		_mm_storeu_si128((__m128i *)(dst + i + 32), _mm_xor_si128(b2, c1));
+		_mm_storeu_si128((__m128i *)(dst + i + 48), _mm_xor_si128(b3, c2));
+		chain = c3;
+	}
+
+	for(; i < size; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(decrypt_block(keys, Nr, block), chain));
+		chain = block;
+	}
+}
+
+/* The CBC-MAC part of AES_CMAC: mac = E(mac ^ block) for each whole block. */
+AES_NI_TARGET
+void AES_ni_cbc_mac(const u32 *ek, int Nr, u8 *mac, const u8 *input, int blocks)
+{
+	__m128i keys[AES_MAXROUNDS + 1];
+	__m128i state = _mm_loadu_si128((const __m128i *)mac);
+	int i;
+	load_round_keys(ek, Nr, keys);
+	for(i = 0; i < blocks; i++)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)(input + i * 16));
+		state = encrypt_block(keys, Nr, _mm_xor_si128(state, block));
+	}
+	_mm_storeu_si128((__m128i *)mac, state);
+}
+
+#endif
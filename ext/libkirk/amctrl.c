@@ -510,13 +510,15 @@ int sceDrmBBCipherInit(CIPHER_KEY *ckey, int type, int mode, u8 *header_key, u8
 int sceDrmBBCipherUpdate(CIPHER_KEY *ckey, u8 *data, int size)
 {
 	int p, retv, dsize;
+	// Not kirk_buf, so that several threads can decrypt at once.
+	u8 kbuf[0x0814];
 
 	retv = 0;
 	p = 0;
 
 	while(size>0){
 		dsize = (size>=0x0800)? 0x0800 : size;
-		retv = sub_428(kirk_buf, data+p, dsize, ckey);
+		retv = sub_428(kbuf, data+p, dsize, ckey);
 		if(retv)
 			break;
 		size -= dsize;
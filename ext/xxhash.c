@@ -125,12 +125,14 @@ forceinline void* XXH_memcpy(void* dest, const void* src, size_t size) { return
 #endif
 
 typedef struct _U32_S { U32 v; } _PACKED U32_S;
+typedef struct _U64_S { U64 v; } _PACKED U64_S;
 
 #if !defined(XXH_USE_UNALIGNED_ACCESS) && !defined(__GNUC__)
 #  pragma pack(pop)
 #endif
 
 #define A32(x) (((U32_S *)(x))->v)
+#define A64(x) (((U64_S *)(x))->v)
 
 
 //***************************************
@@ -141,8 +143,10 @@ typedef struct _U32_S { U32 v; } _PACKED U32_S;
 // Note : although _rotl exists for minGW (GCC under windows), performance seems poor
 #if defined(_MSC_VER)
 #  define XXH_rotl32(x,r) _rotl(x,r)
+#  define XXH_rotl64(x,r) _rotl64(x,r)
 #else
 #  define XXH_rotl32(x,r) ((x << r) | (x >> (32 - r)))
+#  define XXH_rotl64(x,r) ((x << r) | (x >> (64 - r)))
 #endif
 
 #if defined(_MSC_VER)     // Visual Studio
@@ -157,6 +161,22 @@ static inline U32 XXH_swap32 (U32 x) {
         ((x >> 24) & 0x000000ff );}
 #endif
 
+#if defined(_MSC_VER)     // Visual Studio
+#  define XXH_swap64 _byteswap_uint64
+#elif GCC_VERSION >= 403
+#  define XXH_swap64 __builtin_bswap64
+#else
+static inline U64 XXH_swap64 (U64 x) {
+    return  ((x << 56) & 0xff00000000000000ULL) |
+        ((x << 40) & 0x00ff000000000000ULL) |
+        ((x << 24) & 0x0000ff0000000000ULL) |
+        ((x << 8)  & 0x000000ff00000000ULL) |
+        ((x >> 8)  & 0x00000000ff000000ULL) |
+        ((x >> 24) & 0x0000000000ff0000ULL) |
+        ((x >> 40) & 0x000000000000ff00ULL) |
+        ((x >> 56) & 0x00000000000000ffULL);}
+#endif
+
 
 //**************************************
 // Constants
@@ -167,6 +187,12 @@ static inline U32 XXH_swap32 (U32 x) {
 #define PRIME32_4    668265263U
 #define PRIME32_5    374761393U
 
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3  1609587929392839161ULL
+#define PRIME64_4  9650029242287828579ULL
+#define PRIME64_5  2870177450012600261ULL
+
 
 //**************************************
 // Architecture Macros
@@ -199,6 +225,14 @@ forceinline U32 XXH_readLE32_align(const U32* ptr, XXH_endianess endian, XXH_ali
 
 forceinline U32 XXH_readLE32(const U32* ptr, XXH_endianess endian) { return XXH_readLE32_align(ptr, endian, XXH_unaligned); }
 
+forceinline U64 XXH_readLE64_align(const U64* ptr, XXH_endianess endian, XXH_alignment align)
+{ 
+    if (align==XXH_unaligned)
+        return endian==XXH_littleEndian ? A64(ptr) : XXH_swap64(A64(ptr)); 
+    else
+        return endian==XXH_littleEndian ? *ptr : XXH_swap64(*ptr); 
+}
+
 
 //****************************
 // Simple Hash Functions
@@ -290,6 +324,101 @@ U32 XXH32(const void* input, int len, U32 seed)
 }
 
 
+forceinline U64 XXH64_round(U64 acc, U64 input)
+{
+    acc += input * PRIME64_2;
+    acc  = XXH_rotl64(acc, 31);
+    acc *= PRIME64_1;
+    return acc;
+}
+
+forceinline U64 XXH64_mergeRound(U64 h64, U64 v)
+{
+    h64 ^= XXH64_round(0, v);
+    return h64 * PRIME64_1 + PRIME64_4;
+}
+
+forceinline U64 XXH64_endian_align(const void* input, size_t len, U64 seed, XXH_endianess endian, XXH_alignment align)
+{
+    const BYTE* p = (const BYTE*)input;
+    const BYTE* const bEnd = p + len;
+    U64 h64;
+
+#ifdef XXH_ACCEPT_NULL_INPUT_POINTER
+    if (p==NULL) { len=0; p=(const BYTE*)(size_t)32; }
+#endif
+
+    if (len>=32)
+    {
+        const BYTE* const limit = bEnd - 32;
+        U64 v1 = seed + PRIME64_1 + PRIME64_2;
+        U64 v2 = seed + PRIME64_2;
+        U64 v3 = seed + 0;
+        U64 v4 = seed - PRIME64_1;
+
+        do
+        {
+            v1 = XXH64_round(v1, XXH_readLE64_align((const U64*)p, endian, align)); p+=8;
+            v2 = XXH64_round(v2, XXH_readLE64_align((const U64*)p, endian, align)); p+=8;
+            v3 = XXH64_round(v3, XXH_readLE64_align((const U64*)p, endian, align)); p+=8;
+            v4 = XXH64_round(v4, XXH_readLE64_align((const U64*)p, endian, align)); p+=8;
+        } while (p<=limit);
+
+        h64 = XXH_rotl64(v1, 1) + XXH_rotl64(v2, 7) + XXH_rotl64(v3, 12) + XXH_rotl64(v4, 18);
+        h64 = XXH64_mergeRound(h64, v1);
+        h64 = XXH64_mergeRound(h64, v2);
+        h64 = XXH64_mergeRound(h64, v3);
+        h64 = XXH64_mergeRound(h64, v4);
+    }
+    else
+    {
+        h64  = seed + PRIME64_5;
+    }
+
+    h64 += (U64) len;
+
+    while (p+8<=bEnd)
+    {
+        h64 ^= XXH64_round(0, XXH_readLE64_align((const U64*)p, endian, align));
+        h64  = XXH_rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+        p+=8;
+    }
+
+    if (p+4<=bEnd)
+    {
+        h64 ^= (U64)(XXH_readLE32_align((const U32*)p, endian, align)) * PRIME64_1;
+        h64  = XXH_rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+        p+=4;
+    }
+
+    while (p<bEnd)
+    {
+        h64 ^= (*p) * PRIME64_5;
+        h64  = XXH_rotl64(h64, 11) * PRIME64_1;
+        p++;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= PRIME64_3;
+    h64 ^= h64 >> 32;
+
+    return h64;
+}
+
+
+unsigned long long XXH64(const void* input, size_t len, unsigned long long seed)
+{
+    XXH_endianess endian_detected = (XXH_endianess)XXH_CPU_LITTLE_ENDIAN;
+
+    if ((endian_detected==XXH_littleEndian) || XXH_FORCE_NATIVE_FORMAT)
+        return XXH64_endian_align(input, len, seed, XXH_littleEndian, XXH_unaligned);
+    else
+        return XXH64_endian_align(input, len, seed, XXH_bigEndian, XXH_unaligned);
+}
+
+
 //****************************
 // Advanced Hash Functions
 //****************************
@@ -59,6 +59,8 @@ It depends on successfully passing SMHasher test set.
 
 #pragma once
 
+#include <stddef.h>
+
 #if defined (__cplusplus)
 extern "C" {
 #endif
@@ -88,6 +90,15 @@ XXH32() :
     If your data is larger, use the advanced functions below.
 */
 
+unsigned long long XXH64 (const void* input, size_t len, unsigned long long seed);
+
+/*
+XXH64() :
+    Calculate the 64-bits hash of sequence of length "len" stored at memory address "input".
+    Same algorithm and results as XXH64 in later xxHash releases.  Faster than XXH32 on
+    64-bit CPUs, since it works on 8 bytes at a time.
+*/
+
 
 
 //****************************
@@ -0,0 +1,81 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Common/CPUDetect.h"
+#include "Common/Hash.h"
+#include "Common/StringUtils.h"
+#include "Core/Util/Benchmark.h"
+#include "ext/xxhash.h"
+
+#include "HashBench.h"
+
+typedef u32 (*HashFunc)(const std::vector<u8> &data, size_t len);
+
+static u32 HashWithXXH32(const std::vector<u8> &data, size_t len) { return XXH32(&data[0], (int)len, 0); }
+static u32 HashWithXXH64(const std::vector<u8> &data, size_t len) { return (u32)HashXXH64(&data[0], len); }
+static u32 HashWithCRC32C(const std::vector<u8> &data, size_t len) { return HashCRC32C(&data[0], len); }
+static u32 HashWithFast64(const std::vector<u8> &data, size_t len) { return (u32)HashFast64(&data[0], len); }
+static u32 HashWithMurmur3(const std::vector<u8> &data, size_t len) { return (u32)GetMurmurHash3(&data[0], (int)len, 0); }
+
+// 256 MB, in len sized pieces.
+static u64 HashLoop(HashFunc hash, const std::vector<u8> *data, size_t len)
+{
+	u64 sum = 0;
+	for (size_t done = 0; done < 256 * 1024 * 1024; done += len)
+		sum += hash(*data, len);
+	return sum;
+}
+
+static void BenchHash(const char *name, HashFunc hash, const std::vector<u8> &data, size_t len)
+{
+	RunBenchmark(StringFromFormat("Hash: %d KB, %s", (int)(len / 1024), name).c_str(), std::bind(&HashLoop, hash, &data, len), 256, "MB");
+}
+
+int RunHashBench()
+{
+	const bool wasEnabled = GetHashHardwareEnabled();
+	std::vector<u8> data(1024 * 1024);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (u8)(i * 13 + (i >> 11));
+
+	// Without SSE4.2 (on ARM, say) Fast64 is XXH64 on 64-bit CPUs and XXH32's rounds on 32-bit ones.
+	printf("Hash: %d-bit build, %s\n", (int)sizeof(void *) * 8, cpu_info.bSSE4_2 ? "SSE4.2" : "no SSE4.2");
+	const size_t sizes[2] = { 4096, 1024 * 1024 };
+	for (int i = 0; i < 2; ++i)
+	{
+		const size_t len = sizes[i];
+		SetHashHardwareEnabled(false);
+		BenchHash("XXH32", &HashWithXXH32, data, len);
+		BenchHash("XXH64", &HashWithXXH64, data, len);
+		BenchHash("Murmur3", &HashWithMurmur3, data, len);
+		BenchHash("CRC32C", &HashWithCRC32C, data, len);
+		BenchHash("Fast64", &HashWithFast64, data, len);
+		if (cpu_info.bSSE4_2)
+		{
+			SetHashHardwareEnabled(true);
+			BenchHash("CRC32C SSE4.2", &HashWithCRC32C, data, len);
+			BenchHash("Fast64 SSE4.2", &HashWithFast64, data, len);
+		}
+	}
+
+	SetHashHardwareEnabled(wasEnabled);
+	return 0;
+}
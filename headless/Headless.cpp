@@ -4,18 +4,29 @@
 
 #include <stdio.h>
 
+#include "Core/BootProfiler.h"
 #include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/System.h"
+#include "Core/FileSystems/BlockDevices.h"
+#include "Core/FileSystems/FileTrace.h"
+#include "Core/FileSystems/ISOFileSystem.h"
+#include "Core/FileSystems/MetaFileSystem.h"
+#include "Core/FileSystems/VirtualDiscFileSystem.h"
 #include "Core/HLE/sceUtility.h"
 #include "Core/Host.h"
 #include "Log.h"
 #include "LogManager.h"
+#include "MemoryUtil.h"
+#include "TaskScheduler.h"
 #include "base/NativeApp.h"
+#include "file/file_util.h"
 #include "input/input_state.h"
 
 #include "Compare.h"
+#include "HashBench.h"
+#include "HugePageBench.h"
 #include "StubHost.h"
 #ifdef _WIN32
 #include "Windows/OpenGLBase.h"
@@ -86,19 +97,75 @@ void printUsage(const char *progname, const char *reason)
 	fprintf(stderr, "  -i                    use the interpreter\n");
 	fprintf(stderr, "  -j                    use jit (default)\n");
 	fprintf(stderr, "  -c, --compare         compare with output in file.expected\n");
+	fprintf(stderr, "  --boot-profile        print how long each boot phase took\n");
+	fprintf(stderr, "  --io-trace=FILE       record the file IO to FILE\n");
+	fprintf(stderr, "  --io-replay=FILE      replay the reads of a file IO trace against the disc\n");
+	fprintf(stderr, "                        image instead of running it, and print the times\n");
+	fprintf(stderr, "  --io-paced            replay at the pace of the trace's emulated time\n");
+	fprintf(stderr, "  --huge-pages=MODE     back RAM and the JIT with huge pages (Linux), MODE is\n");
+	fprintf(stderr, "                        transparent or explicit\n");
+	fprintf(stderr, "  --bench-hugepages     time RAM and JIT code on regular and huge pages, then exit\n");
+	fprintf(stderr, "  --bench-hash          time each hash, then exit\n");
 	fprintf(stderr, "\nSee headless.txt for details.\n");
 }
 
+// Runs the trace against the disc image mounted like PSPLoaders does, without the rest of the emulator.
+static int ReplayFileTrace(const char *traceFilename, const char *discFilename, bool paced)
+{
+	std::vector<FileTraceEvent> events;
+	if (!FileTrace::Load(traceFilename, events))
+	{
+		fprintf(stderr, "Unable to read file trace %s\n", traceFilename);
+		return 1;
+	}
+
+	MetaFileSystem replayFileSystem;
+	IFileSystem *umd;
+	FileInfo info;
+	if (getFileInfo(discFilename, &info) && info.isDirectory)
+		umd = new VirtualDiscFileSystem(&replayFileSystem, discFilename);
+	else
+	{
+		BlockDevice *bd = constructBlockDevice(discFilename);
+		if (!bd)
+		{
+			fprintf(stderr, "Unable to open disc image %s\n", discFilename);
+			return 1;
+		}
+		umd = new ISOFileSystem(&replayFileSystem, bd);
+	}
+	replayFileSystem.Mount("umd0:", umd);
+	replayFileSystem.Mount("umd1:", umd);
+	replayFileSystem.Mount("disc0:", umd);
+	replayFileSystem.Mount("umd:", umd);
+
+	FileTraceReplayStats stats;
+	FileTrace::Replay(events, &replayFileSystem, paced, stats);
+	replayFileSystem.Shutdown();
+
+	printf("%s", FileTrace::GetReplayReport(stats).c_str());
+	printf("Block device cache hits: %u, misses: %u, read-ahead blocks: %u, used: %u\n",
+		blockDeviceStats.cacheHits, blockDeviceStats.cacheMisses, blockDeviceStats.readAheadBlocks, blockDeviceStats.readAheadHits);
+	return 0;
+}
+
 int main(int argc, const char* argv[])
 {
 	bool fullLog = false;
 	bool useJit = true;
 	bool autoCompare = false;
 	bool useGraphics = false;
+	bool bootProfile = false;
+	bool ioPaced = false;
+	bool benchHugePages = false;
+	bool benchHash = false;
+	int hugePages = HUGEPAGES_OFF;
 	
 	const char *bootFilename = 0;
 	const char *mountIso = 0;
 	const char *screenshotFilename = 0;
+	const char *ioTraceFilename = 0;
+	const char *ioReplayFilename = 0;
 	bool readMount = false;
 
 	for (int i = 1; i < argc; i++)
@@ -121,6 +188,22 @@ int main(int argc, const char* argv[])
 			autoCompare = true;
 		else if (!strcmp(argv[i], "--graphics"))
 			useGraphics = true;
+		else if (!strcmp(argv[i], "--boot-profile"))
+			bootProfile = true;
+		else if (!strncmp(argv[i], "--io-trace=", strlen("--io-trace=")) && strlen(argv[i]) > strlen("--io-trace="))
+			ioTraceFilename = argv[i] + strlen("--io-trace=");
+		else if (!strncmp(argv[i], "--io-replay=", strlen("--io-replay=")) && strlen(argv[i]) > strlen("--io-replay="))
+			ioReplayFilename = argv[i] + strlen("--io-replay=");
+		else if (!strcmp(argv[i], "--io-paced"))
+			ioPaced = true;
+		else if (!strcmp(argv[i], "--huge-pages=transparent"))
+			hugePages = HUGEPAGES_TRANSPARENT;
+		else if (!strcmp(argv[i], "--huge-pages=explicit"))
+			hugePages = HUGEPAGES_EXPLICIT;
+		else if (!strcmp(argv[i], "--bench-hugepages"))
+			benchHugePages = true;
+		else if (!strcmp(argv[i], "--bench-hash"))
+			benchHash = true;
 		else if (!strncmp(argv[i], "--screenshot=", strlen("--screenshot=")) && strlen(argv[i]) > strlen("--screenshot="))
 			screenshotFilename = argv[i] + strlen("--screenshot=");
 		else if (bootFilename == 0)
@@ -143,12 +226,19 @@ int main(int argc, const char* argv[])
 		printUsage(argv[0], "Missing argument after -m");
 		return 1;
 	}
+	if (benchHugePages)
+		return RunHugePageBench();
+	if (benchHash)
+		return RunHashBench();
 	if (!bootFilename)
 	{
 		printUsage(argv[0], argc <= 1 ? NULL : "No executable specified");
 		return 1;
 	}
 
+	if (ioReplayFilename)
+		return ReplayFileTrace(ioReplayFilename, bootFilename, ioPaced);
+
 	HeadlessHost *headlessHost = useGraphics ? new HEADLESSHOST_CLASS() : new HeadlessHost();
 	host = headlessHost;
 
@@ -209,6 +299,8 @@ int main(int argc, const char* argv[])
 	g_Config.iDateFormat = PSP_SYSTEMPARAM_DATE_FORMAT_DDMMYYYY;
 	g_Config.iButtonPreference = PSP_SYSTEMPARAM_BUTTON_CROSS;
 	g_Config.iLockParentalLevel = 9;
+	g_Config.sFileTraceFilename = ioTraceFilename ? ioTraceFilename : "";
+	g_Config.iHugePages = hugePages;
 
 #if defined(ANDROID)
 #elif defined(BLACKBERRY) || defined(__SYMBIAN32__)
@@ -220,6 +312,7 @@ int main(int argc, const char* argv[])
 	if (!PSP_Init(coreParameter, &error_string)) {
 		fprintf(stderr, "Failed to start %s. Error: %s\n", coreParameter.fileToStart.c_str(), error_string.c_str());
 		printf("TESTERROR\n");
+		LogManager::Shutdown();
 		return 1;
 	}
 
@@ -243,11 +336,19 @@ int main(int argc, const char* argv[])
 
 	host->ShutdownGL();
 	PSP_Shutdown();
+	TaskScheduler::Shutdown();
+
+	// Goes to stderr so it doesn't get in the way of --compare.
+	if (bootProfile)
+		fprintf(stderr, "%s", BootProfiler::GetReport().c_str());
 
 	delete host;
 	host = NULL;
 	headlessHost = NULL;
 
+	// Writes out any log messages still queued.
+	LogManager::Shutdown();
+
 	if (autoCompare)
 		CompareOutput(bootFilename);
 
@@ -0,0 +1,174 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Common/MemoryUtil.h"
+#include "Common/StringUtils.h"
+#include "Core/MemMap.h"
+#include "Core/Util/Benchmark.h"
+
+#include "HugePageBench.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Read misses of a TLB for this thread, or -1 where perf isn't allowed (see perf_event_paranoid.)
+static int OpenTLBMissCounter(u64 cache)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void StartCounter(int fd)
+{
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static s64 StopCounter(int fd)
+{
+	u64 count = 0;
+	if (fd < 0)
+		return -1;
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	bool ok = read(fd, &count, sizeof(count)) == sizeof(count);
+	close(fd);
+	return ok ? (s64)count : -1;
+}
+#else
+static int OpenTLBMissCounter(u64 cache) { return -1; }
+static void StartCounter(int fd) {}
+static s64 StopCounter(int fd) { return -1; }
+#define PERF_COUNT_HW_CACHE_DTLB 3
+#define PERF_COUNT_HW_CACHE_ITLB 4
+#endif
+
+static void PrintHugePageRun(s64 misses, const char *counter, size_t hugeBytes)
+{
+	std::string missText = misses < 0 ? "no perf counters" : StringFromFormat("%lld %s misses", (long long)misses, counter);
+	printf("  %s, %d KB on huge pages\n", missText.c_str(), (int)(hugeBytes / 1024));
+}
+
+static u64 RandomReads(const u8 *ram, u32 size, int fd, s64 *misses)
+{
+	u32 x = 12345, sum = 0;
+	StartCounter(fd);
+	for (int i = 0; i < 16 * 1024 * 1024; ++i)
+	{
+		x = x * 1664525 + 1013904223;
+		sum += *(const u32 *)(ram + ((x >> 6) & (size - 4)));
+	}
+	*misses = StopCounter(fd);
+	return sum;
+}
+
+// Random reads all over PSP RAM through the mirror the JIT uses, like a game's heap and tables would get.
+static bool BenchHugePagesRAM(int mode, const char *name)
+{
+	SetHugePageMode(mode);
+	Memory::g_MemorySize = 0x02000000;
+	Memory::Init();
+	u8 *ram = Memory::m_pPhysicalRAM;
+	if (ram == NULL)
+	{
+		fprintf(stderr, "Unable to allocate PSP RAM\n");
+		return false;
+	}
+
+	for (u32 i = 0; i < Memory::g_MemorySize; i += 4)
+		*(u32 *)(ram + i) = i;
+	// The mirrors have to stay the same memory whatever the pages are.
+	if (*(u32 *)(Memory::m_pUncachedRAM + 0x01234560) != 0x01234560 || *(u32 *)(Memory::m_pRAM + 0x01FFFFFC) != 0x01FFFFFC)
+	{
+		fprintf(stderr, "RAM mirrors don't match\n");
+		Memory::Shutdown();
+		return false;
+	}
+
+	s64 misses = -1;
+	int fd = OpenTLBMissCounter(PERF_COUNT_HW_CACHE_DTLB);
+	RunBenchmark(StringFromFormat("HugePages: RAM random reads, %s", name).c_str(),
+		std::bind(&RandomReads, ram, Memory::g_MemorySize, fd, &misses), 16, "M reads");
+	PrintHugePageRun(misses, "dTLB", GetHugePageBytes(ram, Memory::g_MemorySize));
+	Memory::Shutdown();
+	return true;
+}
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+static u64 RandomCalls(const u8 *code, size_t size, int fd, s64 *misses)
+{
+	typedef void (*BlockFunc)();
+	u32 x = 54321;
+	StartCounter(fd);
+	for (int i = 0; i < 4 * 1024 * 1024; ++i)
+	{
+		x = x * 1664525 + 1013904223;
+		((BlockFunc)(code + ((x >> 6) & (size - 64))))();
+	}
+	*misses = StopCounter(fd);
+	return x;
+}
+
+// Calls to blocks spread over a JIT sized code space, each just a ret.
+static void BenchHugePagesCode(int mode, const char *name)
+{
+	const size_t size = 16 * 1024 * 1024;
+	SetHugePageMode(mode);
+	u8 *code = (u8 *)AllocateExecutableMemory(size);
+	memset(code, 0xC3, size);
+
+	s64 misses = -1;
+	int fd = OpenTLBMissCounter(PERF_COUNT_HW_CACHE_ITLB);
+	RunBenchmark(StringFromFormat("HugePages: code space calls, %s", name).c_str(),
+		std::bind(&RandomCalls, code, size, fd, &misses), 4, "M calls");
+	PrintHugePageRun(misses, "iTLB", GetHugePageBytes(code, size));
+	FreeMemoryPages(code, size);
+}
+#endif
+
+// Where huge pages aren't available (other OSes, or the kernel settings), all runs are regular pages.
+int RunHugePageBench()
+{
+	const int wasMode = GetHugePageMode();
+	if (!BenchHugePagesRAM(HUGEPAGES_OFF, "regular") || !BenchHugePagesRAM(HUGEPAGES_TRANSPARENT, "transparent"))
+		return 1;
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+	BenchHugePagesCode(HUGEPAGES_OFF, "regular");
+	BenchHugePagesCode(HUGEPAGES_TRANSPARENT, "transparent");
+	BenchHugePagesCode(HUGEPAGES_EXPLICIT, "explicit");
+#endif
+
+	SetHugePageMode(wasMode);
+	return 0;
+}
@@ -27,13 +27,41 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "base/NativeApp.h"
 #include "Common/ArmEmitter.h"
+#include "Common/Atomics.h"
+#include "Common/CPUDetect.h"
+#include "Common/FileUtil.h"
+#include "Common/Hash.h"
+#include "Common/StringUtils.h"
+#include "Common/TaskScheduler.h"
+#include "Core/CoreTiming.h"
+#include "Core/ELF/PrxCache.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/MIPS.h"
+#include "Core/System.h"
+#include "Core/FileSystems/BlockDevices.h"
+#include "Core/FileSystems/ISOFileSystem.h"
+#include "Core/FileSystems/VirtualDiscFileSystem.h"
+#include "Core/Util/Benchmark.h"
+#include "Core/Util/StateRingbuffer.h"
 #include "ext/disarm.h"
 #include "math/math_util.h"
+#include "thread/threadpool.h"
+
+extern "C"
+{
+#include "ext/libkirk/AES.h"
+#include "ext/libkirk/amctrl.h"
+#include "ext/libkirk/kirk_engine.h"
+}
 
 #define EXPECT_TRUE(a) if (!(a)) { printf(__FUNCTION__ ":%i: Test Fail\n", __LINE__); return false; }
 #define EXPECT_FALSE(a) if ((a)) { printf(__FUNCTION__ ":%i: Test Fail\n", __LINE__); return false; }
@@ -107,9 +135,727 @@ bool TestMathUtil() {
 	return true;
 }
 
+static u64 ReadEachBlock(BlockDevice *dev, std::vector<u8> *out) {
+	const u32 numBlocks = dev->GetNumBlocks();
+	for (u32 i = 0; i < numBlocks; ++i)
+		dev->ReadBlock(i, &(*out)[i * 2048]);
+	return out->back();
+}
+
+static u64 ReadBlockBatches(BlockDevice *dev, std::vector<u8> *out, int batch) {
+	const u32 numBlocks = dev->GetNumBlocks();
+	for (u32 i = 0; i < numBlocks; i += batch)
+		dev->ReadBlocks(i, batch, &(*out)[i * 2048]);
+	return out->back();
+}
+
+// Compares block by block and batched reads over a synthetic ISO, and prints the throughput.
+bool TestBlockDevices() {
+	const int numBlocks = 8192;
+	const int batch = 64;
+	const std::string filename = "unittest_blockdevice.iso";
+
+	std::vector<u8> data(numBlocks * 2048);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (u8)((i * 2654435761U) >> 13);
+	{
+		File::IOFile f(filename, "wb");
+		EXPECT_TRUE(f.WriteBytes(&data[0], data.size()));
+	}
+
+	BlockDevice *dev = constructBlockDevice(filename.c_str());
+	EXPECT_TRUE(dev != NULL);
+	EXPECT_TRUE(dev->GetNumBlocks() == numBlocks);
+
+	std::vector<u8> single(data.size()), batched(data.size());
+	const double mb = data.size() / (1024.0 * 1024.0);
+	RunBenchmark("BlockDevice: ReadBlock", std::bind(&ReadEachBlock, dev, &single), mb, "MB");
+	RunBenchmark(StringFromFormat("BlockDevice: ReadBlocks(%d)", batch).c_str(), std::bind(&ReadBlockBatches, dev, &batched, batch), mb, "MB");
+	delete dev;
+	File::Delete(filename);
+
+	EXPECT_TRUE(single == data);
+	EXPECT_TRUE(batched == data);
+	return true;
+}
+
+// Appends an ISO 9660 directory record, moving to the next sector if it doesn't fit.
+static void AddDirRecord(std::vector<u8> &dirData, u32 lba, u32 length, bool isDir, const std::string &name) {
+	const size_t recordSize = (33 + name.size() + 1) & ~1;
+	size_t pos = dirData.size();
+	if ((pos & 2047) + recordSize > 2048)
+		pos = (pos + 2047) & ~2047;
+	dirData.resize(pos + recordSize);
+
+	u8 *r = &dirData[pos];
+	r[0] = (u8)recordSize;
+	for (int i = 0; i < 4; ++i) {
+		r[2 + i] = (u8)(lba >> (i * 8));
+		r[9 - i] = (u8)(lba >> (i * 8));
+		r[10 + i] = (u8)(length >> (i * 8));
+		r[17 - i] = (u8)(length >> (i * 8));
+	}
+	r[25] = isDir ? 2 : 0;
+	r[32] = (u8)name.size();
+	memcpy(r + 33, name.data(), name.size());
+}
+
+static u32 DirSectors(const std::vector<u8> &dirData) {
+	return (u32)((dirData.size() + 2047) / 2048);
+}
+
+static u64 MountISO(IHandleAllocator *handles, BlockDevice *dev, ISOFileSystem **fs) {
+	*fs = new ISOFileSystem(handles, dev);
+	return (u64)(uintptr_t)*fs;
+}
+
+// The first lookup in each directory, which has to read it.
+static u64 LookupFirstISOFiles(ISOFileSystem *fs, int numDirs, int filesPerDir, int *found) {
+	for (int d = 0; d < numDirs; ++d) {
+		char path[64];
+		sprintf(path, "/dir%02d/file%04d.bin", d, filesPerDir - 1);
+		PSPFileInfo info = fs->GetFileInfo(path);
+		if (info.exists && info.size == (s64)(d * filesPerDir + filesPerDir - 1))
+			++*found;
+	}
+	return *found;
+}
+
+// Spread over all the directories, in both cases and with extra slashes.
+static u64 LookupISOFiles(ISOFileSystem *fs, int numDirs, int filesPerDir, int numLookups, int *found) {
+	for (int i = 0; i < numLookups; ++i) {
+		const int d = (i * 7) % numDirs, f = (i * 13) % filesPerDir;
+		char path[64];
+		sprintf(path, (i & 1) ? "/DIR%02d/FILE%04d.BIN" : "dir%02d//file%04d.bin/", d, f);
+		PSPFileInfo info = fs->GetFileInfo(path);
+		if (info.exists && info.size == (s64)(d * filesPerDir + f))
+			++*found;
+	}
+	return *found;
+}
+
+bool TestISOFileSystem() {
+	const int numDirs = 64;
+	const int filesPerDir = 256;
+	const int numLookups = 100000;
+	const std::string filename = "unittest_filesystem.iso";
+
+	// Each subdirectory has the same number of sectors, so the layout is easy to compute.
+	std::vector<std::vector<u8> > dirs(numDirs);
+	for (int d = 0; d < numDirs; ++d) {
+		AddDirRecord(dirs[d], 0, 0, true, std::string(1, '\x00'));
+		AddDirRecord(dirs[d], 0, 0, true, std::string(1, '\x01'));
+		for (int f = 0; f < filesPerDir; ++f) {
+			char name[32];
+			sprintf(name, "FILE%04d.BIN", f);
+			AddDirRecord(dirs[d], 1000 + f, d * filesPerDir + f, false, name);
+		}
+	}
+	const u32 dirSectors = DirSectors(dirs[0]);
+
+	const u32 rootLBA = 18;
+	std::vector<u8> root;
+	AddDirRecord(root, rootLBA, 0, true, std::string(1, '\x00'));
+	AddDirRecord(root, rootLBA, 0, true, std::string(1, '\x01'));
+	const u32 firstDirLBA = rootLBA + 8;
+	for (int d = 0; d < numDirs; ++d) {
+		char name[32];
+		sprintf(name, "DIR%02d", d);
+		AddDirRecord(root, firstDirLBA + d * dirSectors, dirSectors * 2048, true, name);
+	}
+
+	std::vector<u8> iso((firstDirLBA + numDirs * dirSectors) * 2048);
+	memcpy(&iso[16 * 2048 + 1], "CD001", 5);
+	std::vector<u8> rootRecord;
+	AddDirRecord(rootRecord, rootLBA, DirSectors(root) * 2048, true, std::string(1, '\x00'));
+	memcpy(&iso[16 * 2048 + 156], &rootRecord[0], 34);
+	memcpy(&iso[rootLBA * 2048], &root[0], root.size());
+	for (int d = 0; d < numDirs; ++d)
+		memcpy(&iso[(firstDirLBA + d * dirSectors) * 2048], &dirs[d][0], dirs[d].size());
+	{
+		File::IOFile f(filename, "wb");
+		EXPECT_TRUE(f.WriteBytes(&iso[0], iso.size()));
+	}
+
+	SequentialHandleAllocator handles;
+	BlockDevice *dev = constructBlockDevice(filename.c_str());
+	EXPECT_TRUE(dev != NULL);
+
+	ISOFileSystem *fs = NULL;
+	RunBenchmark("ISOFileSystem: mount", std::bind(&MountISO, &handles, dev, &fs), 1, "mounts");
+	int firstFound = 0, found = 0;
+	RunBenchmark("ISOFileSystem: first lookup per dir", std::bind(&LookupFirstISOFiles, fs, numDirs, filesPerDir, &firstFound), numDirs, "lookups");
+	RunBenchmark("ISOFileSystem: lookups", std::bind(&LookupISOFiles, fs, numDirs, filesPerDir, numLookups, &found), numLookups, "lookups");
+
+	EXPECT_TRUE(firstFound == numDirs);
+	EXPECT_TRUE(found == numLookups);
+	EXPECT_TRUE(!fs->GetFileInfo("/dir00/missing.bin").exists);
+	EXPECT_TRUE(!fs->GetFileInfo("/dir00/file0000.bin/more").exists);
+	EXPECT_TRUE(fs->GetFileInfo("/dir63").type == FILETYPE_DIRECTORY);
+	EXPECT_TRUE(fs->GetDirListing("/dir05").size() == filesPerDir);
+
+	delete fs;
+	File::Delete(filename);
+	return true;
+}
+
+static u8 VirtualDiscByte(int file, u32 pos, u32 size) {
+	return pos < size ? (u8)(file * 13 + pos / 7 + 1) : 0;
+}
+
+struct VirtualDiscRead {
+	int file;
+	u32 sector;
+	u32 count;
+};
+
+// Reads the trace through one handle on the whole disc, and checks both ends of each sector.
+static u64 ReplayVirtualDiscReads(VirtualDiscFileSystem *fs, u32 disc, const std::vector<VirtualDiscRead> *trace,
+	const std::vector<u32> *firstBlocks, const std::vector<u32> *sizes, int *good) {
+	std::vector<u8> buffer(16 * 2048);
+	for (size_t i = 0; i < trace->size(); ++i) {
+		const VirtualDiscRead &read = (*trace)[i];
+		fs->SeekFile(disc, (*firstBlocks)[read.file] + read.sector, FILEMOVE_BEGIN);
+		if (fs->ReadFile(disc, &buffer[0], read.count) != read.count)
+			continue;
+
+		bool ok = true;
+		for (u32 s = 0; s < read.count; ++s) {
+			const u32 pos = (read.sector + s) * 2048;
+			ok = ok && buffer[s * 2048] == VirtualDiscByte(read.file, pos, (*sizes)[read.file]);
+			ok = ok && buffer[s * 2048 + 2047] == VirtualDiscByte(read.file, pos + 2047, (*sizes)[read.file]);
+		}
+		if (ok)
+			++*good;
+	}
+	return *good;
+}
+
+bool TestVirtualDiscFileSystem() {
+	const int numFiles = 512;
+	const int numReads = 20000;
+	const std::string dir = "unittest_virtualdisc/";
+
+	File::CreateDir(dir);
+	std::vector<u32> sizes(numFiles);
+	for (int f = 0; f < numFiles; ++f) {
+		// Some don't end on a sector boundary, the rest of the sector reads as zeros.
+		sizes[f] = (f % 8 + 1) * 8 * 1024 + (f % 3) * 300;
+		std::vector<u8> data(sizes[f]);
+		for (u32 i = 0; i < sizes[f]; ++i)
+			data[i] = VirtualDiscByte(f, i, sizes[f]);
+		char name[32];
+		sprintf(name, "FILE%04d.BIN", f);
+		File::IOFile out(dir + name, "wb");
+		EXPECT_TRUE(out.WriteBytes(&data[0], data.size()));
+	}
+
+	SequentialHandleAllocator handles;
+	VirtualDiscFileSystem *fs = new VirtualDiscFileSystem(&handles, dir);
+	std::vector<u32> firstBlocks(numFiles);
+	for (int f = 0; f < numFiles; ++f) {
+		char path[32];
+		sprintf(path, "/FILE%04d.BIN", f);
+		PSPFileInfo info = fs->GetFileInfo(path);
+		EXPECT_TRUE(info.exists && info.size == sizes[f]);
+		firstBlocks[f] = info.startSector;
+	}
+
+	// Mostly runs of sequential reads through a file, like streamed audio or video, with jumps between.
+	std::vector<VirtualDiscRead> trace(numReads);
+	int file = 0;
+	u32 sector = 0;
+	srand(1234);
+	for (int i = 0; i < numReads; ++i) {
+		const u32 fileSectors = (sizes[file] + 2047) / 2048;
+		if (sector >= fileSectors || rand() % 4 == 0) {
+			file = rand() % numFiles;
+			sector = rand() % ((sizes[file] + 2047) / 2048);
+		}
+		const u32 left = (sizes[file] + 2047) / 2048 - sector;
+		trace[i].file = file;
+		trace[i].sector = sector;
+		trace[i].count = std::min(left, (u32)(rand() % 16 + 1));
+		sector += trace[i].count;
+	}
+
+	u32 disc = fs->OpenFile("", FILEACCESS_READ);
+	int good = 0;
+	RunBenchmark(StringFromFormat("VirtualDiscFileSystem: %d files, trace", numFiles).c_str(),
+		std::bind(&ReplayVirtualDiscReads, fs, disc, &trace, &firstBlocks, &sizes, &good), numReads, "reads");
+	fs->CloseFile(disc);
+
+	EXPECT_TRUE(good == numReads);
+	delete fs;
+	File::DeleteDirRecursively(dir);
+	return true;
+}
+
+// Uneven work per item, every seventh one is much slower.
+static void TaskSchedulerWork(const std::vector<float> *src, std::vector<float> *dest, int l, int u) {
+	for (int i = l; i < u; ++i) {
+		float x = (*src)[i];
+		const int iterations = i % 7 == 0 ? 200 : 10;
+		for (int k = 0; k < iterations; ++k)
+			x = sqrtf(x + (float)k);
+		(*dest)[i] = x;
+	}
+}
+
+static void TaskSchedulerCount(volatile u32 *counter) {
+	Common::AtomicIncrement(*counter);
+}
+
+// Each item waits on a group of its own, from inside a task.
+static void TaskSchedulerNested(volatile u32 *counter, int l, int u) {
+	for (int i = l; i < u; ++i) {
+		TaskGroup group;
+		for (int j = 0; j < 8; ++j)
+			group.Run(std::bind(&TaskSchedulerCount, counter));
+	}
+}
+
+static u64 ThreadPoolLoop(ThreadPool *pool, const std::function<void(int,int)> *loop, int count) {
+	pool->ParallelLoop(*loop, 0, count);
+	return count;
+}
+
+static u64 ParallelForLoop(const std::function<void(int,int)> *loop, int count) {
+	TaskScheduler::ParallelFor(*loop, 0, count);
+	return count;
+}
+
+// Checks ParallelFor, groups and handles, and compares loop times against the old ThreadPool.
+bool TestTaskScheduler() {
+	const int count = 20000;
+	const int reps = 100;
+	std::vector<float> src(count), serial(count), parallel(count);
+	for (int i = 0; i < count; ++i)
+		src[i] = (float)i;
+	TaskSchedulerWork(&src, &serial, 0, count);
+
+	const std::function<void(int,int)> loop = std::bind(&TaskSchedulerWork, &src, &parallel, std::placeholders::_1, std::placeholders::_2);
+	TaskScheduler::ParallelFor(loop, 0, count);
+	EXPECT_TRUE(parallel == serial);
+	std::fill(parallel.begin(), parallel.end(), 0.0f);
+	TaskScheduler::ParallelFor(loop, 0, count, 1);
+	EXPECT_TRUE(parallel == serial);
+
+	volatile u32 counter = 0;
+	TaskScheduler::ParallelFor(std::bind(&TaskSchedulerNested, &counter, std::placeholders::_1, std::placeholders::_2), 0, 256, 1);
+	EXPECT_TRUE(counter == 256 * 8);
+
+	std::vector<TaskHandle> handles;
+	for (int i = 0; i < 256; ++i)
+		handles.push_back(TaskScheduler::Submit(std::bind(&TaskSchedulerCount, &counter)));
+	for (size_t i = 0; i < handles.size(); ++i)
+		handles[i].Wait();
+	EXPECT_TRUE(counter == 256 * 9);
+
+	ThreadPool pool(TaskScheduler::NumWorkers());
+	printf("TaskScheduler: %d workers\n", TaskScheduler::NumWorkers());
+	RunBenchmark("TaskScheduler: ThreadPool loop", std::bind(&ThreadPoolLoop, &pool, &loop, count), count, "items", reps);
+	RunBenchmark("TaskScheduler: ParallelFor loop", std::bind(&ParallelForLoop, &loop, count), count, "items", reps);
+	EXPECT_TRUE(parallel == serial);
+	return true;
+}
+
+static std::vector<u8> PrxCacheModule(int seed, u32 size) {
+	std::vector<u8> data(size);
+	for (u32 i = 0; i < size; ++i)
+		data[i] = (u8)(seed * 31 + i * 7 + (i >> 9));
+	return data;
+}
+
+// Loads the index from disk first, like the first boot of a session.
+static u64 LookupPrxCacheCold(const std::string &dir, u32 size, const PrxCache::Key &key, std::vector<u8> *buffer) {
+	PrxCache cache(dir, 3 * size);
+	return cache.Lookup(key, &(*buffer)[0], size);
+}
+
+// Stores, looks up and evicts in a temporary directory, then reloads the index from disk.
+bool TestPrxCache() {
+	const std::string dir = "unittest_prxcache/";
+	const u32 size = 256 * 1024;
+
+	std::vector<std::vector<u8> > encrypted, decrypted;
+	std::vector<PrxCache::Key> keys;
+	for (int i = 0; i < 4; ++i) {
+		encrypted.push_back(PrxCacheModule(i, size));
+		decrypted.push_back(PrxCacheModule(i + 100, size - 64 * i));
+		keys.push_back(PrxCache::MakeKey(&encrypted[i][0], size));
+	}
+
+	std::vector<u8> buffer(size);
+	{
+		// Room for three modules.
+		PrxCache cache(dir, 3 * size);
+		EXPECT_TRUE(cache.Lookup(keys[0], &buffer[0], size) == 0);
+		for (int i = 0; i < 3; ++i)
+			cache.Store(keys[i], &decrypted[i][0], (u32)decrypted[i].size());
+		EXPECT_TRUE(cache.Lookup(keys[0], &buffer[0], size) == decrypted[0].size());
+		EXPECT_TRUE(std::equal(decrypted[0].begin(), decrypted[0].end(), buffer.begin()));
+		// Too small a buffer is a miss.
+		EXPECT_TRUE(cache.Lookup(keys[0], &buffer[0], size / 2) == 0);
+
+		// Module 1 was used least recently, so it goes.
+		cache.Store(keys[0], &decrypted[0][0], (u32)decrypted[0].size());
+		cache.Store(keys[3], &decrypted[3][0], (u32)decrypted[3].size());
+		EXPECT_TRUE(cache.TotalBytes() <= 3 * size);
+		EXPECT_TRUE(cache.Lookup(keys[1], &buffer[0], size) == 0);
+		EXPECT_TRUE(cache.Lookup(keys[3], &buffer[0], size) == decrypted[3].size());
+	}
+
+	RunBenchmark(StringFromFormat("PrxCache: %d KB lookup, cold index", (int)(decrypted[2].size() / 1024)).c_str(),
+		std::bind(&LookupPrxCacheCold, dir, size, keys[2], &buffer), 1, "lookups");
+	EXPECT_TRUE(std::equal(decrypted[2].begin(), decrypted[2].end(), buffer.begin()));
+
+	File::DeleteDirRecursively(dir);
+	return true;
+}
+
+static std::vector<u8> FromHex(const char *hex) {
+	std::vector<u8> bytes;
+	for (; hex[0] && hex[1]; hex += 2) {
+		unsigned int b;
+		sscanf(hex, "%2x", &b);
+		bytes.push_back((u8)b);
+	}
+	return bytes;
+}
+
+// FIPS-197, SP 800-38A and RFC 4493 vectors through whichever AES path is enabled.
+static bool TestAESVectors() {
+	const std::vector<u8> key = FromHex("2b7e151628aed2a6abf7158809cf4f3c");
+	const std::vector<u8> plain = FromHex(
+		"6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+		"30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710");
+	AES_ctx ctx;
+	AES_set_key(&ctx, &key[0], 128);
+	u8 out[64], back[64];
+
+	const std::vector<u8> fipsKey = FromHex("000102030405060708090a0b0c0d0e0f");
+	const std::vector<u8> fipsPlain = FromHex("00112233445566778899aabbccddeeff");
+	AES_ctx fips;
+	AES_set_key(&fips, &fipsKey[0], 128);
+	AES_encrypt(&fips, &fipsPlain[0], out);
+	EXPECT_TRUE(FromHex("69c4e0d86a7b0430d8cdb78070b4c55a") == std::vector<u8>(out, out + 16));
+	AES_decrypt(&fips, out, back);
+	EXPECT_TRUE(fipsPlain == std::vector<u8>(back, back + 16));
+
+	const std::vector<u8> ecb = FromHex(
+		"3ad77bb40d7a3660a89ecaf32466ef97" "f5d3d58503b9699de785895a96fdbaaf"
+		"43b1cd7f598ece23881b00e3ed030688" "7b0c785e27e8ad3f8223207104725dd4");
+	for (int i = 0; i < 4; ++i) {
+		AES_encrypt(&ctx, &plain[i * 16], out + i * 16);
+		AES_decrypt(&ctx, &ecb[i * 16], back + i * 16);
+	}
+	EXPECT_TRUE(ecb == std::vector<u8>(out, out + 64));
+	EXPECT_TRUE(plain == std::vector<u8>(back, back + 64));
+
+	// Kirk's CBC has a zero IV, so the vector's IV goes into the first block instead.
+	const std::vector<u8> iv = FromHex("000102030405060708090a0b0c0d0e0f");
+	const std::vector<u8> cbc = FromHex(
+		"7649abac8119b246cee98e9b12e9197d" "5086cb9b507219ee95db113a917678b2"
+		"73bed6b8e3c1743b7116e69e22229516" "3ff1caa1681fac09120eca307586e1a7");
+	std::vector<u8> cbcPlain = plain;
+	for (int i = 0; i < 16; ++i)
+		cbcPlain[i] ^= iv[i];
+	AES_cbc_encrypt(&ctx, &cbcPlain[0], out, 64);
+	EXPECT_TRUE(cbc == std::vector<u8>(out, out + 64));
+	AES_cbc_decrypt(&ctx, out, out, 64);
+	EXPECT_TRUE(cbcPlain == std::vector<u8>(out, out + 64));
+
+	const int cmacLengths[4] = { 0, 16, 40, 64 };
+	const char *cmacs[4] = {
+		"bb1d6929e95937287fa37d129b756746",
+		"070a16b46b4d4144f79bdd9dd04a287c",
+		"dfa66747de9ae63030ca32611497c827",
+		"51f0bebf7e3b9d92fc49741779363cfe",
+	};
+	for (int i = 0; i < 4; ++i) {
+		AES_CMAC(&ctx, (unsigned char *)&plain[0], cmacLengths[i], out);
+		EXPECT_TRUE(FromHex(cmacs[i]) == std::vector<u8>(out, out + 16));
+	}
+	return true;
+}
+
+// Same as the NPDRM block device does per block, without the file and LZRC.
+static u64 DecryptNPDRMImage(std::vector<u8> *image, int blockSize) {
+	u8 hkey[16], vkey[16];
+	for (int i = 0; i < 16; ++i) {
+		hkey[i] = (u8)(i * 17 + 3);
+		vkey[i] = (u8)(i * 29 + 5);
+	}
+	for (size_t offset = 0; offset < image->size(); offset += blockSize) {
+		CIPHER_KEY ckey;
+		sceDrmBBCipherInit(&ckey, 1, 2, hkey, vkey, (u32)(offset >> 4));
+		sceDrmBBCipherUpdate(&ckey, &(*image)[offset], blockSize);
+		sceDrmBBCipherFinal(&ckey);
+	}
+	return image->back();
+}
+
+// Checks the software and AES-NI paths against known vectors and each other, and times both on an NPDRM sized image.
+bool TestAES() {
+	kirk_init();
+	const int wasEnabled = AES_get_hw_enabled();
+
+	AES_set_hw_enabled(0);
+	RET(TestAESVectors());
+	if (!cpu_info.bAES) {
+		printf("AES: no AES-NI on this CPU, software only\n");
+		return true;
+	}
+	AES_set_hw_enabled(1);
+	RET(TestAESVectors());
+
+	// Odd sizes, so the four block loop has leftovers, and in place like kirk does it.
+	std::vector<u8> data(16 * 1027), soft(data.size()), hard(data.size());
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (u8)(i * 7 + (i >> 8));
+	AES_ctx ctx;
+	AES_set_key(&ctx, &data[0], 128);
+	for (int size = 16; size <= (int)data.size(); size += 16 * 93) {
+		AES_set_hw_enabled(0);
+		soft = data;
+		AES_cbc_decrypt(&ctx, &soft[0], &soft[0], size);
+		AES_set_hw_enabled(1);
+		hard = data;
+		AES_cbc_decrypt(&ctx, &hard[0], &hard[0], size);
+		EXPECT_TRUE(soft == hard);
+		AES_cbc_encrypt(&ctx, &hard[0], &hard[0], size);
+		EXPECT_TRUE(std::equal(hard.begin(), hard.begin() + size, data.begin()));
+	}
+
+	const int blockSize = 16 * 2048;
+	std::vector<u8> image(64 * 1024 * 1024);
+	for (size_t i = 0; i < image.size(); ++i)
+		image[i] = (u8)(i * 13 + (i >> 11));
+	std::vector<u8> imageCopy = image;
+	const double mb = image.size() / (1024.0 * 1024.0);
+	AES_set_hw_enabled(0);
+	RunBenchmark("AES: NPDRM image, software", std::bind(&DecryptNPDRMImage, &image, blockSize), mb, "MB");
+	AES_set_hw_enabled(1);
+	RunBenchmark("AES: NPDRM image, AES-NI", std::bind(&DecryptNPDRMImage, &imageCopy, blockSize), mb, "MB");
+	EXPECT_TRUE(image == imageCopy);
+
+	AES_set_hw_enabled(wasEnabled);
+	return true;
+}
+
+// In case the code never reaches its break.  CoreTiming also needs something queued to keep time.
+static void RunMIPSTimeout(u64 userdata, int cyclesLate) {
+	Core_UpdateState(CORE_ERROR);
+}
+
+// Runs code from 0x08800000 until it hits a break, on the interpreter or a fresh JIT.
+static bool RunMIPS(CPUCore core, const u32 *code, size_t size, const u32 *regs) {
+	// Copied in untracked, and every time, since the last JIT left its emuhacks behind.
+	memcpy(Memory::GetPointer(0x08800000), code, size);
+	PSP_CoreParameter().cpuCore = core;
+	mipsr4k.Reset();
+	for (int i = 0; i < 8; ++i)
+		mipsr4k.r[i] = regs[i];
+	mipsr4k.pc = 0x08800000;
+	CoreTiming::Init();
+	CoreTiming::ScheduleEvent(0x7FFFFFFF, CoreTiming::RegisterEvent("RunMIPSTimeout", &RunMIPSTimeout));
+	coreState = CORE_RUNNING;
+	mipsr4k.RunLoopUntil(0x7FFFFFFF);
+	CoreTiming::Shutdown();
+	return coreState == CORE_STEPPING;
+}
+
+static bool TestDirtyMarking(CPUCore core) {
+	Memory::SetDirtyTracking(true);
+	const u32 codeEpoch = Memory::NextDirtyEpoch();
+	EXPECT_FALSE(Memory::IsDirtySince(0x08900000, 4, codeEpoch));
+
+	// lui a2, 0x08B0; sw a1, 0(a2); sw a1, 0(a0); sb a1, 0x2000(a0); break
+	const u32 code[] = { 0x3C0608B0, 0xACC50000, 0xAC850000, 0xA0852000, 0x0000000D };
+	const u32 regs[8] = { 0, 0, 0, 0, 0x08900000, 0x12345678 };
+	EXPECT_TRUE(RunMIPS(core, code, sizeof(code), regs));
+
+	// The JIT takes the constant address path for the first store, and the register one for the others.
+	EXPECT_TRUE(Memory::Read_U32(0x08B00000) == 0x12345678);
+	EXPECT_TRUE(Memory::IsDirtySince(0x08B00000, 4, codeEpoch));
+	EXPECT_TRUE(Memory::IsDirtySince(0x08900000, 4, codeEpoch));
+	EXPECT_TRUE(Memory::IsDirtySince(0x08902000, 1, codeEpoch));
+	EXPECT_FALSE(Memory::IsDirtySince(0x08901000, 0x1000, codeEpoch));
+	EXPECT_FALSE(Memory::IsDirtySince(0x08800000, sizeof(code), codeEpoch));
+
+	std::vector<u32> pages;
+	Memory::GetDirtyPagesSince(codeEpoch, pages);
+	EXPECT_TRUE(pages.size() == 3);
+
+	// Host side writes, through the mirrors too.
+	const u32 hostEpoch = Memory::NextDirtyEpoch();
+	EXPECT_FALSE(Memory::IsDirtySince(0x08900000, 4, hostEpoch));
+	Memory::Write_U32(1, 0x48A00000);
+	Memory::Memset(0x08A01FFE, 0, 4);
+	Memory::Write_U16(1, 0x04600000);
+	EXPECT_TRUE(Memory::IsDirtySince(0x08A00000, 4, hostEpoch));
+	EXPECT_TRUE(Memory::IsDirtySince(0x08A01000, 4, hostEpoch));
+	EXPECT_TRUE(Memory::IsDirtySince(0x08A02000, 4, hostEpoch));
+	EXPECT_TRUE(Memory::IsDirtySince(0x04000000, 4, hostEpoch));
+	EXPECT_FALSE(Memory::IsDirtySince(0x08A03000, 4, hostEpoch));
+	EXPECT_FALSE(Memory::IsDirtySince(0x08B00000, 4, hostEpoch));
+
+	Memory::SetDirtyTracking(false);
+	return true;
+}
+
+// Stores a2 words from a0 on, a pass over a game sized buffer.
+static u64 RunDirtyStores(CPUCore core) {
+	// loop: sw a1, 0(a0); addiu a0, a0, 4; addiu a2, a2, -1; bne a2, zero, loop; nop; break
+	const u32 code[] = { 0xAC850000, 0x24840004, 0x24C6FFFF, 0x14C0FFFC, 0x00000000, 0x0000000D };
+	const u32 regs[8] = { 0, 0, 0, 0, 0x08900000, 0x12345678, 0x00400000 };
+	RunMIPS(core, code, sizeof(code), regs);
+	return mipsr4k.r[4];
+}
+
+static void BenchDirtyStores(const char *name, CPUCore core, bool tracking) {
+	Memory::SetDirtyTracking(tracking);
+	RunBenchmark(name, std::bind(&RunDirtyStores, core), 0x00400000 / 1000000.0, "M stores", 8);
+	Memory::SetDirtyTracking(false);
+}
+
+// All of RAM stands in for a full savestate.
+static bool CaptureRAM(std::vector<u8> &state) {
+	state.resize(Memory::g_MemorySize);
+	memcpy(&state[0], Memory::GetPointer(PSP_GetKernelMemoryBase()), state.size());
+	return true;
+}
+
+static bool LoadRAM(u8 *state) {
+	memcpy(Memory::GetPointer(PSP_GetKernelMemoryBase()), state, Memory::g_MemorySize);
+	return true;
+}
+
+static bool TestRewindDeltas() {
+	StateRingbuffer states;
+	const size_t memoryLimit = Memory::g_MemorySize * 2;
+	Memory::Memset(PSP_GetKernelMemoryBase(), 0, Memory::g_MemorySize);
+	// Rewind used to skip pages tracking thought were clean, which lost these writes.
+	Memory::SetDirtyTracking(true);
+
+	Memory::Write_U32(0x11111111, 0x08900000);
+	EXPECT_TRUE(states.Save(&CaptureRAM, 8, memoryLimit));
+	// Untracked, like sceIoRead() or the GPU writing to RAM.
+	memset(Memory::GetPointer(0x08A00000), 0x22, 0x1000);
+	Memory::Write_U32(0x33333333, 0x08900000);
+	EXPECT_TRUE(states.Save(&CaptureRAM, 8, memoryLimit));
+	memset(Memory::GetPointer(0x08A00000), 0x44, 0x2000);
+
+	EXPECT_TRUE(states.Restore(&LoadRAM));
+	EXPECT_TRUE(Memory::Read_U32(0x08900000) == 0x33333333);
+	EXPECT_TRUE(Memory::Read_U8(0x08A00000) == 0x22 && Memory::Read_U8(0x08A00FFF) == 0x22);
+	EXPECT_TRUE(Memory::Read_U8(0x08A01000) == 0);
+
+	EXPECT_TRUE(states.Restore(&LoadRAM));
+	EXPECT_TRUE(Memory::Read_U32(0x08900000) == 0x11111111);
+	EXPECT_TRUE(Memory::Read_U8(0x08A00000) == 0 && Memory::Read_U8(0x08A00FFF) == 0);
+
+	// The oldest state stays, so rewinding again just reloads it.
+	EXPECT_TRUE(states.Restore(&LoadRAM));
+	EXPECT_TRUE(Memory::Read_U32(0x08900000) == 0x11111111);
+
+	Memory::SetDirtyTracking(false);
+	return true;
+}
+
+bool TestDirtyTracking() {
+	const u32 wasMemorySize = Memory::g_MemorySize;
+	Memory::g_MemorySize = 0x02000000;
+	Memory::Init();
+	RET(TestDirtyMarking(CPU_INTERPRETER));
+	RET(TestDirtyMarking(CPU_JIT));
+	RET(TestRewindDeltas());
+
+	BenchDirtyStores("DirtyTracking: interpreter", CPU_INTERPRETER, false);
+	BenchDirtyStores("DirtyTracking: interpreter, tracking", CPU_INTERPRETER, true);
+	BenchDirtyStores("DirtyTracking: JIT", CPU_JIT, false);
+	BenchDirtyStores("DirtyTracking: JIT, tracking", CPU_JIT, true);
+
+	PSP_CoreParameter().cpuCore = CPU_INTERPRETER;
+	mipsr4k.Reset();
+	Memory::Shutdown();
+	Memory::g_MemorySize = wasMemorySize;
+	return true;
+}
+
+// Known values, and things a weak cache hash would miss: single bit flips, swapped blocks
+// (which the old add/xor texture hash couldn't see) and a run of nearly identical keys.
+static bool TestHashCollisions() {
+	EXPECT_TRUE(HashXXH64((const u8 *)"", 0) == 0xef46db3751d8e999ULL);
+	EXPECT_TRUE(HashXXH64((const u8 *)"abc", 3) == 0x44bc2cf5ad770999ULL);
+	EXPECT_TRUE(HashCRC32C((const u8 *)"123456789", 9) == 0xE3069283);
+	EXPECT_TRUE(HashCRC32C((const u8 *)"6789", 4, HashCRC32C((const u8 *)"12345", 5)) == 0xE3069283);
+
+	std::vector<u8> data(4096);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = (u8)(i * 131 + (i >> 9));
+	EXPECT_TRUE(HashFast64Sampled(&data[0], data.size(), 0, 7) == HashFast64(&data[0], data.size(), 7));
+
+	std::set<u64> seen;
+	seen.insert(HashFast64(&data[0], data.size()));
+	for (size_t bit = 0; bit < data.size() * 8; ++bit) {
+		data[bit / 8] ^= 1 << (bit & 7);
+		seen.insert(HashFast64(&data[0], data.size()));
+		data[bit / 8] ^= 1 << (bit & 7);
+	}
+	EXPECT_TRUE(seen.size() == data.size() * 8 + 1);
+
+	const u64 before = HashFast64(&data[0], data.size());
+	std::swap_ranges(data.begin(), data.begin() + 32, data.begin() + 64);
+	EXPECT_TRUE(HashFast64(&data[0], data.size()) != before);
+	EXPECT_TRUE(HashFast64Sampled(&data[0], data.size(), 16) != HashFast64Sampled(&data[0], data.size() - 1, 16));
+
+	seen.clear();
+	std::set<u64> seenXXH64;
+	for (u32 i = 0; i < 200000; ++i) {
+		u32 key[4] = { i, 0, 0, 0 };
+		seen.insert(HashFast64((const u8 *)key, sizeof(key)));
+		seenXXH64.insert(HashXXH64((const u8 *)key, sizeof(key)));
+	}
+	EXPECT_TRUE(seen.size() == 200000);
+	EXPECT_TRUE(seenXXH64.size() == 200000);
+	return true;
+}
+
+// Checks both paths.  The throughput is headless --bench-hash, which also builds on ARM.
+bool TestHash() {
+	const bool wasEnabled = GetHashHardwareEnabled();
+	SetHashHardwareEnabled(false);
+	RET(TestHashCollisions());
+	if (cpu_info.bSSE4_2) {
+		std::vector<u8> data(1024);
+		for (size_t i = 0; i < data.size(); ++i)
+			data[i] = (u8)(i * 7 + (i >> 8));
+		std::vector<u32> soft;
+		for (size_t len = 0; len < 300; ++len)
+			soft.push_back(HashCRC32C(&data[len & 7], len, (u32)len));
+		SetHashHardwareEnabled(true);
+		for (size_t len = 0; len < 300; ++len)
+			EXPECT_TRUE(HashCRC32C(&data[len & 7], len, (u32)len) == soft[len]);
+		RET(TestHashCollisions());
+	}
+
+	SetHashHardwareEnabled(wasEnabled);
+	return true;
+}
+
 int main(int argc, const char *argv[])
 {
 	TestArmEmitter();
 	TestMathUtil();
+	TestBlockDevices();
+	TestISOFileSystem();
+	TestVirtualDiscFileSystem();
+	TestTaskScheduler();
+	TestPrxCache();
+	TestAES();
+	TestDirtyTracking();
+	TestHash();
 	return 0;
 }
\ No newline at end of file